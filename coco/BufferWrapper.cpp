@@ -0,0 +1,61 @@
+#include "BufferWrapper.hpp"
+
+
+namespace coco {
+
+BufferWrapper::BufferWrapper(Buffer &buffer)
+	: Buffer(buffer.headerData(), buffer.headerSize(), buffer.capacity(),
+		buffer.disabled() ? State::DISABLED : State::READY)
+	, buffer(buffer)
+{
+	this->observer = observe().handle;
+}
+
+BufferWrapper::~BufferWrapper() {
+	// the awaitable in the suspended coroutine removes itself from the task list of the wrapped buffer
+	this->observer.destroy();
+}
+
+bool BufferWrapper::forward(Op op) {
+	auto &buffer = this->buffer;
+	this->forwarded = false;
+	if (!buffer.ready())
+		return false;
+	buffer.headerResize(this->p.headerSize);
+	buffer.resize(this->size());
+	this->forwarded = buffer.start(op);
+	return this->forwarded;
+}
+
+void BufferWrapper::complete() {
+	auto &buffer = this->buffer;
+	if (buffer.disabled())
+		setDisabled();
+	else
+		setReady(this->forwarded ? buffer.size() : 0);
+}
+
+void BufferWrapper::follow() {
+	// a transfer in progress completes with the wrapped buffer
+	auto state = this->st.state;
+	if (state == State::BUSY)
+		return;
+
+	auto &buffer = this->buffer;
+	if (buffer.disabled()) {
+		if (state != State::DISABLED)
+			setDisabled();
+	} else if (buffer.ready()) {
+		if (state != State::READY)
+			setReady(0);
+	}
+}
+
+BufferWrapper::Observer BufferWrapper::observe() {
+	while (true) {
+		co_await this->buffer.untilStateChanged();
+		follow();
+	}
+}
+
+} // namespace coco
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Buffer.hpp"
+#include <coroutine>
+
+
+namespace coco {
+
+/**
+ * Base class for buffers that wrap a buffer of another device and use its memory, e.g. the buffers of RegisterCache,
+ * TrafficShaper and FairQueue. While no transfer is in progress, the state follows the wrapped buffer: The wrapper
+ * becomes disabled when the wrapped buffer gets disabled (e.g. the device was closed) and ready when it becomes ready
+ * again. Derived classes start their transfers on the wrapped buffer using forward() and finish them using complete().
+ */
+class BufferWrapper : public Buffer {
+public:
+	/**
+	 * Constructor
+	 * @param buffer buffer to wrap
+	 */
+	BufferWrapper(Buffer &buffer);
+	~BufferWrapper() override;
+
+protected:
+	/**
+	 * Start a transfer on the wrapped buffer, header and data are already in place as the memory is shared. If the
+	 * transfer was started, wait until the wrapped buffer is ready or disabled before calling complete()
+	 * @param op operation
+	 * @return true if the transfer was started
+	 */
+	bool forward(Op op);
+
+	/**
+	 * Complete the transfer with the size of the wrapped buffer, or set disabled state if the wrapped buffer is
+	 * disabled. A transfer that could not be started completes with size 0
+	 */
+	void complete();
+
+	/**
+	 * Follow the state of the wrapped buffer if no transfer is in progress
+	 */
+	void follow();
+
+	struct Observer {
+		struct promise_type {
+			Observer get_return_object() {return {std::coroutine_handle<promise_type>::from_promise(*this)};}
+			std::suspend_never initial_suspend() noexcept {return {};}
+			std::suspend_always final_suspend() noexcept {return {};}
+			void return_void() {}
+			void unhandled_exception() {}
+		};
+
+		std::coroutine_handle<promise_type> handle;
+	};
+	Observer observe();
+
+	Buffer &buffer;
+
+	// true if the last transfer was started on the wrapped buffer
+	bool forwarded = false;
+
+	// coroutine that waits for state changes of the wrapped buffer, gets destroyed together with the wrapper
+	std::coroutine_handle<Observer::promise_type> observer;
+};
+
+} // namespace coco
@@ -0,0 +1,112 @@
+#include "CancelScope.hpp"
+
+
+namespace coco {
+
+CancelScope::CancelScope(int capacity)
+	: buffers(new Buffer *[capacity]), capacity(capacity)
+{
+}
+
+CancelScope::CancelScope(CancelScope &parent, int capacity)
+	: parent(&parent), buffers(new Buffer *[capacity]), capacity(capacity)
+{
+	parent.children.add(*this);
+}
+
+CancelScope::~CancelScope() {
+	delete [] this->buffers;
+}
+
+bool CancelScope::start(Buffer &buffer, Buffer::Op op) {
+	if (cancelled() || !add(buffer))
+		return false;
+	return buffer.start(op);
+}
+
+bool CancelScope::add(Buffer &buffer) {
+	auto buffers = this->buffers;
+	int count = this->count;
+	for (int i = 0; i < count; ++i) {
+		if (buffers[i] == &buffer)
+			return true;
+	}
+
+	// remove buffers that are not busy when full
+	if (count == this->capacity) {
+		if (this->cancelling)
+			return false;
+		int j = 0;
+		for (int i = 0; i < count; ++i) {
+			if (buffers[i]->busy())
+				buffers[j++] = buffers[i];
+		}
+		count = j;
+		if (count == this->capacity) {
+			this->count = count;
+			return false;
+		}
+	}
+
+	buffers[count] = &buffer;
+	this->count = count + 1;
+	return true;
+}
+
+int CancelScope::cancel() {
+	this->cancelFlag = true;
+	return cancelBuffers();
+}
+
+int CancelScope::busyCount() {
+	int busyCount = 0;
+	for (int i = 0; i < this->count; ++i) {
+		if (this->buffers[i]->busy())
+			++busyCount;
+	}
+	for (auto &child : this->children) {
+		busyCount += child.busyCount();
+	}
+	return busyCount;
+}
+
+AwaitableCoroutine CancelScope::untilIdle() {
+	// wait for one busy buffer after the other, cancelled buffers typically complete immediately
+	while (auto buffer = firstBusy()) {
+		co_await buffer->untilReadyOrDisabled();
+	}
+}
+
+int CancelScope::cancelBuffers() {
+	// first cancel the buffers of all child scopes, then the own buffers
+	int busyCount = 0;
+	for (auto &child : this->children) {
+		busyCount += child.cancelBuffers();
+	}
+	// cancelling a buffer may resume a coroutine that calls add(), also when cancel() gets called recursively
+	bool cancelling = this->cancelling;
+	this->cancelling = true;
+	for (int i = 0; i < this->count; ++i) {
+		auto buffer = this->buffers[i];
+		if (buffer->busy()) {
+			++busyCount;
+			buffer->cancel();
+		}
+	}
+	this->cancelling = cancelling;
+	return busyCount;
+}
+
+Buffer *CancelScope::firstBusy() {
+	for (int i = 0; i < this->count; ++i) {
+		if (this->buffers[i]->busy())
+			return this->buffers[i];
+	}
+	for (auto &child : this->children) {
+		if (auto buffer = child.firstBusy())
+			return buffer;
+	}
+	return nullptr;
+}
+
+} // namespace coco
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Buffer.hpp"
+#include <coco/Coroutine.hpp>
+#include <coco/IntrusiveList.hpp>
+
+
+namespace coco {
+
+/**
+ * Cancellation scope for a group of transfers, e.g. all transfers of a session. Buffers that get started through the
+ * scope (or added to it) are tracked, cancel() cancels all of them at once and untilIdle() waits until all of them
+ * have returned to READY or DISABLED state. Scopes can be nested, cancelling a scope also cancels the transfers of
+ * its child scopes. After cancel(), the scope and its child scopes refuse to start new transfers until reset().
+ *
+ * Usage example:
+ * CancelScope session(8);
+ * CancelScope control(session, 2);
+ * control.start(buffer1, Buffer::Op::READ);
+ * session.start(buffer2, Buffer::Op::WRITE);
+ * session.cancel(); // cancels buffer1 and buffer2
+ * co_await session.untilIdle();
+ */
+class CancelScope : public IntrusiveListNode {
+public:
+	/**
+	 * Constructor for a root scope
+	 * @param capacity maximum number of tracked buffers
+	 */
+	CancelScope(int capacity);
+
+	/**
+	 * Constructor for a child scope
+	 * @param parent parent scope
+	 * @param capacity maximum number of tracked buffers
+	 */
+	CancelScope(CancelScope &parent, int capacity);
+
+	~CancelScope();
+
+	/**
+	 * Start a transfer and track the buffer
+	 * @param buffer buffer to start
+	 * @param op operation to start
+	 * @return true if successful, false if the scope is cancelled, the buffer could not be started or no more buffers
+	 * can be tracked
+	 */
+	bool start(Buffer &buffer, Buffer::Op op);
+
+	/**
+	 * Track a buffer that was started elsewhere. Buffers that are not busy anymore make room for new buffers, except
+	 * while the scope cancels its buffers (e.g. when called by a coroutine that got resumed by the cancellation)
+	 * @param buffer buffer to track
+	 * @return true if successful, false if no more buffers can be tracked
+	 */
+	bool add(Buffer &buffer);
+
+	/**
+	 * Returns true if the scope or one of its parents is cancelled
+	 */
+	bool cancelled() const {return this->cancelFlag || (this->parent != nullptr && this->parent->cancelled());}
+
+	/**
+	 * Cancel the transfers of all tracked buffers of this scope and its child scopes. Does not wait until the buffers
+	 * are ready, use untilIdle() to wait
+	 * @return number of buffers that were busy
+	 */
+	int cancel();
+
+	/**
+	 * Allow starting transfers again after cancel()
+	 */
+	void reset() {this->cancelFlag = false;}
+
+	/**
+	 * Get the number of busy buffers of this scope and its child scopes
+	 */
+	int busyCount();
+
+	/**
+	 * Wait until all tracked buffers of this scope and its child scopes are not busy anymore
+	 * @return use co_await on return value to wait until all buffers are ready or disabled
+	 */
+	[[nodiscard]] AwaitableCoroutine untilIdle();
+
+protected:
+	int cancelBuffers();
+	Buffer *firstBusy();
+
+	CancelScope *parent = nullptr;
+	IntrusiveList<CancelScope> children;
+
+	// tracked buffers
+	Buffer **buffers;
+	int capacity;
+	int count = 0;
+
+	bool cancelFlag = false;
+
+	// the tracked buffers get cancelled, the array must not be compacted
+	bool cancelling = false;
+};
+
+} // namespace coco
@@ -0,0 +1,153 @@
+#include "FairQueue.hpp"
+
+
+namespace coco {
+
+FairQueue::FairQueue(int depth, int quantum)
+	: BufferDevice(State::READY), depth(depth), quantum(quantum)
+{
+	assert(depth > 0 && quantum > 0);
+}
+
+FairQueue::~FairQueue() {
+}
+
+int FairQueue::getBufferCount() {
+	return this->buffers.count();
+}
+
+FairQueue::Buffer &FairQueue::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+void FairQueue::remove(Flow &flow) {
+	// an idle flow does not keep its credit
+	this->flows.remove(flow);
+	flow.active = false;
+	flow.visited = false;
+	flow.deficit = 0;
+}
+
+void FairQueue::process() {
+	// the state is updated before a transfer gets started as it may complete immediately and call process() again
+	while (this->activeTransfers < this->depth && !this->flows.empty()) {
+		auto &flow = this->flows.front();
+
+		// give the flow its quantum once per round
+		if (!flow.visited) {
+			flow.visited = true;
+			flow.deficit += this->quantum * flow.weight;
+		}
+
+		auto &buffer = flow.transfers.front();
+		int size = buffer.size();
+		if (size > flow.deficit) {
+			// not enough credit: move the flow to the end of the round, the credit is carried over
+			++flow.stats.deferredCount;
+			flow.visited = false;
+			this->flows.pop();
+			this->flows.push(flow);
+			continue;
+		}
+		flow.transfers.pop();
+		flow.deficit -= size;
+		++flow.stats.transferCount;
+		flow.stats.byteCount += size;
+		if (flow.transfers.empty())
+			remove(flow);
+
+		// start the transfer on the device
+		++this->activeTransfers;
+		buffer.active = true;
+		buffer.transfer(buffer.op);
+	}
+}
+
+
+// Flow
+
+FairQueue::Flow::Flow(FairQueue &queue, int weight)
+	: queue(queue), weight(weight)
+{
+	assert(weight > 0);
+}
+
+FairQueue::Flow::~Flow() {
+	if (this->active)
+		this->queue.remove(*this);
+}
+
+
+// Buffer
+
+FairQueue::Buffer::Buffer(Flow &flow, coco::Buffer &buffer)
+	: BufferWrapper(buffer), flow(flow)
+{
+	flow.queue.buffers.add(*this);
+}
+
+FairQueue::Buffer::~Buffer() {
+	if (this->st.state == State::BUSY && !this->active)
+		cancel();
+}
+
+bool FairQueue::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+
+	// set state before starting the transfer as it may complete immediately
+	setBusy();
+	this->op = op;
+
+	// add to the queue of the flow and add the flow to the end of the round if it was idle
+	auto &flow = this->flow;
+	auto &queue = flow.queue;
+	flow.transfers.push(*this);
+	if (!flow.active) {
+		flow.active = true;
+		queue.flows.push(flow);
+	}
+	queue.process();
+
+	return true;
+}
+
+bool FairQueue::Buffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	// the buffer completes when the device buffer completes
+	if (this->active)
+		return this->buffer.cancel();
+
+	// remove a queued transfer
+	auto &flow = this->flow;
+	flow.transfers.remove(*this);
+	if (flow.transfers.empty())
+		flow.queue.remove(flow);
+	setReady(0);
+
+	return true;
+}
+
+Coroutine FairQueue::Buffer::transfer(Op op) {
+	// start the transfer on the device
+	if (forward(op))
+		co_await this->buffer.untilReadyOrDisabled();
+	this->active = false;
+
+	// let the next transfer start before the producer gets resumed
+	auto &queue = this->flow.queue;
+	--queue.activeTransfers;
+	queue.process();
+
+	complete();
+}
+
+} // namespace coco
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "BufferDevice.hpp"
+#include "BufferWrapper.hpp"
+#include <coco/Coroutine.hpp>
+#include <coco/IntrusiveList.hpp>
+#include <coco/IntrusiveQueue.hpp>
+#include <cstdint>
+
+
+namespace coco {
+
+/**
+ * Fair queuing of the transfers of several producers that share one device, e.g. a bulk transfer and interactive
+ * messages on the same socket or bus. Each producer has a flow with a weight and its own queue. The transfers are
+ * started on the device using deficit round robin: in each round a flow may start transfers of up to quantum * weight
+ * bytes, unused bytes are carried over to the next round while the flow has queued transfers. Therefore a producer
+ * that starts many transfers can't starve the others and the bandwidth gets shared according to the weights.
+ *
+ * The buffers wrap buffers of the device and use their memory, the data is not copied. The depth limits the number of
+ * transfers that are started concurrently on the device, the transfers of one flow are started in order. Everything
+ * runs on the event loop, therefore no locking is needed.
+ *
+ * Usage example:
+ * FairQueue queue(1, 512);
+ * FairQueue::Flow bulk(queue, 1);
+ * FairQueue::Flow control(queue, 4);
+ * FairQueue::Buffer buffer1(bulk, socketBuffer1);
+ * FairQueue::Buffer buffer2(control, socketBuffer2);
+ * co_await buffer1.writeArray(data);
+ */
+class FairQueue : public BufferDevice {
+public:
+	class Buffer;
+
+	/**
+	 * Constructor
+	 * @param depth maximum number of transfers that are started concurrently on the device
+	 * @param quantum number of bytes a flow with weight 1 may transfer per round
+	 */
+	FairQueue(int depth = 1, int quantum = 512);
+	~FairQueue() override;
+
+	/**
+	 * Flow of a producer with its own queue of transfers
+	 */
+	class Flow : public IntrusiveQueueNode {
+		friend class FairQueue;
+	public:
+		/**
+		 * Flow statistics
+		 */
+		struct Statistics {
+			// number of transfers and bytes
+			int transferCount = 0;
+			int64_t byteCount = 0;
+
+			// number of rounds in which the flow had queued transfers but not enough credit
+			int deferredCount = 0;
+		};
+
+		/**
+		 * Constructor
+		 * @param queue fair queue
+		 * @param weight share of the bandwidth relative to the other flows
+		 */
+		Flow(FairQueue &queue, int weight = 1);
+		~Flow();
+
+		/**
+		 * Change the weight of the flow, takes effect in the next round
+		 * @param weight share of the bandwidth relative to the other flows
+		 */
+		void setWeight(int weight) {
+			assert(weight > 0);
+			this->weight = weight;
+		}
+
+		/**
+		 * Get the flow statistics
+		 */
+		const Statistics &statistics() const {return this->stats;}
+
+		/**
+		 * Reset the flow statistics
+		 */
+		void resetStatistics() {this->stats = {};}
+
+	protected:
+		FairQueue &queue;
+		int weight;
+
+		// queued transfers
+		IntrusiveQueue<Buffer> transfers;
+
+		// number of bytes the flow may transfer in the current round
+		int deficit = 0;
+
+		// true if the flow is in the list of active flows and got its quantum in the current round
+		bool active = false;
+		bool visited = false;
+
+		Statistics stats;
+	};
+
+	/**
+	 * Buffer that wraps a buffer of the device and uses its memory, its state follows the buffer of the device
+	 */
+	class Buffer : public BufferWrapper, public IntrusiveListNode, public IntrusiveQueueNode {
+		friend class FairQueue;
+	public:
+		/**
+		 * Constructor
+		 * @param flow flow of the producer
+		 * @param buffer buffer of the device
+		 */
+		Buffer(Flow &flow, coco::Buffer &buffer);
+		~Buffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		Coroutine transfer(Op op);
+
+		Flow &flow;
+		Op op;
+
+		// true while the transfer is on the device
+		bool active = false;
+	};
+
+	/**
+	 * Get the number of transfers that are started on the device
+	 */
+	int activeCount() const {return this->activeTransfers;}
+
+	// BufferDevice methods
+	int getBufferCount() override;
+	Buffer &getBuffer(int index) override;
+
+protected:
+	void remove(Flow &flow);
+	void process();
+
+	int depth;
+	int quantum;
+
+	// list of buffers
+	IntrusiveList<Buffer> buffers;
+
+	// flows that have queued transfers in round robin order
+	IntrusiveQueue<Flow> flows;
+
+	// number of transfers on the device
+	int activeTransfers = 0;
+};
+
+} // namespace coco
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace coco {
+
+/**
+ * Fixed size memory for the coroutine frame of a small helper coroutine, e.g. the waiters of whenAll() and the
+ * operation states of senders. The slot lives inside the object that starts the coroutine, therefore no memory gets
+ * allocated unless the frame does not fit into the slot.
+ *
+ * The operator new of the promise type gets the slot from the arguments of the coroutine and calls allocate(), the
+ * operator delete calls free(). Note that GCC reports -Wmismatched-new-delete if operator new is a template, therefore
+ * pass awaitables as pointer (e.g. const void *) instead of a template reference.
+ *
+ * Usage example:
+ * static void *operator new(std::size_t size, FrameSlot &slot) {return slot.allocate(size);}
+ * static void operator delete(void *frame) {FrameSlot::free(frame);}
+ */
+struct FrameSlot {
+	// size of the slot
+	static constexpr int SIZE = 128;
+
+	// header in front of a coroutine frame that indicates if the frame was allocated on the heap
+	static constexpr int HEADER_SIZE = alignof(std::max_align_t);
+
+	/**
+	 * Allocate memory for a coroutine frame in the slot or on the heap if it does not fit
+	 * @param size size of the coroutine frame
+	 * @return memory for the coroutine frame
+	 */
+	void *allocate(std::size_t size) {
+		uint8_t *block;
+		if (HEADER_SIZE + size <= SIZE) {
+			block = this->data;
+			block[0] = 0;
+		} else {
+			block = new uint8_t[HEADER_SIZE + size];
+			block[0] = 1;
+		}
+		return block + HEADER_SIZE;
+	}
+
+	/**
+	 * Free the memory of a coroutine frame that was allocated using allocate()
+	 * @param frame coroutine frame
+	 */
+	static void free(void *frame) {
+		auto block = static_cast<uint8_t *>(frame) - HEADER_SIZE;
+		if (block[0] != 0)
+			delete [] block;
+	}
+
+	alignas(std::max_align_t) uint8_t data[SIZE];
+};
+
+} // namespace coco
@@ -0,0 +1,194 @@
+#include "Framebuffer.hpp"
+#include <algorithm>
+#include <cstring>
+
+
+namespace coco {
+
+namespace {
+
+using Word = uintptr_t;
+
+// index of first byte that differs, a and b must differ
+int firstDifference(const uint8_t *a, const uint8_t *b, int size) {
+	int i = 0;
+	for (; i + int(sizeof(Word)) <= size; i += sizeof(Word)) {
+		Word x, y;
+		std::memcpy(&x, a + i, sizeof(Word));
+		std::memcpy(&y, b + i, sizeof(Word));
+		if (x != y)
+			break;
+	}
+	while (a[i] == b[i])
+		++i;
+	return i;
+}
+
+// index of last byte that differs, a and b must differ
+int lastDifference(const uint8_t *a, const uint8_t *b, int size) {
+	int i = size;
+	for (; i - int(sizeof(Word)) >= 0; i -= sizeof(Word)) {
+		Word x, y;
+		std::memcpy(&x, a + i - sizeof(Word), sizeof(Word));
+		std::memcpy(&y, b + i - sizeof(Word), sizeof(Word));
+		if (x != y)
+			break;
+	}
+	do {
+		--i;
+	} while (a[i] == b[i]);
+	return i;
+}
+
+} // namespace
+
+
+Framebuffer::Framebuffer(BufferDevice &device, int width, int height, int bytesPerPixel, int maxRectangles)
+	: device(device), w(width), h(height), bpp(bytesPerPixel)
+	, frame(new uint8_t[width * height * bytesPerPixel]()), sent(new uint8_t[width * height * bytesPerPixel]())
+	, rects(new Rectangle[maxRectangles]), maxRectangles(maxRectangles)
+{
+	// at least one rectangle is needed that further changes can be merged into
+	assert(maxRectangles >= 1);
+
+	// the buffers must hold the parameters of CASET/RASET and at least one pixel
+	int count = device.getBufferCount();
+	for (int i = 0; i < count; ++i) {
+		assert(device.getBuffer(i).capacity() >= std::max(4, bytesPerPixel));
+	}
+}
+
+Framebuffer::~Framebuffer() {
+	delete [] this->frame;
+	delete [] this->sent;
+	delete [] this->rects;
+}
+
+int Framebuffer::update() {
+	// check if the whole frame is dirty
+	if (this->invalid) {
+		this->invalid = false;
+		this->rects[0] = {0, 0, this->w, this->h};
+		this->rectCount = 1;
+		return 1;
+	}
+
+	int stride = this->stride();
+	int bpp = this->bpp;
+	int count = 0;
+	bool extend = false;
+	for (int y = 0; y < this->h; ++y) {
+		auto a = this->frame + y * stride;
+		auto b = this->sent + y * stride;
+
+		// check if the row has changed
+		if (std::memcmp(a, b, stride) == 0) {
+			// unchanged row ends the current rectangle
+			extend = false;
+			continue;
+		}
+
+		// find changed pixels
+		int x0 = firstDifference(a, b, stride) / bpp;
+		int x1 = lastDifference(a, b, stride) / bpp + 1;
+
+		if (extend || count == this->maxRectangles) {
+			// extend current rectangle, also across unchanged rows if the maximum number of rectangles is reached
+			auto &r = this->rects[count - 1];
+			int left = std::min(r.x, x0);
+			int right = std::max(r.x + r.width, x1);
+			r.x = left;
+			r.width = right - left;
+			r.height = y + 1 - r.y;
+		} else {
+			// start a new rectangle
+			this->rects[count++] = {x0, y, x1 - x0, 1};
+		}
+		extend = true;
+	}
+	this->rectCount = count;
+	return count;
+}
+
+AwaitableCoroutine Framebuffer::flush() {
+	update();
+
+	auto &stats = this->stats;
+	++stats.flushCount;
+	stats.framePixelCount += int64_t(this->w) * this->h;
+
+	int stride = this->stride();
+	int bpp = this->bpp;
+	for (int i = 0; i < this->rectCount; ++i) {
+		auto r = this->rects[i];
+
+		// set window and start memory write: CASET, x range, RASET, y range, RAMWR
+		for (int step = 0; step < 5; ++step) {
+			auto &buffer = nextBuffer();
+			co_await buffer.untilReadyOrDisabled();
+			if (!buffer.ready())
+				co_return;
+			auto data = buffer.data();
+			if ((step & 1) == 0) {
+				// command
+				data[0] = step == 0 ? CASET : (step == 2 ? RASET : RAMWR);
+				buffer.startWrite(1, Buffer::Op::COMMAND);
+			} else {
+				// start and end address (inclusive) as big endian
+				int start = step == 1 ? r.x : r.y;
+				int end = start + (step == 1 ? r.width : r.height) - 1;
+				data[0] = start >> 8;
+				data[1] = start;
+				data[2] = end >> 8;
+				data[3] = end;
+				buffer.startWrite(4);
+			}
+			++stats.transferCount;
+		}
+
+		// pixel data, the copy of the sent frame gets updated with the data that is actually sent
+		int rowSize = r.width * bpp;
+		int y = r.y;
+		int offset = 0;
+		while (y < r.y + r.height) {
+			auto &buffer = nextBuffer();
+			co_await buffer.untilReadyOrDisabled();
+			if (!buffer.ready())
+				co_return;
+			int capacity = buffer.capacity() / bpp * bpp;
+			auto data = buffer.data();
+			int size = 0;
+			while (size < capacity && y < r.y + r.height) {
+				int o = y * stride + r.x * bpp + offset;
+				int n = std::min(capacity - size, rowSize - offset);
+				std::memcpy(data + size, this->frame + o, n);
+				std::memcpy(this->sent + o, this->frame + o, n);
+				size += n;
+				offset += n;
+				if (offset == rowSize) {
+					offset = 0;
+					++y;
+				}
+			}
+			buffer.startWrite(size);
+			++stats.transferCount;
+		}
+
+		++stats.rectangleCount;
+		stats.pixelCount += int64_t(r.width) * r.height;
+	}
+
+	// wait until all transfers have completed
+	int bufferCount = this->device.getBufferCount();
+	for (int i = 0; i < bufferCount; ++i) {
+		co_await this->device.getBuffer(i).untilReadyOrDisabled();
+	}
+}
+
+Buffer &Framebuffer::nextBuffer() {
+	auto &buffer = this->device.getBuffer(this->bufferIndex);
+	this->bufferIndex = (this->bufferIndex + 1) % this->device.getBufferCount();
+	return buffer;
+}
+
+} // namespace coco
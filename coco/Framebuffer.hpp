@@ -0,0 +1,161 @@
+#pragma once
+
+#include "BufferDevice.hpp"
+#include <coco/Array.hpp>
+#include <coco/Coroutine.hpp>
+#include <cstdint>
+
+
+namespace coco {
+
+/**
+ * Framebuffer for displays with MIPI DCS command set (e.g. ST7789, ILI9341) that are connected to a BufferDevice
+ * supporting Op::COMMAND, e.g. an SPI channel with command/data line.
+ *
+ * The application draws into the current frame. A copy of the frame that was last sent to the display is kept, on
+ * flush() each row is compared against this copy to find the changed columns. Changed rows are combined into dirty
+ * rectangles and only these windows are sent to the display using CASET, RASET and RAMWR. The row comparison first
+ * checks for equality using memcmp() which is vectorized by the C library on most platforms, then changed rows are
+ * scanned for the first and last difference one machine word at a time.
+ *
+ * All buffers of the device are used in turn so that pixel data of the next transfer gets copied while the previous
+ * transfer is in progress. The buffers must have a capacity of at least 4 bytes (parameters of CASET/RASET) and at least
+ * one pixel.
+ *
+ * Usage example:
+ * Framebuffer framebuffer(channel, 240, 240, 2);
+ * framebuffer.row(10)[20] = 0xff;
+ * co_await framebuffer.flush();
+ */
+class Framebuffer {
+public:
+	// MIPI DCS commands
+	static constexpr uint8_t CASET = 0x2a; // column address set
+	static constexpr uint8_t RASET = 0x2b; // row address set
+	static constexpr uint8_t RAMWR = 0x2c; // memory write
+
+	/**
+	 * Rectangle in pixels
+	 */
+	struct Rectangle {
+		int x;
+		int y;
+		int width;
+		int height;
+	};
+
+	/**
+	 * Framebuffer statistics
+	 */
+	struct Statistics {
+		// number of calls to flush()
+		int flushCount = 0;
+
+		// number of dirty rectangles that were sent
+		int rectangleCount = 0;
+
+		// number of transfers (commands, parameters and pixel data)
+		int transferCount = 0;
+
+		// number of pixels that were sent
+		int64_t pixelCount = 0;
+
+		// number of pixels that full frame refreshes would have sent
+		int64_t framePixelCount = 0;
+
+		/**
+		 * Fraction of pixels that were sent compared to full frame refreshes
+		 */
+		float ratio() const {return this->framePixelCount > 0 ? float(this->pixelCount) / float(this->framePixelCount) : 0.0f;}
+	};
+
+	/**
+	 * Constructor
+	 * @param device device to send commands and pixel data to, all its buffers get used
+	 * @param width width in pixels
+	 * @param height height in pixels
+	 * @param bytesPerPixel number of bytes per pixel, e.g. 2 for RGB565
+	 * @param maxRectangles maximum number of dirty rectangles (at least 1), further changes get merged into the last
+	 * rectangle
+	 */
+	Framebuffer(BufferDevice &device, int width, int height, int bytesPerPixel = 2, int maxRectangles = 8);
+	~Framebuffer();
+
+	int width() const {return this->w;}
+	int height() const {return this->h;}
+	int bytesPerPixel() const {return this->bpp;}
+
+	/**
+	 * Number of bytes of one row
+	 */
+	int stride() const {return this->w * this->bpp;}
+
+	/**
+	 * Get the current frame
+	 */
+	uint8_t *data() {return this->frame;}
+
+	/**
+	 * Get a row of the current frame
+	 * @param y row index
+	 */
+	uint8_t *row(int y) {return this->frame + y * stride();}
+
+	/**
+	 * Mark the whole frame as dirty, e.g. after the display was reset. Initially the whole frame is dirty
+	 */
+	void invalidate() {this->invalid = true;}
+
+	/**
+	 * Compare the current frame against the frame that was last sent and calculate the dirty rectangles. Gets called
+	 * by flush()
+	 * @return number of dirty rectangles
+	 */
+	int update();
+
+	/**
+	 * Get the dirty rectangles that were calculated by update()
+	 */
+	Array<const Rectangle> rectangles() const {return {this->rects, this->rectCount};}
+
+	/**
+	 * Send the dirty rectangles to the display
+	 * @return use co_await on return value to wait until all transfers have completed
+	 */
+	[[nodiscard]] AwaitableCoroutine flush();
+
+	/**
+	 * Get the framebuffer statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the framebuffer statistics
+	 */
+	void resetStatistics() {this->stats = {};}
+
+protected:
+	Buffer &nextBuffer();
+
+	BufferDevice &device;
+	int w;
+	int h;
+	int bpp;
+
+	// current frame and frame that was last sent to the display
+	uint8_t *frame;
+	uint8_t *sent;
+	bool invalid = true;
+
+	// dirty rectangles
+	Rectangle *rects;
+	int maxRectangles;
+	int rectCount = 0;
+
+	// index of next buffer to use
+	int bufferIndex = 0;
+
+	Statistics stats;
+};
+
+} // namespace coco
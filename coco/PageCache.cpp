@@ -0,0 +1,280 @@
+#include "PageCache.hpp"
+#include <algorithm>
+
+
+namespace coco {
+
+PageCache::PageCache(BufferDevice &device, int pageSize, SetAddress setAddress, int readAhead)
+	: BufferDevice(State::READY), device(device), pageSize(pageSize), setAddress(setAddress), readAhead(readAhead)
+{
+	int count = device.getBufferCount();
+	this->pages = new Page[count];
+	this->pageCount = count;
+	for (int i = 0; i < count; ++i) {
+		auto &buffer = device.getBuffer(i);
+		assert(buffer.capacity() >= pageSize);
+		this->pages[i] = {&buffer, 0, false, false, 0};
+	}
+}
+
+PageCache::~PageCache() {
+	delete [] this->pages;
+}
+
+void PageCache::setAddress32(coco::Buffer &buffer, [[maybe_unused]] Buffer::Op op, uint32_t address) {
+	buffer.setHeader<uint32_t>(address);
+}
+
+void PageCache::invalidate() {
+	for (int i = 0; i < this->pageCount; ++i) {
+		this->pages[i].valid = false;
+	}
+}
+
+int PageCache::getBufferCount() {
+	return this->buffers.count();
+}
+
+PageCache::Buffer &PageCache::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+PageCache::Page *PageCache::find(uint32_t address) {
+	for (int i = 0; i < this->pageCount; ++i) {
+		auto &page = this->pages[i];
+		if (page.valid && page.address == address)
+			return &page;
+	}
+	return nullptr;
+}
+
+PageCache::Page *PageCache::allocate() {
+	// find an invalid page or the least recently used page, pages that are loading can't be used
+	Page *result = nullptr;
+	for (int i = 0; i < this->pageCount; ++i) {
+		auto &page = this->pages[i];
+		if (!page.buffer->ready())
+			continue;
+		if (!page.valid)
+			return &page;
+		if (result == nullptr || int32_t(page.lastUse - result->lastUse) < 0)
+			result = &page;
+	}
+	return result;
+}
+
+PageCache::Page *PageCache::oldestLoading() {
+	Page *result = nullptr;
+	for (int i = 0; i < this->pageCount; ++i) {
+		auto &page = this->pages[i];
+		if (page.buffer->busy() && (result == nullptr || int32_t(page.lastUse - result->lastUse) < 0))
+			result = &page;
+	}
+	return result;
+}
+
+void PageCache::load(Page &page, uint32_t address) {
+	page.address = address;
+	page.valid = true;
+	page.prefetched = false;
+	page.lastUse = ++this->useCounter;
+
+	auto &buffer = *page.buffer;
+	this->setAddress(buffer, Buffer::Op::READ, address);
+	buffer.startRead(this->pageSize);
+}
+
+void PageCache::prefetch(uint32_t end) {
+	// prefetch the pages following the page that contains the end of the read
+	int pageSize = this->pageSize;
+	uint32_t address = (end - 1) / pageSize * pageSize;
+	for (int i = 0; i < this->readAhead; ++i) {
+		address += pageSize;
+		if (find(address) != nullptr)
+			continue;
+		auto page = allocate();
+		if (page == nullptr)
+			break;
+		++this->stats.prefetchCount;
+		load(*page, address);
+		page->prefetched = true;
+	}
+}
+
+
+// Buffer
+
+PageCache::Buffer::Buffer(PageCache &cache, int capacity)
+	: coco::Buffer(new uint8_t[sizeof(uint32_t) + capacity], sizeof(uint32_t), capacity, cache.st.state)
+	, cache(cache)
+{
+	*reinterpret_cast<uint32_t *>(this->p.data) = 0;
+	cache.buffers.add(*this);
+}
+
+PageCache::Buffer::~Buffer() {
+	delete [] this->p.data;
+}
+
+bool PageCache::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set and the header contains the address
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+	assert(this->p.headerSize == sizeof(uint32_t));
+
+	auto &cache = this->cache;
+	auto &stats = cache.stats;
+	uint32_t address = header<uint32_t>();
+	int size = this->size();
+	if ((op & Op::WRITE) != 0) {
+		setBusy();
+		writeThrough(address, size);
+		return true;
+	}
+	++stats.readCount;
+
+	// detect sequential access
+	uint32_t end = address + size;
+	bool sequential = address == cache.nextAddress;
+	cache.nextAddress = end;
+
+	// check if all pages are in the cache and loaded
+	int pageSize = cache.pageSize;
+	bool hit = true;
+	for (uint32_t a = address / pageSize * pageSize; a < end; a += pageSize) {
+		auto page = cache.find(a);
+		if (page == nullptr || !page->buffer->ready()) {
+			hit = false;
+			break;
+		}
+	}
+
+	if (hit) {
+		// copy from the cache, the buffer stays in ready state
+		++stats.hitCount;
+		readPages(address, size);
+	} else {
+		// set state before reading as the read may complete immediately
+		setBusy();
+		readPages(address, size);
+	}
+
+	// read ahead after the read was started so that the pages of the read get loaded first
+	if (sequential && size > 0)
+		cache.prefetch(end);
+
+	return true;
+}
+
+bool PageCache::Buffer::cancel() {
+	// reads and writes complete when the transfers of the storage device complete
+	return this->st.state == State::BUSY;
+}
+
+Coroutine PageCache::Buffer::readPages(uint32_t address, int size) {
+	auto &cache = this->cache;
+	auto &stats = cache.stats;
+	int pageSize = cache.pageSize;
+	auto data = this->data();
+	int offset = 0;
+	while (offset < size) {
+		uint32_t a = address + offset;
+		uint32_t pageAddress = a / pageSize * pageSize;
+
+		// find the page or load it into an unused page
+		auto page = cache.find(pageAddress);
+		if (page == nullptr) {
+			page = cache.allocate();
+			if (page == nullptr) {
+				// all pages are loading, wait and try again. Stop if no page can be used, e.g. the device is closed
+				auto loading = cache.oldestLoading();
+				if (loading == nullptr)
+					break;
+				co_await loading->buffer->untilReadyOrDisabled();
+				continue;
+			}
+			++stats.missCount;
+			cache.load(*page, pageAddress);
+		}
+
+		// wait until the page is loaded
+		auto &buffer = *page->buffer;
+		co_await buffer.untilReadyOrDisabled();
+		if (!buffer.ready() || buffer.size() < pageSize) {
+			// read failed or was cancelled
+			page->valid = false;
+			break;
+		}
+
+		// copy from the page
+		int o = a - pageAddress;
+		int n = std::min(size - offset, pageSize - o);
+		std::copy(buffer.data() + o, buffer.data() + o + n, data + offset);
+		offset += n;
+		page->lastUse = ++cache.useCounter;
+		if (page->prefetched) {
+			page->prefetched = false;
+			++stats.prefetchHitCount;
+		}
+	}
+
+	// notify the application if the read had to wait
+	if (this->st.state == State::BUSY)
+		setReady(offset);
+}
+
+Coroutine PageCache::Buffer::writeThrough(uint32_t address, int size) {
+	auto &cache = this->cache;
+	auto &stats = cache.stats;
+	int pageSize = cache.pageSize;
+
+	// invalidate the affected pages
+	uint32_t end = address + size;
+	for (uint32_t a = address / pageSize * pageSize; a < end; a += pageSize) {
+		auto page = cache.find(a);
+		if (page != nullptr)
+			page->valid = false;
+	}
+
+	// write through the storage buffers, one transfer for each page
+	int offset = 0;
+	while (offset < size) {
+		// get an unused page for the write
+		Page *page;
+		while ((page = cache.allocate()) == nullptr) {
+			// stop if no page can be used, e.g. the device is closed
+			auto loading = cache.oldestLoading();
+			if (loading == nullptr) {
+				setReady(offset);
+				co_return;
+			}
+			co_await loading->buffer->untilReadyOrDisabled();
+		}
+		page->valid = false;
+
+		// write up to the end of the page
+		uint32_t a = address + offset;
+		int n = std::min(size - offset, pageSize - int(a % pageSize));
+		auto &buffer = *page->buffer;
+		cache.setAddress(buffer, Op::WRITE, a);
+		std::copy(this->data() + offset, this->data() + offset + n, buffer.data());
+		++stats.writeCount;
+		buffer.startWrite(n);
+		co_await buffer.untilReadyOrDisabled();
+		if (!buffer.ready() || buffer.size() < n) {
+			// write failed, report the bytes that were written
+			if (buffer.ready())
+				offset += buffer.size();
+			break;
+		}
+		offset += n;
+	}
+	setReady(offset);
+}
+
+} // namespace coco
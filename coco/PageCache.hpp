@@ -0,0 +1,166 @@
+#pragma once
+
+#include "BufferDevice.hpp"
+#include <coco/Coroutine.hpp>
+#include <coco/IntrusiveList.hpp>
+#include <cstdint>
+
+
+namespace coco {
+
+/**
+ * Page cache with read-ahead for storage devices where the header of a buffer contains the address, e.g. a SPI flash
+ * or a file. The buffers of the storage device are used as cache pages, all of them need a capacity of at least the
+ * page size. Pages get replaced in least recently used order.
+ *
+ * The buffers of the cache have a 32 bit address as header (setHeader<uint32_t>(address)), the header of the storage
+ * buffers is set by a function that is given to the constructor (e.g. read or program command and 24 bit address of a
+ * flash).
+ * Reads that hit cached pages complete immediately without a transfer on the bus. When a read continues where the
+ * last read ended, the following pages get prefetched into spare buffers while the application processes the data.
+ * Writes go directly to the storage device (with the header set by the same function) and invalidate the affected
+ * pages. A write is split at page boundaries into one transfer per page, e.g. because a page program of a flash wraps
+ * around at the end of the page.
+ *
+ * Usage example:
+ * PageCache cache(flashChannel, 256, [](Buffer &buffer, Buffer::Op op, uint32_t address) {
+ *     if ((op & Buffer::Op::WRITE) != 0)
+ *         buffer.setHeader(std::array<uint8_t, 4>{0x02, uint8_t(address >> 16), uint8_t(address >> 8), uint8_t(address)});
+ *     else
+ *         buffer.setHeader(std::array<uint8_t, 5>{0x0b, uint8_t(address >> 16), uint8_t(address >> 8), uint8_t(address), 0});
+ * });
+ * PageCache::Buffer buffer(cache, 64);
+ * buffer.setHeader<uint32_t>(0x1000);
+ * co_await buffer.read(64);
+ */
+class PageCache : public BufferDevice {
+public:
+	/**
+	 * Function that sets the header of a storage buffer to the given address for a read (loading a page) or write
+	 * (writing through to the storage device)
+	 */
+	using SetAddress = void (*)(coco::Buffer &buffer, Buffer::Op op, uint32_t address);
+
+	/**
+	 * Cache statistics
+	 */
+	struct Statistics {
+		// number of reads and reads that were completely served from the cache
+		int readCount = 0;
+		int hitCount = 0;
+
+		// number of pages that were loaded on demand
+		int missCount = 0;
+
+		// number of pages that were prefetched and prefetched pages that were used by a read
+		int prefetchCount = 0;
+		int prefetchHitCount = 0;
+
+		// number of writes to the storage device, a write that spans several pages counts once for each page
+		int writeCount = 0;
+
+		/**
+		 * Number of transfers on the storage device
+		 */
+		int transferCount() const {return this->missCount + this->prefetchCount + this->writeCount;}
+	};
+
+	/**
+	 * Constructor
+	 * @param device storage device, all its buffers are used as cache pages
+	 * @param pageSize size of a page in bytes
+	 * @param setAddress function that sets the header of a storage buffer to an address
+	 * @param readAhead number of pages to prefetch on sequential reads, 0 to disable read-ahead
+	 */
+	PageCache(BufferDevice &device, int pageSize, SetAddress setAddress = setAddress32, int readAhead = 2);
+	~PageCache() override;
+
+	/**
+	 * Buffer for reading from or writing to the storage device through the cache
+	 */
+	class Buffer : public coco::Buffer, public IntrusiveListNode {
+		friend class PageCache;
+	public:
+		/**
+		 * Constructor
+		 * @param cache page cache to attach to
+		 * @param capacity capacity of the buffer
+		 */
+		Buffer(PageCache &cache, int capacity);
+		~Buffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		Coroutine readPages(uint32_t address, int size);
+		Coroutine writeThrough(uint32_t address, int size);
+
+		PageCache &cache;
+	};
+
+	/**
+	 * Default function for setting the address, sets a 32 bit header
+	 */
+	static void setAddress32(coco::Buffer &buffer, Buffer::Op op, uint32_t address);
+
+	/**
+	 * Invalidate all pages, e.g. after the storage was modified by other means
+	 */
+	void invalidate();
+
+	/**
+	 * Get the cache statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the cache statistics
+	 */
+	void resetStatistics() {this->stats = {};}
+
+	// BufferDevice methods
+	int getBufferCount() override;
+	Buffer &getBuffer(int index) override;
+
+protected:
+	struct Page {
+		coco::Buffer *buffer;
+
+		// address of the page, valid when the page is loaded or loading (buffer is busy)
+		uint32_t address;
+		bool valid;
+
+		// page was prefetched and not used yet
+		bool prefetched;
+
+		// counter value of last use
+		uint32_t lastUse;
+	};
+
+	Page *find(uint32_t address);
+	Page *allocate();
+	Page *oldestLoading();
+	void load(Page &page, uint32_t address);
+	void prefetch(uint32_t end);
+
+	BufferDevice &device;
+	int pageSize;
+	SetAddress setAddress;
+	int readAhead;
+
+	// list of buffers
+	IntrusiveList<Buffer> buffers;
+
+	// pages, one for each buffer of the storage device
+	Page *pages;
+	int pageCount;
+	uint32_t useCounter = 0;
+
+	// end address of last read for detection of sequential access
+	uint32_t nextAddress = 0xffffffff;
+
+	Statistics stats;
+};
+
+} // namespace coco
@@ -0,0 +1,50 @@
+#include "ReadSequence.hpp"
+
+
+namespace coco {
+
+ReadSequence::ReadSequence(BufferDevice &device, int size)
+	: device(device), size(size)
+{
+}
+
+ReadSequence::~ReadSequence() {
+}
+
+Awaitable<Buffer::Events> ReadSequence::next() {
+	int count = this->device.getBufferCount();
+	if (!this->started) {
+		// start reading into all buffers that are ready
+		this->started = true;
+		this->index = 0;
+		for (int i = 0; i < count; ++i) {
+			auto &buffer = this->device.getBuffer(i);
+			if (buffer.ready())
+				start(buffer);
+		}
+	} else {
+		auto &buffer = this->device.getBuffer(this->index);
+		if (buffer.ready()) {
+			// the application has processed the buffer: read into it again and continue with the next buffer
+			++this->stats.readCount;
+			this->stats.byteCount += buffer.size();
+			start(buffer);
+			if (++this->index >= count)
+				this->index = 0;
+		} else if (buffer.disabled()) {
+			// start all buffers again on the next call
+			this->started = false;
+		}
+	}
+
+	auto &buffer = this->device.getBuffer(this->index);
+	if (buffer.busy())
+		++this->stats.waitCount;
+	return buffer.untilReadyOrDisabled();
+}
+
+void ReadSequence::start(Buffer &buffer) {
+	buffer.startRead(this->size >= 0 ? this->size : buffer.capacity());
+}
+
+} // namespace coco
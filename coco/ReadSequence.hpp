@@ -0,0 +1,97 @@
+#pragma once
+
+#include "BufferDevice.hpp"
+#include <cstdint>
+
+
+namespace coco {
+
+/**
+ * Sequence of completed reads from a BufferDevice for processing the read buffers in a loop. All buffers of the device
+ * are kept reading, next() starts the buffer that was processed in the last iteration again and waits for the next
+ * buffer in the order in which the buffers were started. Therefore the device does not become idle while the
+ * application processes a buffer.
+ *
+ * Usage example:
+ * ReadSequence reads(device);
+ * while (true) {
+ *     co_await reads.next();
+ *     if (!reads)
+ *         break; // device was disabled
+ *     process(reads->data(), reads->size());
+ * }
+ */
+class ReadSequence {
+public:
+	/**
+	 * Sequence statistics
+	 */
+	struct Statistics {
+		// number of completed reads and bytes
+		int readCount = 0;
+		int64_t byteCount = 0;
+
+		// number of calls to next() that had to wait for a read to complete, i.e. the application was faster than
+		// the device
+		int waitCount = 0;
+	};
+
+	/**
+	 * Constructor
+	 * @param device device to read from, all its buffers are used
+	 * @param size number of bytes to read into each buffer, -1 for the capacity of the buffer
+	 */
+	ReadSequence(BufferDevice &device, int size = -1);
+	~ReadSequence();
+
+	/**
+	 * Start the buffer of the last iteration again and wait for the next completed read. Starts all buffers on first
+	 * call or when called again after the device was disabled
+	 * @return use co_await on return value to wait until the next read is completed
+	 */
+	[[nodiscard]] Awaitable<Buffer::Events> next();
+
+	/**
+	 * Check if the current buffer contains a completed read after next() returned. If it is disabled, the next call
+	 * of next() starts all buffers again, also when the device was enabled in the meantime
+	 * @return true if the current buffer is ready, false if it is disabled
+	 */
+	explicit operator bool() {
+		bool ready = this->device.getBuffer(this->index).ready();
+		if (!ready)
+			this->started = false;
+		return ready;
+	}
+
+	/**
+	 * Get the current buffer
+	 */
+	Buffer &operator *() {return this->device.getBuffer(this->index);}
+	Buffer *operator ->() {return &this->device.getBuffer(this->index);}
+
+	/**
+	 * Get the sequence statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the sequence statistics
+	 */
+	void resetStatistics() {this->stats = {};}
+
+protected:
+	void start(Buffer &buffer);
+
+	BufferDevice &device;
+	int size;
+
+	// buffers are reading
+	bool started = false;
+
+	// index of current buffer
+	int index = 0;
+
+	Statistics stats;
+};
+
+} // namespace coco
@@ -0,0 +1,165 @@
+#include "RegisterCache.hpp"
+#include <algorithm>
+
+
+namespace coco {
+
+RegisterCache::RegisterCache(int registerCount, Mode mode, uint32_t addressMask)
+	: BufferDevice(State::READY)
+	, registers(new Register[registerCount]), registerCount(registerCount), addressMask(addressMask)
+{
+	for (int i = 0; i < registerCount; ++i) {
+		this->registers[i] = {0, mode, false};
+	}
+}
+
+RegisterCache::~RegisterCache() {
+	delete [] this->registers;
+}
+
+void RegisterCache::setMode(int address, int count, Mode mode) {
+	int end = std::min(address + count, this->registerCount);
+	for (int i = address; i < end; ++i) {
+		this->registers[i].mode = mode;
+		this->registers[i].valid = false;
+	}
+}
+
+void RegisterCache::invalidate(int address, int count) {
+	int end = std::min(address + count, this->registerCount);
+	for (int i = address; i < end; ++i) {
+		this->registers[i].valid = false;
+	}
+}
+
+int RegisterCache::getBufferCount() {
+	return this->buffers.count();
+}
+
+RegisterCache::Buffer &RegisterCache::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+int RegisterCache::getAddress(coco::Buffer &buffer) {
+	// header is the address in big endian byte order
+	auto header = buffer.headerData();
+	int headerSize = buffer.headerSize();
+	if (headerSize > 4)
+		return -1;
+	uint32_t address = 0;
+	for (int i = 0; i < headerSize; ++i) {
+		address = (address << 8) | header[i];
+	}
+	address &= this->addressMask;
+
+	// -1 if the address is not cached
+	return address < uint32_t(this->registerCount) ? int(address) : -1;
+}
+
+bool RegisterCache::cached(int address, int count) {
+	if (address < 0 || address + count > this->registerCount)
+		return false;
+	for (int i = 0; i < count; ++i) {
+		auto &reg = this->registers[address + i];
+		if (reg.mode != Mode::CACHEABLE || !reg.valid)
+			return false;
+	}
+	return true;
+}
+
+void RegisterCache::store(int address, const uint8_t *data, int count) {
+	if (address < 0)
+		return;
+	int end = std::min(address + count, this->registerCount);
+	for (int i = address; i < end; ++i) {
+		auto &reg = this->registers[i];
+		if (reg.mode == Mode::CACHEABLE) {
+			reg.value = data[i - address];
+			reg.valid = true;
+		}
+	}
+}
+
+
+// Buffer
+
+RegisterCache::Buffer::Buffer(RegisterCache &cache, coco::Buffer &buffer)
+	: BufferWrapper(buffer), cache(cache)
+{
+	cache.buffers.add(*this);
+}
+
+RegisterCache::Buffer::~Buffer() {
+}
+
+bool RegisterCache::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+
+	auto &cache = this->cache;
+	auto &stats = cache.stats;
+	int address = cache.getAddress(*this);
+	int size = this->size();
+	auto data = this->data();
+	if ((op & Op::READ) != 0) {
+		++stats.readCount;
+
+		// read from cache, the buffer stays in ready state
+		if (cache.cached(address, size)) {
+			for (int i = 0; i < size; ++i) {
+				data[i] = cache.registers[address + i].value;
+			}
+			++stats.hitCount;
+			return true;
+		}
+	} else {
+		++stats.writeCount;
+
+		// suppress write if the registers already contain the values
+		if (cache.cached(address, size)) {
+			bool equal = true;
+			for (int i = 0; i < size; ++i) {
+				equal &= data[i] == cache.registers[address + i].value;
+			}
+			if (equal) {
+				++stats.suppressedCount;
+				return true;
+			}
+		}
+	}
+
+	// set state before starting the transfer as it may complete immediately
+	setBusy();
+	transfer(op, address);
+
+	return true;
+}
+
+bool RegisterCache::Buffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	// the buffer completes when the bus buffer completes
+	return this->buffer.cancel();
+}
+
+Coroutine RegisterCache::Buffer::transfer(Op op, int address) {
+	auto &buffer = this->buffer;
+
+	// start the transfer on the bus
+	if (forward(op))
+		co_await buffer.untilReadyOrDisabled();
+
+	// update the cache (write-through) unless the transfer was cancelled
+	if (this->forwarded && buffer.ready() && buffer.size() == this->size())
+		this->cache.store(address, this->data(), buffer.size());
+	complete();
+}
+
+} // namespace coco
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "BufferDevice.hpp"
+#include "BufferWrapper.hpp"
+#include <coco/Coroutine.hpp>
+#include <coco/IntrusiveList.hpp>
+#include <cstdint>
+
+
+namespace coco {
+
+/**
+ * Write-through register cache for peripherals that are accessed using header-addressed buffers, e.g. a sensor on
+ * I2C or SPI where the header contains the register address. Each buffer of the cache wraps a buffer of the bus and
+ * shares its memory.
+ *
+ * The address is the header interpreted as big endian number (as sent on the bus), masked with the address mask to
+ * remove read/write flags (e.g. 0x7f if bit 7 of the header is the read flag of an SPI sensor). A transfer of n bytes
+ * accesses the registers address to address + n - 1 (auto increment). Transfers with a header of more than 4 bytes or
+ * an address beyond the number of registers always go to the bus and do not touch the cache.
+ *
+ * Reads of cacheable registers whose values are known complete immediately without a bus transfer. Writes where all
+ * registers are cacheable and already contain the given values get suppressed. All other transfers go to the bus and
+ * update the cache when they complete. Volatile registers (e.g. status or data registers) are never cached.
+ *
+ * Usage example:
+ * RegisterCache cache(128);
+ * cache.setMode(0x1e, 8, RegisterCache::Mode::VOLATILE);
+ * RegisterCache::Buffer buffer(cache, i2cBuffer);
+ * buffer.setHeader<uint8_t>(0x10);
+ * co_await buffer.writeValue<uint8_t>(0x40);
+ */
+class RegisterCache : public BufferDevice {
+public:
+	/**
+	 * Register mode
+	 */
+	enum class Mode : uint8_t {
+		// register can change by itself, always access the bus
+		VOLATILE,
+
+		// register is only changed by writes, its value can be cached
+		CACHEABLE
+	};
+
+	/**
+	 * Cache statistics
+	 */
+	struct Statistics {
+		// number of reads and reads that were served from the cache
+		int readCount = 0;
+		int hitCount = 0;
+
+		// number of writes and writes that were suppressed because the values did not change
+		int writeCount = 0;
+		int suppressedCount = 0;
+
+		/**
+		 * Number of transfers that went to the bus
+		 */
+		int transferCount() const {return this->readCount - this->hitCount + this->writeCount - this->suppressedCount;}
+	};
+
+	/**
+	 * Constructor
+	 * @param registerCount number of registers, addresses beyond are not cached
+	 * @param mode initial mode of all registers
+	 * @param addressMask mask for the address in the header
+	 */
+	RegisterCache(int registerCount, Mode mode = Mode::CACHEABLE, uint32_t addressMask = 0xffffffff);
+	~RegisterCache() override;
+
+	/**
+	 * Buffer that wraps a buffer of the bus and uses its memory, its state follows the buffer of the bus
+	 */
+	class Buffer : public BufferWrapper, public IntrusiveListNode {
+		friend class RegisterCache;
+	public:
+		/**
+		 * Constructor
+		 * @param cache register cache to attach to
+		 * @param buffer buffer of the bus
+		 */
+		Buffer(RegisterCache &cache, coco::Buffer &buffer);
+		~Buffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		Coroutine transfer(Op op, int address);
+
+		RegisterCache &cache;
+	};
+
+	/**
+	 * Set the mode of a range of registers
+	 * @param address address of first register
+	 * @param count number of registers
+	 * @param mode mode
+	 */
+	void setMode(int address, int count, Mode mode);
+
+	/**
+	 * Invalidate all registers, e.g. after a reset of the peripheral
+	 */
+	void invalidate() {invalidate(0, this->registerCount);}
+
+	/**
+	 * Invalidate a range of registers, e.g. after a command that changes registers by itself
+	 * @param address address of first register
+	 * @param count number of registers
+	 */
+	void invalidate(int address, int count);
+
+	/**
+	 * Get the cache statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the cache statistics
+	 */
+	void resetStatistics() {this->stats = {};}
+
+	// BufferDevice methods
+	int getBufferCount() override;
+	Buffer &getBuffer(int index) override;
+
+protected:
+	struct Register {
+		uint8_t value;
+		Mode mode;
+		bool valid;
+	};
+
+	int getAddress(coco::Buffer &buffer);
+	bool cached(int address, int count);
+	void store(int address, const uint8_t *data, int count);
+
+	// list of buffers
+	IntrusiveList<Buffer> buffers;
+
+	Register *registers;
+	int registerCount;
+	uint32_t addressMask;
+
+	Statistics stats;
+};
+
+} // namespace coco
@@ -0,0 +1,332 @@
+#pragma once
+
+#include "Buffer.hpp"
+#include "Device.hpp"
+#include "FrameSlot.hpp"
+#include <coco/Coroutine.hpp>
+#include <coco/Loop.hpp>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+
+namespace coco {
+
+/**
+ * Senders for buffer transfers, device state waits and the event loop in the style of sender/receiver (std::execution)
+ * for composing device I/O into pipelines without coroutines in the application.
+ *
+ * A sender describes an operation. connect() combines it with a receiver into an operation state which is started
+ * using start(). On completion the receiver gets either setValue(...) or setStopped() when the buffer or device was
+ * disabled. The operation state must not be moved and must stay alive until completion, destroying it before
+ * completion abandons the operation (but does not cancel a transfer). The operation states contain everything they
+ * need, no memory gets allocated.
+ *
+ * Usage example:
+ * struct Receiver {
+ *     void setValue(int size) {...}
+ *     void setStopped() {...}
+ * };
+ * auto operation = then(transfer(buffer, 64, Buffer::Op::READ), [](int size) {return size / 2;}).connect(Receiver());
+ * operation.start();
+ */
+
+/**
+ * Operation that waits for a buffer or device to become ready or disabled. The waiting is done by a small coroutine
+ * whose frame is placed into a slot (see FrameSlot) inside the operation state, a frame that does not fit gets
+ * allocated on the heap.
+ */
+class WaitOperation {
+public:
+	struct Task {
+		struct promise_type {
+			promise_type(WaitOperation &operation, const void *) : operation(operation) {}
+
+			static void *operator new(std::size_t size, WaitOperation &operation, const void *) {
+				return operation.slot.allocate(size);
+			}
+			static void operator delete(void *frame) {
+				FrameSlot::free(frame);
+			}
+
+			Task get_return_object() {return {std::coroutine_handle<promise_type>::from_promise(*this)};}
+			std::suspend_never initial_suspend() noexcept {return {};}
+
+			// complete the operation when the coroutine is suspended so that the receiver may destroy the operation
+			struct Final {
+				bool await_ready() noexcept {return false;}
+				void await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+					auto &operation = handle.promise().operation;
+					operation.handle = {};
+					handle.destroy();
+					operation.complete(operation);
+				}
+				void await_resume() noexcept {}
+			};
+			Final final_suspend() noexcept {return {};}
+
+			void return_void() {}
+			void unhandled_exception() {}
+
+			WaitOperation &operation;
+		};
+
+		std::coroutine_handle<promise_type> handle;
+	};
+
+	WaitOperation(void (*complete)(WaitOperation &)) : complete(complete) {}
+	WaitOperation(const WaitOperation &) = delete;
+
+	~WaitOperation() {
+		// abandon the operation, the awaitable in the frame removes itself from the task list
+		if (this->handle)
+			this->handle.destroy();
+	}
+
+protected:
+	template <typename T>
+	void wait(T &object) {
+		// complete immediately if the object is already ready or disabled, e.g. when a transfer completed in start()
+		if (object.ready() || object.disabled()) {
+			this->complete(*this);
+			return;
+		}
+
+		// the coroutine suspends until the object becomes ready or disabled
+		this->handle = waitReadyOrDisabled(*this, &object).handle;
+	}
+
+	// the operation is passed to operator new and the constructor of the promise
+	template <typename T>
+	static Task waitReadyOrDisabled([[maybe_unused]] WaitOperation &operation, T *object) {
+		co_await object->untilReadyOrDisabled();
+	}
+
+	void (*complete)(WaitOperation &);
+	std::coroutine_handle<Task::promise_type> handle;
+	FrameSlot slot;
+};
+
+/**
+ * Sender for a transfer of a buffer, completes with setValue(int size) where size is the transferred size
+ */
+class TransferSender {
+public:
+	template <typename R>
+	class Operation : public WaitOperation {
+	public:
+		Operation(Buffer &buffer, int size, Buffer::Op op, R &&receiver)
+			: WaitOperation(&Operation::onComplete), buffer(buffer), size(size), op(op)
+			, receiver(std::move(receiver)) {}
+
+		void start() {
+			auto &buffer = this->buffer;
+			bool started = this->size >= 0 ? buffer.start(this->size, this->op) : buffer.start(this->op);
+			if (!started) {
+				// buffer is disabled or busy
+				this->receiver.setStopped();
+				return;
+			}
+			wait(buffer);
+		}
+
+	protected:
+		static void onComplete(WaitOperation &operation) {
+			auto &self = static_cast<Operation &>(operation);
+			auto &buffer = self.buffer;
+			if (buffer.ready())
+				self.receiver.setValue(buffer.size());
+			else
+				self.receiver.setStopped();
+		}
+
+		Buffer &buffer;
+		int size;
+		Buffer::Op op;
+		R receiver;
+	};
+
+	TransferSender(Buffer &buffer, int size, Buffer::Op op) : buffer(buffer), size(size), op(op) {}
+
+	template <typename R>
+	Operation<std::remove_cvref_t<R>> connect(R &&receiver) {
+		return {this->buffer, this->size, this->op, std::remove_cvref_t<R>(std::forward<R>(receiver))};
+	}
+
+protected:
+	Buffer &buffer;
+	int size;
+	Buffer::Op op;
+};
+
+/**
+ * Sender that waits until a device is ready, completes with setValue() or setStopped() when the device is disabled
+ */
+class ReadySender {
+public:
+	template <typename R>
+	class Operation : public WaitOperation {
+	public:
+		Operation(Device &device, R &&receiver)
+			: WaitOperation(&Operation::onComplete), device(device), receiver(std::move(receiver)) {}
+
+		void start() {
+			wait(this->device);
+		}
+
+	protected:
+		static void onComplete(WaitOperation &operation) {
+			auto &self = static_cast<Operation &>(operation);
+			if (self.device.ready())
+				self.receiver.setValue();
+			else
+				self.receiver.setStopped();
+		}
+
+		Device &device;
+		R receiver;
+	};
+
+	ReadySender(Device &device) : device(device) {}
+
+	template <typename R>
+	Operation<std::remove_cvref_t<R>> connect(R &&receiver) {
+		return {this->device, std::remove_cvref_t<R>(std::forward<R>(receiver))};
+	}
+
+protected:
+	Device &device;
+};
+
+/**
+ * Sender that completes with setValue() from the event loop, i.e. the loop acts as scheduler
+ */
+class ScheduleSender {
+public:
+	template <typename R>
+	class Operation {
+	public:
+		Operation(Loop &loop, Milliseconds<> delay, R &&receiver)
+			: loop(loop), delay(delay), receiver(std::move(receiver))
+			, callback(makeCallback<Operation, &Operation::handle>(this)) {}
+		Operation(const Operation &) = delete;
+
+		void start() {
+			this->loop.invoke(this->callback, this->delay);
+		}
+
+	protected:
+		void handle() {
+			this->receiver.setValue();
+		}
+
+		Loop &loop;
+		Milliseconds<> delay;
+		R receiver;
+		TimedTask<Callback> callback;
+	};
+
+	ScheduleSender(Loop &loop, Milliseconds<> delay) : loop(loop), delay(delay) {}
+
+	template <typename R>
+	Operation<std::remove_cvref_t<R>> connect(R &&receiver) {
+		return {this->loop, this->delay, std::remove_cvref_t<R>(std::forward<R>(receiver))};
+	}
+
+protected:
+	Loop &loop;
+	Milliseconds<> delay;
+};
+
+/**
+ * Sender that calls a function with the values of another sender and completes with the result of the function
+ */
+template <typename S, typename F>
+class ThenSender {
+public:
+	template <typename R>
+	struct Receiver {
+		template <typename... V>
+		void setValue(V... values) {
+			if constexpr (std::is_void_v<std::invoke_result_t<F, V...>>) {
+				this->function(values...);
+				this->receiver.setValue();
+			} else {
+				this->receiver.setValue(this->function(values...));
+			}
+		}
+
+		void setStopped() {
+			this->receiver.setStopped();
+		}
+
+		R receiver;
+		F function;
+	};
+
+	ThenSender(S sender, F function) : sender(std::move(sender)), function(std::move(function)) {}
+
+	template <typename R>
+	auto connect(R &&receiver) {
+		return this->sender.connect(Receiver<std::remove_cvref_t<R>>{std::forward<R>(receiver), this->function});
+	}
+
+protected:
+	S sender;
+	F function;
+};
+
+/**
+ * Transfer using the current size of the buffer
+ * @param buffer buffer to start
+ * @param op operation, e.g. Buffer::Op::READ, Buffer::Op::WRITE or Buffer::Op::ERASE
+ * @return sender
+ */
+inline TransferSender transfer(Buffer &buffer, Buffer::Op op) {
+	return {buffer, -1, op};
+}
+
+/**
+ * Transfer of the given size
+ * @param buffer buffer to start
+ * @param size size of the data to transfer
+ * @param op operation, e.g. Buffer::Op::READ or Buffer::Op::WRITE
+ * @return sender
+ */
+inline TransferSender transfer(Buffer &buffer, int size, Buffer::Op op) {
+	return {buffer, size, op};
+}
+
+/**
+ * Wait until a device is ready
+ * @param device device to wait for
+ * @return sender
+ */
+inline ReadySender untilReady(Device &device) {
+	return {device};
+}
+
+/**
+ * Continue on the event loop
+ * @param loop event loop
+ * @param delay optional delay
+ * @return sender
+ */
+inline ScheduleSender schedule(Loop &loop, Milliseconds<> delay = {}) {
+	return {loop, delay};
+}
+
+/**
+ * Call a function with the values of a sender
+ * @param sender sender
+ * @param function function to call, its result is the value of the returned sender
+ * @return sender
+ */
+template <typename S, typename F>
+ThenSender<S, F> then(S sender, F function) {
+	return {std::move(sender), std::move(function)};
+}
+
+} // namespace coco
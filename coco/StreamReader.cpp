@@ -0,0 +1,196 @@
+#include "StreamReader.hpp"
+#include <algorithm>
+#include <cstring>
+
+
+namespace coco {
+
+StreamReader::StreamReader(BufferDevice &device)
+	: device(device)
+{
+}
+
+StreamReader::~StreamReader() {
+}
+
+void StreamReader::start() {
+	this->index = 0;
+	this->offset = 0;
+	int count = this->device.getBufferCount();
+	for (int i = 0; i < count; ++i) {
+		auto &buffer = this->device.getBuffer(i);
+		if (buffer.ready()) {
+			++this->stats.transferCount;
+			buffer.startRead(buffer.capacity());
+		}
+	}
+}
+
+Array<const uint8_t> StreamReader::data() {
+	auto buffer = current();
+	if (buffer == nullptr)
+		return {};
+	return {buffer->data() + this->offset, buffer->size() - this->offset};
+}
+
+int StreamReader::find(uint8_t delimiter) {
+	auto d = data();
+	auto p = static_cast<const uint8_t *>(std::memchr(d.data(), delimiter, d.size()));
+	return p == nullptr ? -1 : int(p - d.data());
+}
+
+void StreamReader::consume(int size) {
+	// the buffer gets started again by current() so that views stay valid until the next call
+	assert(size >= 0 && size <= data().size());
+	this->offset += size;
+	this->stats.byteCount += size;
+}
+
+AwaitableCoroutine StreamReader::read(int size, uint8_t *storage, Array<const uint8_t> &view) {
+	view = {};
+	int offset = 0;
+	while (offset < size) {
+		auto buffer = current();
+		if (buffer == nullptr) {
+			auto &next = this->device.getBuffer(this->index);
+			if (next.disabled())
+				break;
+			co_await next.untilReadyOrDisabled();
+			continue;
+		}
+		auto data = buffer->data() + this->offset;
+		int n = std::min(size - offset, buffer->size() - this->offset);
+		this->offset += n;
+		this->stats.byteCount += n;
+
+		// return a view of the buffer if the data is contained in one buffer
+		if (offset == 0 && n == size) {
+			++this->stats.viewCount;
+			view = {data, size};
+			co_return;
+		}
+		std::copy(data, data + n, storage + offset);
+		offset += n;
+	}
+
+	// return the copied data, less than requested if the device was disabled
+	if (offset > 0) {
+		++this->stats.copyCount;
+		view = {storage, offset};
+	}
+}
+
+AwaitableCoroutine StreamReader::peek(int size, uint8_t *storage, Array<const uint8_t> &view) {
+	view = {};
+	int count = this->device.getBufferCount();
+	while (true) {
+		auto buffer = current();
+		if (buffer == nullptr) {
+			auto &next = this->device.getBuffer(this->index);
+			if (next.disabled())
+				co_return;
+			co_await next.untilReadyOrDisabled();
+			continue;
+		}
+
+		// return a view of the buffer if the data is contained in one buffer
+		auto data = buffer->data() + this->offset;
+		int n = buffer->size() - this->offset;
+		if (n >= size) {
+			++this->stats.viewCount;
+			view = {data, size};
+			co_return;
+		}
+		break;
+	}
+
+	// copy from the following buffers without consuming, wait until they are ready
+	int index = this->index;
+	int o = this->offset;
+	int offset = 0;
+	for (int i = 0; i < count; ++i) {
+		auto &buffer = this->device.getBuffer(index);
+		co_await buffer.untilReadyOrDisabled();
+		if (!buffer.ready())
+			co_return;
+		auto data = buffer.data() + o;
+		int n = std::min(size - offset, buffer.size() - o);
+		std::copy(data, data + n, storage + offset);
+		offset += n;
+		if (offset == size) {
+			++this->stats.copyCount;
+			view = {storage, size};
+			co_return;
+		}
+		if (++index >= count)
+			index = 0;
+		o = 0;
+	}
+
+	// error: size is larger than the capacity of all buffers
+	assert(false);
+}
+
+AwaitableCoroutine StreamReader::readUntil(uint8_t delimiter, uint8_t *storage, int capacity,
+	Array<const uint8_t> &view)
+{
+	view = {};
+	int offset = 0;
+	while (offset < capacity) {
+		auto buffer = current();
+		if (buffer == nullptr) {
+			auto &next = this->device.getBuffer(this->index);
+			if (next.disabled())
+				break;
+			co_await next.untilReadyOrDisabled();
+			continue;
+		}
+		auto data = buffer->data() + this->offset;
+		int n = std::min(capacity - offset, buffer->size() - this->offset);
+
+		// search the delimiter
+		auto p = static_cast<const uint8_t *>(std::memchr(data, delimiter, n));
+		if (p != nullptr)
+			n = int(p - data) + 1;
+		this->offset += n;
+		this->stats.byteCount += n;
+
+		// return a view of the buffer if the data is contained in one buffer
+		if (offset == 0 && p != nullptr) {
+			++this->stats.viewCount;
+			view = {data, n};
+			co_return;
+		}
+		std::copy(data, data + n, storage + offset);
+		offset += n;
+		if (p != nullptr)
+			break;
+	}
+
+	// return the copied data, without delimiter if the device was disabled
+	if (offset > 0) {
+		++this->stats.copyCount;
+		view = {storage, offset};
+	}
+}
+
+Buffer *StreamReader::current() {
+	int count = this->device.getBufferCount();
+	for (int i = 0; i < count; ++i) {
+		auto &buffer = this->device.getBuffer(this->index);
+		if (!buffer.ready())
+			return nullptr;
+		if (this->offset < buffer.size())
+			return &buffer;
+
+		// all data of the buffer was consumed: read into it again and continue with the next buffer
+		++this->stats.transferCount;
+		buffer.startRead(buffer.capacity());
+		this->offset = 0;
+		if (++this->index >= count)
+			this->index = 0;
+	}
+	return nullptr;
+}
+
+} // namespace coco
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "BufferDevice.hpp"
+#include <coco/Array.hpp>
+#include <coco/Coroutine.hpp>
+#include <cstdint>
+
+
+namespace coco {
+
+/**
+ * Byte stream reader on top of a BufferDevice, e.g. for line based protocols on a serial port or TCP socket. All
+ * buffers of the device are kept reading in turn, the application consumes the data of the completed buffers in the
+ * order in which the buffers were started. A buffer gets started again when all its data was consumed.
+ *
+ * Data is returned as view of the buffer memory when the requested data is contained in one buffer, otherwise it gets
+ * copied into storage that is provided by the application. The search for a delimiter uses memchr() which is
+ * vectorized by the C library on most platforms. A view is valid until the next call of a method of the reader.
+ *
+ * Usage example:
+ * StreamReader reader(serialPort);
+ * reader.start();
+ * uint8_t line[128];
+ * Array<const uint8_t> view;
+ * co_await reader.readUntil('\n', line, sizeof(line), view);
+ */
+class StreamReader {
+public:
+	/**
+	 * Reader statistics
+	 */
+	struct Statistics {
+		// number of bytes that were consumed
+		int64_t byteCount = 0;
+
+		// number of reads that returned a view of the buffer memory and that had to copy the data
+		int viewCount = 0;
+		int copyCount = 0;
+
+		// number of buffers that were started
+		int transferCount = 0;
+	};
+
+	/**
+	 * Constructor
+	 * @param device device to read from, all its buffers get used in turn
+	 */
+	StreamReader(BufferDevice &device);
+	~StreamReader();
+
+	/**
+	 * Start reading into all buffers of the device, e.g. after the device was opened. Discards unconsumed data
+	 */
+	void start();
+
+	/**
+	 * Get the data that is available in the current buffer without waiting
+	 * @return view of the available data, empty if no data is available
+	 */
+	Array<const uint8_t> data();
+
+	/**
+	 * Find a delimiter in the data that is available in the current buffer without waiting
+	 * @param delimiter delimiter to search for
+	 * @return index of delimiter in data() or -1 if not found
+	 */
+	int find(uint8_t delimiter);
+
+	/**
+	 * Consume data that is available in the current buffer
+	 * @param size number of bytes to consume, at most data().size()
+	 */
+	void consume(int size);
+
+	/**
+	 * Wait until data is available in the current buffer or the device gets disabled
+	 * @return use co_await on return value to wait until data is available
+	 */
+	[[nodiscard]] Awaitable<Buffer::Events> untilAvailable() {
+		return this->device.getBuffer(this->index).untilReadyOrDisabled();
+	}
+
+	/**
+	 * Read the given number of bytes. If the device gets disabled, the data that was already consumed is returned
+	 * @param size number of bytes to read
+	 * @param storage storage for copying the data with a capacity of at least size
+	 * @param view view of the data, shorter than size (or empty) if the device was disabled
+	 * @return use co_await on return value to wait until the data is available
+	 */
+	[[nodiscard]] AwaitableCoroutine read(int size, uint8_t *storage, Array<const uint8_t> &view);
+
+	/**
+	 * Get the given number of bytes without consuming them
+	 * @param size number of bytes to peek
+	 * @param storage storage for copying the data with a capacity of at least size
+	 * @param view view of the data, empty if the device was disabled
+	 * @return use co_await on return value to wait until the data is available
+	 */
+	[[nodiscard]] AwaitableCoroutine peek(int size, uint8_t *storage, Array<const uint8_t> &view);
+
+	/**
+	 * Read until a delimiter, e.g. a line. If the delimiter is not found within the capacity of the storage or the
+	 * device gets disabled, the data that was consumed up to then is returned without delimiter
+	 * @param delimiter delimiter to search for, is included in the returned data
+	 * @param storage storage for copying the data
+	 * @param capacity capacity of the storage
+	 * @param view view of the data, empty if the device was disabled before any data was available
+	 * @return use co_await on return value to wait until the data is available
+	 */
+	[[nodiscard]] AwaitableCoroutine readUntil(uint8_t delimiter, uint8_t *storage, int capacity,
+		Array<const uint8_t> &view);
+
+	/**
+	 * Get the reader statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the reader statistics
+	 */
+	void resetStatistics() {this->stats = {};}
+
+protected:
+	Buffer *current();
+
+	BufferDevice &device;
+
+	// index of current buffer and offset of unconsumed data in the current buffer
+	int index = 0;
+	int offset = 0;
+
+	Statistics stats;
+};
+
+} // namespace coco
@@ -0,0 +1,116 @@
+#include "StreamWriter.hpp"
+
+
+namespace coco {
+
+StreamWriter::StreamWriter(Loop &loop, BufferDevice &device, Milliseconds<> latency, bool partial)
+	: loop(loop), device(device), latency(latency), partial(partial)
+	, callback(makeCallback<StreamWriter, &StreamWriter::handle>(this))
+{
+}
+
+StreamWriter::~StreamWriter() {
+}
+
+BufferWriter *StreamWriter::writer(int size) {
+	if (this->begin != nullptr) {
+		// discard data that was not committed
+		this->w.current = this->committed;
+		if (this->w.remaining() >= size)
+			return &this->w;
+
+		// error: size is larger than the capacity of the buffer
+		if (this->committed == this->begin) {
+			assert(false);
+			return nullptr;
+		}
+
+		// start the current buffer, more data follows
+		++this->stats.fullCount;
+		start(this->partial ? Buffer::Op::PARTIAL : Buffer::Op::NONE);
+	}
+
+	// use the next buffer if it is not busy
+	auto &buffer = this->device.getBuffer(this->index);
+	if (!buffer.ready()) {
+		++this->stats.stallCount;
+		return nullptr;
+	}
+	assert(buffer.capacity() >= size);
+	this->begin = buffer.data();
+	this->committed = this->begin;
+	this->w.assign(this->begin, buffer.capacity());
+	return &this->w;
+}
+
+void StreamWriter::commit() {
+	auto current = this->w.current;
+	assert(this->w.isValid());
+	if (current == this->committed)
+		return;
+	++this->stats.commitCount;
+	this->stats.byteCount += current - this->committed;
+	bool empty = this->committed == this->begin;
+	this->committed = current;
+
+	// start the buffer when it is full
+	if (this->w.atEnd()) {
+		++this->stats.fullCount;
+		start(this->partial ? Buffer::Op::PARTIAL : Buffer::Op::NONE);
+		return;
+	}
+
+	// start the latency budget when the first data was appended. If it is still running for a previous buffer, the
+	// current buffer gets started earlier which does not violate the budget
+	if (empty && !this->timerActive) {
+		this->timerActive = true;
+		this->loop.invoke(this->callback, this->latency);
+	}
+}
+
+bool StreamWriter::write(const uint8_t *data, int size) {
+	auto w = writer(size);
+	if (w == nullptr)
+		return false;
+	w->data(data, size);
+	commit();
+	return true;
+}
+
+AwaitableCoroutine StreamWriter::flush() {
+	if (this->committed != this->begin) {
+		++this->stats.flushCount;
+		start(Buffer::Op::NONE);
+	}
+
+	// wait until all transfers have completed
+	int count = this->device.getBufferCount();
+	for (int i = 0; i < count; ++i) {
+		co_await this->device.getBuffer(i).untilReadyOrDisabled();
+	}
+}
+
+void StreamWriter::start(Buffer::Op op) {
+	// start the current buffer with the committed data
+	auto &buffer = this->device.getBuffer(this->index);
+	buffer.startWrite(this->committed, op);
+
+	// advance to the next buffer which gets assigned by writer()
+	this->w = {};
+	this->begin = nullptr;
+	this->committed = nullptr;
+	if (++this->index >= this->device.getBufferCount())
+		this->index = 0;
+}
+
+void StreamWriter::handle() {
+	this->timerActive = false;
+
+	// start the current buffer if it contains data
+	if (this->committed != this->begin) {
+		++this->stats.timeoutCount;
+		start(Buffer::Op::NONE);
+	}
+}
+
+} // namespace coco
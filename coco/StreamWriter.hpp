@@ -0,0 +1,138 @@
+#pragma once
+
+#include "BufferDevice.hpp"
+#include "BufferWriter.hpp"
+#include <coco/Coroutine.hpp>
+#include <coco/Loop.hpp>
+#include <cstdint>
+
+
+namespace coco {
+
+/**
+ * Stream writer that coalesces many small writes (e.g. log messages) into few large transfers on a BufferDevice. The
+ * application appends data to the current buffer of the device using a BufferWriter. The buffer gets started when it
+ * is full or at the latest when the latency budget since the first byte was appended has elapsed (similar to Nagle's
+ * algorithm), then the next buffer of the device is used while the transfer is in progress.
+ *
+ * Buffers that were started because they were full get Op::PARTIAL since more data follows. For packetized transports
+ * (e.g. USB bulk) the capacity of the buffers should therefore be a multiple of the packet size. Buffers that get
+ * started on timeout or flush() don't get Op::PARTIAL.
+ *
+ * Usage example:
+ * StreamWriter writer(loop, device, 5ms);
+ * auto w = writer.writer(32);
+ * if (w == nullptr) {
+ *     co_await writer.untilAvailable();
+ *     w = writer.writer(32);
+ * }
+ * *w << "sensor timeout\n";
+ * writer.commit();
+ */
+class StreamWriter {
+public:
+	/**
+	 * Writer statistics
+	 */
+	struct Statistics {
+		// number of commits and bytes
+		int commitCount = 0;
+		int64_t byteCount = 0;
+
+		// number of transfers that were started because the buffer was full, the latency budget elapsed or flush()
+		// was called
+		int fullCount = 0;
+		int timeoutCount = 0;
+		int flushCount = 0;
+
+		// number of times no buffer was available
+		int stallCount = 0;
+
+		/**
+		 * Number of transfers
+		 */
+		int transferCount() const {return this->fullCount + this->timeoutCount + this->flushCount;}
+	};
+
+	/**
+	 * Constructor
+	 * @param loop event loop
+	 * @param device device to write to, all its buffers get used in turn
+	 * @param latency maximum time that appended data waits in the current buffer
+	 * @param partial use Op::PARTIAL for buffers that were started because they were full
+	 */
+	StreamWriter(Loop &loop, BufferDevice &device, Milliseconds<> latency, bool partial = true);
+	~StreamWriter();
+
+	/**
+	 * Get a writer for appending to the current buffer. If the current buffer does not have enough space, it gets
+	 * started and the next buffer of the device is used. Call commit() after appending the data.
+	 * @param size number of bytes to append, at most the capacity of the buffers of the device
+	 * @return writer or nullptr if no buffer is available, use untilAvailable() to wait
+	 */
+	BufferWriter *writer(int size);
+
+	/**
+	 * Commit the data that was appended to the writer, starts the latency budget if the buffer was empty
+	 */
+	void commit();
+
+	/**
+	 * Append data to the current buffer
+	 * @param data data to append
+	 * @param size size of data, at most the capacity of the buffers of the device
+	 * @return true if successful, false if no buffer is available
+	 */
+	bool write(const uint8_t *data, int size);
+
+	/**
+	 * Wait until the current buffer is available after writer() or write() have failed
+	 * @return use co_await on return value to wait until a buffer is available
+	 */
+	[[nodiscard]] Awaitable<Buffer::Events> untilAvailable() {
+		return this->device.getBuffer(this->index).untilReadyOrDisabled();
+	}
+
+	/**
+	 * Start the current buffer and wait until all transfers have completed
+	 * @return use co_await on return value to wait until all data is written
+	 */
+	[[nodiscard]] AwaitableCoroutine flush();
+
+	/**
+	 * Get the writer statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the writer statistics
+	 */
+	void resetStatistics() {this->stats = {};}
+
+protected:
+	void start(Buffer::Op op);
+	void handle();
+
+	Loop &loop;
+	BufferDevice &device;
+	Milliseconds<> latency;
+	bool partial;
+	TimedTask<Callback> callback;
+
+	// index of current buffer
+	int index = 0;
+
+	// writer for current buffer, current and end are null when no buffer is assigned
+	BufferWriter w;
+
+	// start of data in current buffer and end of committed data
+	uint8_t *begin = nullptr;
+	uint8_t *committed = nullptr;
+
+	// latency budget is running
+	bool timerActive = false;
+
+	Statistics stats;
+};
+
+} // namespace coco
@@ -0,0 +1,197 @@
+#include "TrafficShaper.hpp"
+#include <algorithm>
+
+
+namespace coco {
+
+TrafficShaper::TrafficShaper(Loop &loop, int bytesPerSecond, int burst)
+	: BufferDevice(State::READY), loop(loop), callback(makeCallback<TrafficShaper, &TrafficShaper::handle>(this))
+	, bytesPerSecond(bytesPerSecond), burst(burst), tokens(int64_t(burst) * 1000)
+{
+	assert(bytesPerSecond > 0 && burst > 0);
+	auto now = loop.now();
+	this->refillTime = now;
+	this->windowTime = now;
+}
+
+TrafficShaper::~TrafficShaper() {
+}
+
+void TrafficShaper::setRate(int bytesPerSecond, int burst) {
+	assert(bytesPerSecond > 0 && burst > 0);
+
+	// add the tokens of the old rate up to now
+	refill(this->loop.now());
+	this->bytesPerSecond = bytesPerSecond;
+	this->burst = burst;
+	this->tokens = std::min(this->tokens, int64_t(burst) * 1000);
+
+	// set the timer again for the new rate, invoking the callback again replaces the pending invocation
+	this->timerActive = false;
+	process();
+}
+
+int TrafficShaper::rate() {
+	measure(this->loop.now());
+	return this->measuredRate;
+}
+
+int TrafficShaper::queueDelay() {
+	if (this->writes.empty())
+		return 0;
+
+	// the last write can start when the bucket contains enough tokens for it, the writes before it consume tokens
+	int64_t bytes = 0;
+	int lastSize = 0;
+	for (auto &buffer : this->writes) {
+		lastSize = buffer.size();
+		bytes += lastSize;
+	}
+	bytes += std::min(lastSize, this->burst) - lastSize;
+	refill(this->loop.now());
+	int64_t missing = bytes * 1000 - this->tokens;
+	if (missing <= 0)
+		return 0;
+	return int((missing + this->bytesPerSecond - 1) / this->bytesPerSecond);
+}
+
+int TrafficShaper::getBufferCount() {
+	return this->buffers.count();
+}
+
+TrafficShaper::Buffer &TrafficShaper::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+void TrafficShaper::refill(Time now) {
+	// bytes per second times milliseconds is bytes * 1000
+	int64_t elapsed = (now - this->refillTime).value;
+	if (elapsed <= 0)
+		return;
+	this->refillTime = now;
+	this->tokens = std::min(this->tokens + elapsed * this->bytesPerSecond, int64_t(this->burst) * 1000);
+}
+
+void TrafficShaper::measure(Time now) {
+	// start a new measurement window every second
+	int64_t elapsed = (now - this->windowTime).value;
+	if (elapsed >= 1000) {
+		this->measuredRate = int(this->windowBytes * 1000 / elapsed);
+		this->windowTime = now;
+		this->windowBytes = 0;
+	}
+}
+
+void TrafficShaper::process() {
+	auto now = this->loop.now();
+	refill(now);
+	auto &stats = this->stats;
+	while (!this->writes.empty()) {
+		auto &buffer = this->writes.front();
+		int size = buffer.size();
+
+		// a write that is larger than the bucket waits until the bucket is full and makes the tokens negative
+		int64_t needed = int64_t(std::min(size, this->burst)) * 1000;
+		if (this->tokens < needed) {
+			// wait until the bucket contains enough tokens for the first write
+			if (!this->timerActive) {
+				this->timerActive = true;
+				int delay = int((needed - this->tokens + this->bytesPerSecond - 1) / this->bytesPerSecond);
+				this->loop.invoke(this->callback, Milliseconds<>(delay));
+			}
+			break;
+		}
+		this->writes.pop();
+		this->tokens -= int64_t(size) * 1000;
+
+		// update statistics
+		int delay = int((now - buffer.queueTime).value);
+		++stats.writeCount;
+		stats.byteCount += size;
+		if (delay > 0) {
+			++stats.delayedCount;
+			stats.totalDelay += delay;
+			stats.maxDelay = std::max(stats.maxDelay, delay);
+		}
+		measure(now);
+		this->windowBytes += size;
+
+		// start the write, the queue is consistent in case the transfer completes immediately and a new write gets
+		// started
+		buffer.active = true;
+		buffer.transfer(buffer.op);
+	}
+}
+
+void TrafficShaper::handle() {
+	this->timerActive = false;
+	process();
+}
+
+
+// Buffer
+
+TrafficShaper::Buffer::Buffer(TrafficShaper &shaper, coco::Buffer &buffer)
+	: BufferWrapper(buffer), shaper(shaper)
+{
+	shaper.buffers.add(*this);
+}
+
+TrafficShaper::Buffer::~Buffer() {
+	if (this->st.state == State::BUSY && !this->active)
+		this->shaper.writes.remove(*this);
+}
+
+bool TrafficShaper::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+
+	// set state before starting the transfer as it may complete immediately
+	setBusy();
+	this->op = op;
+
+	auto &shaper = this->shaper;
+	if ((op & Op::READ) != 0) {
+		// reads are not limited
+		this->active = true;
+		transfer(op);
+	} else {
+		// queue the write and start it when there are enough tokens
+		this->queueTime = shaper.loop.now();
+		shaper.writes.push(*this);
+		shaper.process();
+	}
+
+	return true;
+}
+
+bool TrafficShaper::Buffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	// the buffer completes when the device buffer completes
+	if (this->active)
+		return this->buffer.cancel();
+
+	// remove a write that waits for tokens, the timer may fire without effect
+	this->shaper.writes.remove(*this);
+	setReady(0);
+
+	return true;
+}
+
+Coroutine TrafficShaper::Buffer::transfer(Op op) {
+	// start the transfer on the device
+	if (forward(op))
+		co_await this->buffer.untilReadyOrDisabled();
+	this->active = false;
+	complete();
+}
+
+} // namespace coco
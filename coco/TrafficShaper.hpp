@@ -0,0 +1,153 @@
+#pragma once
+
+#include "BufferDevice.hpp"
+#include "BufferWrapper.hpp"
+#include <coco/Coroutine.hpp>
+#include <coco/IntrusiveList.hpp>
+#include <coco/IntrusiveQueue.hpp>
+#include <coco/Loop.hpp>
+#include <cstdint>
+
+
+namespace coco {
+
+/**
+ * Limits the bandwidth of writes to a device using a token bucket, e.g. for links with a bandwidth cap. The bucket
+ * gets filled with the given number of bytes per second up to the burst size. A write gets started on the device when
+ * the bucket contains enough tokens for its size (or is full for writes that are larger than the burst size), otherwise
+ * it waits in a queue. Writes are started in the order in which they were queued, reads are not limited.
+ *
+ * A single timer per shaper is used which is set to the time when the first queued write can be started. The
+ * statistics contain the queueing delay of the writes, rate() returns the measured rate of the last second.
+ *
+ * Usage example:
+ * TrafficShaper shaper(loop, 125000, 4096); // 1 MBit/s
+ * TrafficShaper::Buffer buffer(shaper, socketBuffer);
+ * co_await buffer.writeString("hello");
+ */
+class TrafficShaper : public BufferDevice {
+public:
+	/**
+	 * Shaper statistics
+	 */
+	struct Statistics {
+		// number of writes and bytes
+		int writeCount = 0;
+		int64_t byteCount = 0;
+
+		// number of writes that had to wait for tokens
+		int delayedCount = 0;
+
+		// total and maximum queueing delay in milliseconds
+		int64_t totalDelay = 0;
+		int maxDelay = 0;
+
+		/**
+		 * Average queueing delay of the writes in milliseconds
+		 */
+		float averageDelay() const {return this->writeCount > 0 ? float(this->totalDelay) / float(this->writeCount) : 0.0f;}
+	};
+
+	/**
+	 * Constructor
+	 * @param loop event loop
+	 * @param bytesPerSecond rate at which the bucket gets filled
+	 * @param burst size of the bucket in bytes, the bucket is full initially
+	 */
+	TrafficShaper(Loop &loop, int bytesPerSecond, int burst);
+	~TrafficShaper() override;
+
+	/**
+	 * Buffer that wraps a buffer of the device and uses its memory, its state follows the buffer of the device
+	 */
+	class Buffer : public BufferWrapper, public IntrusiveListNode, public IntrusiveQueueNode {
+		friend class TrafficShaper;
+	public:
+		/**
+		 * Constructor
+		 * @param shaper shaper to attach to
+		 * @param buffer buffer of the device
+		 */
+		Buffer(TrafficShaper &shaper, coco::Buffer &buffer);
+		~Buffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		Coroutine transfer(Op op);
+
+		TrafficShaper &shaper;
+		Op op;
+
+		// time when the write was queued
+		Time queueTime;
+
+		// true while the transfer is on the device
+		bool active = false;
+	};
+
+	/**
+	 * Change the rate and burst size, the time when the first queued write gets started is recalculated
+	 * @param bytesPerSecond rate at which the bucket gets filled
+	 * @param burst size of the bucket in bytes
+	 */
+	void setRate(int bytesPerSecond, int burst);
+
+	/**
+	 * Get the measured rate of the last second in bytes per second
+	 */
+	int rate();
+
+	/**
+	 * Get the estimated time until all queued writes are started in milliseconds
+	 */
+	int queueDelay();
+
+	/**
+	 * Get the shaper statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the shaper statistics
+	 */
+	void resetStatistics() {this->stats = {};}
+
+	// BufferDevice methods
+	int getBufferCount() override;
+	Buffer &getBuffer(int index) override;
+
+protected:
+	void refill(Time now);
+	void measure(Time now);
+	void process();
+	void handle();
+
+	Loop &loop;
+	TimedTask<Callback> callback;
+	bool timerActive = false;
+
+	// rate in bytes per second and bucket size in bytes
+	int bytesPerSecond;
+	int burst;
+
+	// tokens in the bucket in bytes * 1000, negative after a write that was larger than the burst size
+	int64_t tokens;
+	Time refillTime;
+
+	// list of buffers
+	IntrusiveList<Buffer> buffers;
+
+	// writes that wait for tokens
+	IntrusiveQueue<Buffer> writes;
+
+	// rate measurement
+	Time windowTime;
+	int64_t windowBytes = 0;
+	int measuredRate = 0;
+
+	Statistics stats;
+};
+
+} // namespace coco
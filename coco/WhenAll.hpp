@@ -0,0 +1,201 @@
+#pragma once
+
+#include "FrameSlot.hpp"
+#include <coco/Coroutine.hpp>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+
+namespace coco {
+
+/**
+ * Base class of the combinators whenAll() and whenAny(). For each awaitable that is not ready, a small waiter coroutine
+ * gets started that awaits it and reports back when it is resumed. The coroutine frames of the waiters are placed into
+ * slots (see FrameSlot) inside the combinator which lives in the frame of the awaiting coroutine, therefore no memory
+ * gets allocated unless a frame does not fit into its slot.
+ */
+class WhenBase {
+public:
+	struct Waiter {
+		struct promise_type {
+			promise_type(WhenBase &when, int index, const void *) : when(when), index(index) {}
+
+			static void *operator new(std::size_t size, WhenBase &when, int index, const void *) {
+				return when.slots[index].allocate(size);
+			}
+			static void operator delete(void *frame) {
+				FrameSlot::free(frame);
+			}
+
+			Waiter get_return_object() {return {std::coroutine_handle<promise_type>::from_promise(*this)};}
+			std::suspend_never initial_suspend() noexcept {return {};}
+
+			// report to the combinator and resume the awaiting coroutine if the combinator is complete
+			struct Final {
+				bool await_ready() noexcept {return false;}
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+					auto &p = handle.promise();
+					return p.when.done(p.index);
+				}
+				void await_resume() noexcept {}
+			};
+			Final final_suspend() noexcept {return {};}
+
+			void return_void() {}
+			void unhandled_exception() {}
+
+			WhenBase &when;
+			int index;
+		};
+
+		std::coroutine_handle<promise_type> handle;
+	};
+
+	// the arguments are passed to operator new and the constructor of the promise
+	template <typename A>
+	static Waiter wait([[maybe_unused]] WhenBase &when, [[maybe_unused]] int index, A *awaitable) {
+		co_await *awaitable;
+	}
+
+protected:
+	WhenBase(bool any, FrameSlot *slots) : any(any), slots(slots) {}
+
+	std::coroutine_handle<> done(int index) {
+		if (this->any) {
+			// only the first waiter completes the combinator
+			if (this->result != -1)
+				return std::noop_coroutine();
+			this->result = index;
+		} else {
+			if (--this->remaining > 0)
+				return std::noop_coroutine();
+		}
+		this->complete = true;
+
+		// don't resume the awaiting coroutine while it gets suspended
+		if (this->suspending)
+			return std::noop_coroutine();
+		return this->handle;
+	}
+
+	bool any;
+	FrameSlot *slots;
+
+	// awaiting coroutine
+	std::coroutine_handle<> handle;
+	bool suspending = false;
+	bool complete = false;
+
+	// number of waiters that have not completed yet (whenAll) or index of first ready awaitable (whenAny)
+	int remaining = 0;
+	int result = -1;
+};
+
+/**
+ * Combinator that waits for a group of awaitables, use whenAll() or whenAny() to create
+ */
+template <bool Any, typename... A>
+class When : public WhenBase {
+public:
+	static constexpr int COUNT = sizeof...(A);
+
+	When(A &... awaitables) : WhenBase(Any, frameSlots), awaitables(awaitables...) {}
+	When(const When &) = delete;
+
+	~When() {
+		// destroy the waiters, waiters of whenAny() that are still waiting reference their awaitable which removes
+		// itself from its task list when it gets destroyed at the end of the co_await expression
+		for (auto &handle : this->handles) {
+			if (handle)
+				handle.destroy();
+		}
+	}
+
+	bool await_ready() {
+		checkReady(std::index_sequence_for<A...>());
+		return Any ? this->result != -1 : this->remaining == 0;
+	}
+
+	bool await_suspend(std::coroutine_handle<> handle) {
+		this->handle = handle;
+
+		// start a waiter for each awaitable that is not ready
+		this->suspending = true;
+		start(std::index_sequence_for<A...>());
+		this->suspending = false;
+
+		// resume immediately if the combinator was completed while starting the waiters
+		return !this->complete;
+	}
+
+	auto await_resume() {
+		if constexpr (Any)
+			return this->result;
+	}
+
+protected:
+	template <std::size_t... I>
+	void checkReady(std::index_sequence<I...>) {
+		(checkReady(int(I), std::get<I>(this->awaitables)), ...);
+	}
+
+	template <typename T>
+	void checkReady(int index, T &awaitable) {
+		if (awaitable.await_ready()) {
+			if (this->result == -1)
+				this->result = index;
+		} else {
+			++this->remaining;
+		}
+	}
+
+	template <std::size_t... I>
+	void start(std::index_sequence<I...>) {
+		(start(int(I), std::get<I>(this->awaitables)), ...);
+	}
+
+	template <typename T>
+	void start(int index, T &awaitable) {
+		if (!this->complete && !awaitable.await_ready())
+			this->handles[index] = wait(*this, index, &awaitable).handle;
+	}
+
+	std::tuple<A &...> awaitables;
+	std::coroutine_handle<Waiter::promise_type> handles[COUNT] = {};
+	FrameSlot frameSlots[COUNT];
+};
+
+/**
+ * Wait until all awaitables are ready, e.g. the completion of transfers on several buses. Each awaitable is typically
+ * the result of a call such as buffer.read() or device.untilReady().
+ *
+ * Usage example:
+ * co_await whenAll(buffer1.read(), buffer2.read(), buffer3.read());
+ *
+ * @return use co_await on return value to wait until all awaitables are ready
+ */
+template <typename... A>
+[[nodiscard]] When<false, std::remove_reference_t<A>...> whenAll(A &&... awaitables) {
+	return {awaitables...};
+}
+
+/**
+ * Wait until one of the awaitables is ready, e.g. a transfer or a timeout. The other awaitables get removed from their
+ * task lists.
+ *
+ * Usage example:
+ * int index = co_await whenAny(buffer.read(), loop.sleep(100ms));
+ * if (index == 1)
+ *     buffer.cancel();
+ *
+ * @return use co_await on return value to wait until one awaitable is ready, returns the index of the awaitable
+ */
+template <typename... A>
+[[nodiscard]] When<true, std::remove_reference_t<A>...> whenAny(A &&... awaitables) {
+	return {awaitables...};
+}
+
+} // namespace coco
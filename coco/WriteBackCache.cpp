@@ -0,0 +1,320 @@
+#include "WriteBackCache.hpp"
+#include <algorithm>
+#include <cstring>
+
+
+namespace coco {
+
+WriteBackCache::WriteBackCache(Loop &loop, BufferDevice &device, int pageSize, Milliseconds<> timeout,
+	SetAddress setAddress)
+	: BufferDevice(State::READY), loop(loop), device(device), pageSize(pageSize), timeout(timeout)
+	, setAddress(setAddress), callback(makeCallback<WriteBackCache, &WriteBackCache::handle>(this))
+{
+	int count = device.getBufferCount();
+	this->pages = new Page[count];
+	this->pageCount = count;
+	for (int i = 0; i < count; ++i) {
+		this->pages[i] = {&device.getBuffer(i), 0, false, 0, 0, false, 0, 0};
+	}
+}
+
+WriteBackCache::~WriteBackCache() {
+	delete [] this->pages;
+}
+
+void WriteBackCache::setAddress32(coco::Buffer &buffer, [[maybe_unused]] Buffer::Op op, uint32_t address) {
+	buffer.setHeader<uint32_t>(address);
+}
+
+AwaitableCoroutine WriteBackCache::sync() {
+	auto &stats = this->stats;
+	while (true) {
+		// flush all dirty pages that are not busy
+		int failedCount = stats.failedCount;
+		for (int i = 0; i < this->pageCount; ++i) {
+			auto &page = this->pages[i];
+			if (page.begin < page.end && page.buffer->ready()) {
+				++stats.syncCount;
+				flush(page);
+			}
+		}
+
+		// wait until all pages are written, pages may get dirty again in the meantime
+		bool disabled = false;
+		for (int i = 0; i < this->pageCount; ++i) {
+			auto &buffer = *this->pages[i].buffer;
+			co_await buffer.untilReadyOrDisabled();
+			disabled |= buffer.disabled();
+		}
+		if (this->dirty == 0 || disabled || stats.failedCount != failedCount)
+			break;
+	}
+}
+
+int WriteBackCache::getBufferCount() {
+	return this->buffers.count();
+}
+
+WriteBackCache::Buffer &WriteBackCache::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+WriteBackCache::Page *WriteBackCache::find(uint32_t address) {
+	for (int i = 0; i < this->pageCount; ++i) {
+		auto &page = this->pages[i];
+		if (page.valid && page.address == address)
+			return &page;
+	}
+	return nullptr;
+}
+
+WriteBackCache::Page *WriteBackCache::allocate() {
+	// find an invalid page or the least recently used clean page, pages that are busy can't be used
+	Page *result = nullptr;
+	Page *dirty = nullptr;
+	for (int i = 0; i < this->pageCount; ++i) {
+		auto &page = this->pages[i];
+		if (!page.buffer->ready())
+			continue;
+		if (!page.valid)
+			return &page;
+		if (page.begin < page.end) {
+			if (dirty == nullptr || int32_t(page.lastUse - dirty->lastUse) < 0)
+				dirty = &page;
+		} else {
+			if (result == nullptr || int32_t(page.lastUse - result->lastUse) < 0)
+				result = &page;
+		}
+	}
+
+	// all pages are dirty or busy: evict the least recently used dirty page, the caller has to wait and try again
+	// unless the write has completed immediately
+	if (result == nullptr && dirty != nullptr) {
+		++this->stats.evictCount;
+		flush(*dirty);
+		if (dirty->buffer->ready() && dirty->begin == dirty->end)
+			result = dirty;
+	}
+	return result;
+}
+
+WriteBackCache::Page *WriteBackCache::oldestBusy() {
+	Page *result = nullptr;
+	for (int i = 0; i < this->pageCount; ++i) {
+		auto &page = this->pages[i];
+		if (page.buffer->busy() && (result == nullptr || int32_t(page.lastUse - result->lastUse) < 0))
+			result = &page;
+	}
+	return result;
+}
+
+void WriteBackCache::load(Page &page, uint32_t address) {
+	page.address = address;
+	page.valid = true;
+	page.lastUse = ++this->useCounter;
+	++this->stats.loadCount;
+
+	auto &buffer = *page.buffer;
+	this->setAddress(buffer, Buffer::Op::READ, address);
+	assert(buffer.capacity() >= this->pageSize);
+	buffer.startRead(this->pageSize);
+}
+
+void WriteBackCache::flush(Page &page) {
+	// set header for writing, the header for reading may have a different size. Therefore move the page contents to
+	// the end of the buffer where the header can't overwrite them and back behind the new header
+	auto &buffer = *page.buffer;
+	int pageSize = this->pageSize;
+	auto data = buffer.data();
+	buffer.headerResize(buffer.headerSize() + buffer.capacity() - pageSize);
+	auto end = buffer.data();
+	if (end != data)
+		std::memmove(end, data, pageSize);
+	this->setAddress(buffer, Buffer::Op::WRITE, page.address);
+	if (buffer.data() != end)
+		std::memmove(buffer.data(), end, pageSize);
+
+	// write the whole page, the page stays valid as it contains the data of the storage device
+	buffer.startWrite(pageSize);
+	write(page);
+}
+
+Coroutine WriteBackCache::write(Page &page) {
+	uint32_t modifyCount = page.modifyCount;
+	auto &buffer = *page.buffer;
+	co_await buffer.untilReadyOrDisabled();
+	if (buffer.ready() && buffer.size() == this->pageSize) {
+		// the page is clean unless it was modified after the write completed
+		if (page.begin < page.end) {
+			if (page.modifyCount == modifyCount) {
+				page.begin = 0;
+				page.end = 0;
+				--this->dirty;
+			} else {
+				startTimer();
+			}
+		}
+		co_return;
+	}
+
+	// the page stays dirty and gets written again on timeout or sync(), restore the size of the page
+	++this->stats.failedCount;
+	if (buffer.ready()) {
+		buffer.resize(this->pageSize);
+		startTimer();
+	}
+}
+
+void WriteBackCache::startTimer() {
+	if (!this->timerActive) {
+		this->timerActive = true;
+		this->loop.invoke(this->callback, this->timeout);
+	}
+}
+
+void WriteBackCache::handle() {
+	this->timerActive = false;
+
+	// flush all dirty pages that are not busy
+	for (int i = 0; i < this->pageCount; ++i) {
+		auto &page = this->pages[i];
+		if (page.begin < page.end && page.buffer->ready()) {
+			++this->stats.timeoutCount;
+			flush(page);
+		}
+	}
+}
+
+
+// Buffer
+
+WriteBackCache::Buffer::Buffer(WriteBackCache &cache, int capacity)
+	: coco::Buffer(new uint8_t[sizeof(uint32_t) + capacity], sizeof(uint32_t), capacity, cache.st.state)
+	, cache(cache)
+{
+	*reinterpret_cast<uint32_t *>(this->p.data) = 0;
+	cache.buffers.add(*this);
+}
+
+WriteBackCache::Buffer::~Buffer() {
+	delete [] this->p.data;
+}
+
+bool WriteBackCache::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set and the header contains the address
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+	assert(this->p.headerSize == sizeof(uint32_t));
+
+	auto &stats = this->cache.stats;
+	if ((op & Op::WRITE) != 0)
+		++stats.writeCount;
+	else
+		++stats.readCount;
+
+	// set state before the transfer as it completes immediately if all pages are cached
+	setBusy();
+	transfer(op, header<uint32_t>(), this->size());
+
+	return true;
+}
+
+bool WriteBackCache::Buffer::cancel() {
+	// reads and writes complete when the pages are loaded
+	return this->st.state == State::BUSY;
+}
+
+Coroutine WriteBackCache::Buffer::transfer(Op op, uint32_t address, int size) {
+	auto &cache = this->cache;
+	auto &stats = cache.stats;
+	int pageSize = cache.pageSize;
+	bool write = (op & Op::WRITE) != 0;
+	auto data = this->data();
+	bool coalesced = false;
+	int offset = 0;
+	while (offset < size) {
+		uint32_t a = address + offset;
+		uint32_t pageAddress = a / pageSize * pageSize;
+
+		// find the page or load it into an unused page
+		auto page = cache.find(pageAddress);
+		if (page == nullptr) {
+			page = cache.allocate();
+			if (page == nullptr) {
+				// all pages are busy, wait and try again
+				auto busy = cache.oldestBusy();
+				if (busy == nullptr)
+					break;
+				co_await busy->buffer->untilReadyOrDisabled();
+				continue;
+			}
+			cache.load(*page, pageAddress);
+		}
+
+		// wait until the page is loaded or written
+		auto &buffer = *page->buffer;
+		co_await buffer.untilReadyOrDisabled();
+		if (!page->valid || page->address != pageAddress) {
+			// page was replaced in the meantime
+			continue;
+		}
+		if (!buffer.ready() || buffer.size() < pageSize) {
+			// transfer failed or was cancelled, data that was not written yet is lost
+			if (page->begin < page->end) {
+				page->begin = 0;
+				page->end = 0;
+				--cache.dirty;
+			}
+			page->valid = false;
+			break;
+		}
+
+		int o = a - pageAddress;
+		int n = std::min(size - offset, pageSize - o);
+		auto pageData = buffer.data();
+		if (write) {
+			// modify the page in memory
+			std::copy(data + offset, data + offset + n, pageData + o);
+			++page->modifyCount;
+			if (page->begin < page->end) {
+				coalesced = true;
+
+				// the dirty range gets merged, a gap that the write leaves makes the range incomplete
+				if (o > page->end || o + n < page->begin)
+					page->complete = false;
+				page->begin = std::min(page->begin, o);
+				page->end = std::max(page->end, o + n);
+			} else {
+				page->begin = o;
+				page->end = o + n;
+				page->complete = true;
+				++cache.dirty;
+
+				// start the timeout
+				cache.startTimer();
+			}
+
+			// write the page when it was written completely
+			if (page->complete && page->begin == 0 && page->end == pageSize) {
+				++stats.fullCount;
+				cache.flush(*page);
+			}
+		} else {
+			// copy from the page
+			std::copy(pageData + o, pageData + o + n, data + offset);
+		}
+		offset += n;
+		page->lastUse = ++cache.useCounter;
+	}
+	if (coalesced)
+		++stats.coalescedCount;
+
+	setReady(offset);
+}
+
+} // namespace coco
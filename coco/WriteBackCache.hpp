@@ -0,0 +1,194 @@
+#pragma once
+
+#include "BufferDevice.hpp"
+#include <coco/Coroutine.hpp>
+#include <coco/IntrusiveList.hpp>
+#include <coco/Loop.hpp>
+#include <cstdint>
+
+
+namespace coco {
+
+/**
+ * Write-back cache for storage devices where the header of a buffer contains the address and writing is expensive,
+ * e.g. a flash where each page program takes a long time regardless of the number of bytes. The buffers of the storage
+ * device are used as cache pages, all of them need a capacity of at least the page size.
+ *
+ * A write loads the page it falls into (if not cached yet) and modifies it in memory, the write completes when the data
+ * is in the cache. Further writes to the same page, also overlapping ones, get coalesced, the later write wins. A dirty
+ * page gets written to the storage device as a whole when it was written completely (by writes that each overlap or
+ * adjoin the data written before), when it needs to be evicted to make room for another page, when the timeout since
+ * the first page became dirty has elapsed or on sync(). A page stays dirty until its write has completed, if the write
+ * fails it gets written again later. Reads are served from the cache and therefore always return the written data.
+ *
+ * The buffers of the cache have a 32 bit address as header (setHeader<uint32_t>(address)), the header of the storage
+ * buffers is set by a function that is given to the constructor (e.g. read or program command and 24 bit address of a
+ * flash). The storage device is expected to handle erase, write enable and busy polling by itself.
+ *
+ * Usage example:
+ * WriteBackCache cache(loop, storage, 256, 100ms);
+ * WriteBackCache::Buffer buffer(cache, 16);
+ * buffer.setHeader<uint32_t>(0x1000);
+ * co_await buffer.writeString("hello");
+ * co_await cache.sync();
+ */
+class WriteBackCache : public BufferDevice {
+public:
+	/**
+	 * Function that sets the header of a storage buffer to the given address for a read (loading a page) or write
+	 * (flushing a page)
+	 */
+	using SetAddress = void (*)(coco::Buffer &buffer, Buffer::Op op, uint32_t address);
+
+	/**
+	 * Cache statistics
+	 */
+	struct Statistics {
+		// number of reads and writes
+		int readCount = 0;
+		int writeCount = 0;
+
+		// number of writes to a page that was already dirty
+		int coalescedCount = 0;
+
+		// number of pages that were loaded from the storage device
+		int loadCount = 0;
+
+		// number of pages that were flushed because they were written completely, were evicted, the timeout elapsed
+		// or sync() was called
+		int fullCount = 0;
+		int evictCount = 0;
+		int timeoutCount = 0;
+		int syncCount = 0;
+
+		// number of page writes that failed, the pages stay dirty
+		int failedCount = 0;
+
+		/**
+		 * Number of pages that were written to the storage device
+		 */
+		int flushCount() const {return this->fullCount + this->evictCount + this->timeoutCount + this->syncCount;}
+	};
+
+	/**
+	 * Constructor
+	 * @param loop event loop
+	 * @param device storage device, all its buffers are used as cache pages
+	 * @param pageSize size of a page in bytes
+	 * @param timeout time after which dirty pages get flushed
+	 * @param setAddress function that sets the header of a storage buffer to an address
+	 */
+	WriteBackCache(Loop &loop, BufferDevice &device, int pageSize, Milliseconds<> timeout,
+		SetAddress setAddress = setAddress32);
+	~WriteBackCache() override;
+
+	/**
+	 * Buffer for reading from or writing to the storage device through the cache
+	 */
+	class Buffer : public coco::Buffer, public IntrusiveListNode {
+		friend class WriteBackCache;
+	public:
+		/**
+		 * Constructor
+		 * @param cache write-back cache to attach to
+		 * @param capacity capacity of the buffer
+		 */
+		Buffer(WriteBackCache &cache, int capacity);
+		~Buffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		Coroutine transfer(Op op, uint32_t address, int size);
+
+		WriteBackCache &cache;
+	};
+
+	/**
+	 * Default function for setting the address, sets a 32 bit header
+	 */
+	static void setAddress32(coco::Buffer &buffer, Buffer::Op op, uint32_t address);
+
+	/**
+	 * Write all dirty pages to the storage device. Stops early if a write fails or the storage device is disabled
+	 * @return use co_await on return value to wait until all pages are written
+	 */
+	[[nodiscard]] AwaitableCoroutine sync();
+
+	/**
+	 * Number of dirty pages
+	 */
+	int dirtyCount() const {return this->dirty;}
+
+	/**
+	 * Get the cache statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the cache statistics
+	 */
+	void resetStatistics() {this->stats = {};}
+
+	// BufferDevice methods
+	int getBufferCount() override;
+	Buffer &getBuffer(int index) override;
+
+protected:
+	struct Page {
+		coco::Buffer *buffer;
+
+		// address of the page, valid when the page is loaded or loading (buffer is busy)
+		uint32_t address;
+		bool valid;
+
+		// range of the page that contains data that is not written to the storage device yet, empty if clean
+		int begin;
+		int end;
+
+		// true if the writes covered the dirty range without gaps, e.g. not the case after writing the first and last
+		// byte only. A gap that gets filled later is not detected, then the page gets flushed for another reason
+		bool complete;
+
+		// number of modifications, used to detect modifications during a write
+		uint32_t modifyCount;
+
+		// counter value of last use
+		uint32_t lastUse;
+	};
+
+	Page *find(uint32_t address);
+	Page *allocate();
+	Page *oldestBusy();
+	void load(Page &page, uint32_t address);
+	void flush(Page &page);
+	Coroutine write(Page &page);
+	void startTimer();
+	void handle();
+
+	Loop &loop;
+	BufferDevice &device;
+	int pageSize;
+	Milliseconds<> timeout;
+	SetAddress setAddress;
+	TimedTask<Callback> callback;
+
+	// list of buffers
+	IntrusiveList<Buffer> buffers;
+
+	// pages, one for each buffer of the storage device
+	Page *pages;
+	int pageCount;
+	uint32_t useCounter = 0;
+
+	// number of dirty pages
+	int dirty = 0;
+
+	// timeout is pending
+	bool timerActive = false;
+
+	Statistics stats;
+};
+
+} // namespace coco
@@ -0,0 +1,165 @@
+#include "WriteMerger.hpp"
+#include <algorithm>
+
+
+namespace coco {
+
+WriteMerger::WriteMerger(Loop &loop, coco::Buffer &buffer, uint32_t addressMask)
+	: BufferDevice(State::READY), loop(loop), buffer(buffer), addressMask(addressMask)
+	, callback(makeCallback<WriteMerger, &WriteMerger::handle>(this))
+{
+}
+
+WriteMerger::~WriteMerger() {
+}
+
+int WriteMerger::getBufferCount() {
+	return this->buffers.count();
+}
+
+WriteMerger::Buffer &WriteMerger::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+uint32_t WriteMerger::getHeader(coco::Buffer &buffer) {
+	// header is the address in big endian byte order
+	auto header = buffer.headerData();
+	int headerSize = buffer.headerSize();
+	uint32_t value = 0;
+	for (int i = 0; i < headerSize; ++i) {
+		value = (value << 8) | header[i];
+	}
+	return value;
+}
+
+void WriteMerger::handle() {
+	process();
+}
+
+Coroutine WriteMerger::process() {
+	auto &bus = this->buffer;
+	auto &stats = this->stats;
+	uint32_t mask = this->addressMask;
+	while (!this->transfers.empty()) {
+		auto &first = this->transfers.front();
+		auto op = first.op;
+		int headerSize = first.headerSize();
+		int size = first.size();
+
+		// the first transfer determines header and operation of the burst, a transfer that does not fit into the
+		// buffer of the bus fails
+		bus.setHeader(first.headerData(), headerSize);
+		if (bus.headerSize() != headerSize || size > bus.capacity()) {
+			this->transfers.pop();
+			first.setReady(0);
+			continue;
+		}
+		std::copy(first.data(), first.data() + size, bus.data());
+		first.active = true;
+		int count = 1;
+
+		// append writes to the following addresses with equal flags while they fit into the bus buffer
+		if ((op & Buffer::Op::WRITE) != 0) {
+			uint32_t header = getHeader(first);
+			uint32_t next = (header & mask) + size;
+			auto it = this->transfers.begin();
+			for (++it; it != this->transfers.end(); ++it) {
+				auto &buffer = *it;
+				uint32_t h = getHeader(buffer);
+				int s = buffer.size();
+				if (buffer.op != op || buffer.headerSize() != headerSize || (h & ~mask) != (header & ~mask)
+					|| (h & mask) != next || size + s > bus.capacity())
+				{
+					break;
+				}
+				std::copy(buffer.data(), buffer.data() + s, bus.data() + size);
+				buffer.active = true;
+				size += s;
+				next += s;
+				++count;
+			}
+			stats.mergedCount += count - 1;
+		}
+
+		// execute the transfer on the bus
+		++stats.transferCount;
+		bus.resize(size);
+		bool started = bus.start(op);
+		if (started)
+			co_await bus.untilReadyOrDisabled();
+		int transferred = started && bus.ready() ? bus.size() : 0;
+
+		// set buffers to ready state and notify the application, new transfers get queued behind the burst and the
+		// remaining buffers of the burst can't be cancelled as they are still active
+		if ((op & Buffer::Op::READ) != 0)
+			std::copy(bus.data(), bus.data() + transferred, first.data());
+		for (int i = 0; i < count; ++i) {
+			auto &buffer = *this->transfers.pop();
+			buffer.active = false;
+			int s = std::min(buffer.size(), transferred);
+			transferred -= s;
+			buffer.setReady(s);
+		}
+	}
+	this->running = false;
+}
+
+
+// Buffer
+
+WriteMerger::Buffer::Buffer(WriteMerger &merger, int headerCapacity, int capacity)
+	: coco::Buffer(new uint8_t[headerCapacity + capacity], headerCapacity, capacity, merger.st.state)
+	, merger(merger)
+{
+	merger.buffers.add(*this);
+}
+
+WriteMerger::Buffer::~Buffer() {
+	delete [] this->p.data;
+}
+
+bool WriteMerger::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+
+	this->op = op;
+	auto &merger = this->merger;
+	if ((op & Op::WRITE) != 0)
+		++merger.stats.writeCount;
+	else
+		++merger.stats.readCount;
+
+	// add to list of transfers and let the event loop process the transfers so that all transfers that get started
+	// in this iteration of the event loop can be merged
+	merger.transfers.push(*this);
+	if (!merger.running) {
+		merger.running = true;
+		merger.loop.invoke(merger.callback);
+	}
+
+	// set state
+	setBusy();
+
+	return true;
+}
+
+bool WriteMerger::Buffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	// a transfer that is on the bus can't be cancelled
+	if (this->active)
+		return true;
+	this->merger.transfers.remove(*this);
+	setReady(0);
+
+	return true;
+}
+
+} // namespace coco
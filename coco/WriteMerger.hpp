@@ -0,0 +1,119 @@
+#pragma once
+
+#include "BufferDevice.hpp"
+#include <coco/Coroutine.hpp>
+#include <coco/IntrusiveList.hpp>
+#include <coco/IntrusiveQueue.hpp>
+#include <coco/Loop.hpp>
+#include <cstdint>
+
+
+namespace coco {
+
+/**
+ * Merges writes to contiguous addresses into one burst transfer on a bus with header-addressed buffers, e.g. register
+ * writes to an I2C or SPI peripheral where the header contains the register address. This saves the address phase and
+ * the per-transfer overhead of all but the first write.
+ *
+ * The address is the header interpreted as big endian number (as sent on the bus), the bits outside of the address
+ * mask (e.g. a read flag) have to be equal for writes to get merged. Transfers get executed in the order they were
+ * started, reads are never merged and end a burst, therefore a read after a write always returns the written value.
+ * All transfers that are started within one iteration of the event loop or while the bus is busy get merged.
+ *
+ * Usage example:
+ * WriteMerger merger(loop, i2cBuffer);
+ * WriteMerger::Buffer buffer1(merger, 1, 4);
+ * WriteMerger::Buffer buffer2(merger, 1, 4);
+ * buffer1.setHeader<uint8_t>(0x10);
+ * buffer1.startWriteArray(std::array<uint8_t, 2>{1, 2});
+ * buffer2.setHeader<uint8_t>(0x12);
+ * buffer2.startWriteArray(std::array<uint8_t, 2>{3, 4}); // gets merged with buffer1
+ */
+class WriteMerger : public BufferDevice {
+public:
+	/**
+	 * Merger statistics
+	 */
+	struct Statistics {
+		// number of writes and reads
+		int writeCount = 0;
+		int readCount = 0;
+
+		// number of transfers on the bus
+		int transferCount = 0;
+
+		// number of writes that were merged into the burst of a previous write
+		int mergedCount = 0;
+	};
+
+	/**
+	 * Constructor
+	 * @param loop event loop
+	 * @param buffer buffer of the bus that is used for the merged transfers, its capacity limits the burst size and
+	 *	transfers that do not fit complete with size 0
+	 * @param addressMask mask for the address in the header
+	 */
+	WriteMerger(Loop &loop, coco::Buffer &buffer, uint32_t addressMask = 0xffffffff);
+	~WriteMerger() override;
+
+	/**
+	 * Buffer for a transfer that may get merged with other transfers
+	 */
+	class Buffer : public coco::Buffer, public IntrusiveListNode, public IntrusiveQueueNode {
+		friend class WriteMerger;
+	public:
+		/**
+		 * Constructor
+		 * @param merger merger to attach to
+		 * @param headerCapacity capacity of the header, i.e. size of address
+		 * @param capacity capacity of the buffer
+		 */
+		Buffer(WriteMerger &merger, int headerCapacity, int capacity);
+		~Buffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		WriteMerger &merger;
+		Op op;
+
+		// true while the buffer is part of the transfer on the bus
+		bool active = false;
+	};
+
+	/**
+	 * Get the merger statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the merger statistics
+	 */
+	void resetStatistics() {this->stats = {};}
+
+	// BufferDevice methods
+	int getBufferCount() override;
+	Buffer &getBuffer(int index) override;
+
+protected:
+	uint32_t getHeader(coco::Buffer &buffer);
+	void handle();
+	Coroutine process();
+
+	Loop &loop;
+	coco::Buffer &buffer;
+	uint32_t addressMask;
+	TimedTask<Callback> callback;
+
+	// list of buffers
+	IntrusiveList<Buffer> buffers;
+
+	// queued transfers, the first transfers are active while the bus is busy
+	IntrusiveQueue<Buffer> transfers;
+	bool running = false;
+
+	Statistics stats;
+};
+
+} // namespace coco
@@ -0,0 +1,302 @@
+#include "CanSocket_native.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+
+namespace coco {
+
+CanSocket_native::CanSocket_native(Loop_native &loop)
+	: BufferDevice(State::DISABLED), loop(loop)
+	, callback(makeCallback<CanSocket_native, &CanSocket_native::transfer>(this))
+{
+}
+
+CanSocket_native::~CanSocket_native() {
+	if (this->socket != -1)
+		::close(this->socket);
+}
+
+bool CanSocket_native::open(const char *interfaceName, bool fd) {
+	if (this->st.state != State::DISABLED)
+		return false;
+
+	// create non-blocking raw CAN socket
+	int s = ::socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+	if (s == -1)
+		return false;
+
+	// get index of interface
+	ifreq request = {};
+	std::strncpy(request.ifr_name, interfaceName, IFNAMSIZ - 1);
+	if (ioctl(s, SIOCGIFINDEX, &request) == -1) {
+		::close(s);
+		return false;
+	}
+
+	// enable CAN FD frames
+	if (fd) {
+		int value = 1;
+		if (setsockopt(s, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &value, sizeof(value)) == -1) {
+			::close(s);
+			return false;
+		}
+	}
+
+	// bind to interface
+	sockaddr_can address = {};
+	address.can_family = AF_CAN;
+	address.can_ifindex = request.ifr_ifindex;
+	if (bind(s, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1) {
+		::close(s);
+		return false;
+	}
+
+	// add to epoll, edge triggered so that we only get notified when new frames arrive or the socket becomes
+	// writable again
+	epoll_event event;
+	event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+	event.data.ptr = static_cast<Loop_native::CompletionHandler *>(this);
+	if (epoll_ctl(this->loop.epollFd, EPOLL_CTL_ADD, s, &event) == -1) {
+		::close(s);
+		return false;
+	}
+	this->socket = s;
+	this->fd = fd;
+	this->writeBlocked = false;
+
+	// set state of buffers to ready
+	for (auto &buffer : this->buffers) {
+		buffer.setReady(0);
+	}
+
+	// set state of device to ready
+	this->st.set(State::READY, Events::ENTER_READY);
+
+	return true;
+}
+
+bool CanSocket_native::setFilters(const can_filter *filters, int count) {
+	if (this->socket == -1)
+		return false;
+	return setsockopt(this->socket, SOL_CAN_RAW, CAN_RAW_FILTER, filters, count * sizeof(can_filter)) == 0;
+}
+
+void CanSocket_native::close() {
+	if (this->socket == -1)
+		return;
+
+	// remove from epoll and close socket
+	epoll_ctl(this->loop.epollFd, EPOLL_CTL_DEL, this->socket, nullptr);
+	::close(this->socket);
+	this->socket = -1;
+
+	// all queued transfers get cancelled
+	while (this->writeTransfers.pop() != nullptr);
+	while (this->readTransfers.pop() != nullptr);
+
+	// set state of buffers to disabled
+	for (auto &buffer : this->buffers) {
+		buffer.setDisabled();
+	}
+
+	// set state of device to disabled
+	this->st.set(State::DISABLED, Events::ENTER_DISABLED);
+}
+
+int CanSocket_native::getBufferCount() {
+	return this->buffers.count();
+}
+
+CanSocket_native::Buffer &CanSocket_native::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+void CanSocket_native::handle(epoll_event &event) {
+	if ((event.events & EPOLLOUT) != 0)
+		this->writeBlocked = false;
+	transfer();
+}
+
+void CanSocket_native::transfer() {
+	if (!this->writeBlocked)
+		send();
+	receive();
+}
+
+void CanSocket_native::prepare(int index, Buffer &buffer, int size) {
+	// header and data of the buffer are a can_frame (size CAN_MTU) or canfd_frame (size CANFD_MTU)
+	this->batch[index] = {&buffer, buffer.sequence};
+	auto &iov = this->iovecs[index];
+	iov.iov_base = buffer.p.data;
+	iov.iov_len = size;
+	auto &message = this->messages[index];
+	message.msg_hdr = {};
+	message.msg_hdr.msg_iov = &iov;
+	message.msg_hdr.msg_iovlen = 1;
+}
+
+void CanSocket_native::send() {
+	while (!this->writeTransfers.empty()) {
+		// collect a batch of write buffers
+		int count = 0;
+		for (auto &buffer : this->writeTransfers) {
+			// the kernel expects a complete can_frame or canfd_frame
+			auto &header = buffer.header<Header>();
+			int size = buffer.size();
+			bool fd = this->fd && ((header.flags & FD) != 0 || size > CAN_MAX_DLEN);
+			header.length = size;
+			if (!fd)
+				header.flags = 0;
+			header.reserved0 = 0;
+			header.reserved1 = 0;
+			prepare(count, buffer, fd ? CANFD_MTU : CAN_MTU);
+			if (++count == MAX_BATCH)
+				break;
+		}
+
+		// send all frames of the batch
+		int result = sendmmsg(this->socket, this->messages, count, 0);
+		if (result == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+				// transmit queue is full, wait for EPOLLOUT
+				this->writeBlocked = true;
+				return;
+			}
+			if (errno == EINTR)
+				continue;
+
+			// the first frame failed (e.g. EINVAL for a frame that is too long), complete it with zero size and go on
+			// with the others
+			auto buffer = this->writeTransfers.pop();
+			buffer->setReady(0);
+			continue;
+		}
+
+		// set sent buffers to ready state and notify application
+		for (int i = 0; i < result; ++i) {
+			// skip transfer if a resumed coroutine cancelled (and maybe restarted) it or closed the device
+			auto &transfer = this->batch[i];
+			auto buffer = transfer.buffer;
+			if (!buffer->busy() || buffer->sequence != transfer.sequence)
+				continue;
+			this->writeTransfers.remove(*buffer);
+			buffer->setReady();
+		}
+	}
+}
+
+void CanSocket_native::receive() {
+	while (!this->readTransfers.empty()) {
+		// collect a batch of read buffers
+		int count = 0;
+		for (auto &buffer : this->readTransfers) {
+			prepare(count, buffer, CANFD_MTU);
+			if (++count == MAX_BATCH)
+				break;
+		}
+
+		// receive as many frames as are available
+		int result = recvmmsg(this->socket, this->messages, count, MSG_DONTWAIT, nullptr);
+		if (result == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				// wait for EPOLLIN
+				return;
+			}
+			if (errno == EINTR)
+				continue;
+
+			// a pending error (e.g. ENETDOWN) was consumed by the call, complete the first read with zero size and go on
+			// with the others as more frames may be queued which the edge triggered EPOLLIN won't report again
+			auto buffer = this->readTransfers.pop();
+			buffer->setReady(0);
+			continue;
+		}
+
+		// set received buffers to ready state and notify application
+		for (int i = 0; i < result; ++i) {
+			// skip transfer if a resumed coroutine cancelled (and maybe restarted) it or closed the device
+			auto &transfer = this->batch[i];
+			auto buffer = transfer.buffer;
+			if (!buffer->busy() || buffer->sequence != transfer.sequence)
+				continue;
+			this->readTransfers.remove(*buffer);
+
+			// the size of the message distinguishes CAN FD frames from classic frames
+			auto &header = buffer->header<Header>();
+			if (this->messages[i].msg_len == CANFD_MTU)
+				header.flags |= FD;
+			else
+				header.flags = 0;
+			buffer->setReady(std::min(int(header.length), CANFD_MAX_DLEN));
+		}
+
+		// no more frames available
+		if (result < count)
+			return;
+	}
+}
+
+
+// Buffer
+
+CanSocket_native::Buffer::Buffer(CanSocket_native &device)
+	: coco::Buffer(new uint8_t[sizeof(canfd_frame)], sizeof(Header), CANFD_MAX_DLEN, device.st.state)
+	, device(device)
+{
+	static_assert(sizeof(Header) == offsetof(canfd_frame, data));
+	*reinterpret_cast<Header *>(this->p.data) = {};
+	device.buffers.add(*this);
+}
+
+CanSocket_native::Buffer::~Buffer() {
+	delete [] this->p.data;
+}
+
+bool CanSocket_native::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set and the header is a Header
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+	assert(this->p.headerSize == sizeof(Header));
+
+	this->op = op;
+	auto &device = this->device;
+	this->sequence = ++device.sequence;
+
+	// add buffer to list of transfers and let the event loop submit the batch when the first was added
+	bool first = (op & Op::WRITE) != 0 ? device.writeTransfers.push(*this) : device.readTransfers.push(*this);
+	if (first)
+		device.loop.invoke(device.callback);
+
+	// set state
+	setBusy();
+
+	return true;
+}
+
+bool CanSocket_native::Buffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	// transfers are submitted synchronously, therefore a busy buffer is always still queued
+	auto &device = this->device;
+	if ((this->op & Op::WRITE) != 0)
+		device.writeTransfers.remove(*this);
+	else
+		device.readTransfers.remove(*this);
+	setReady(0);
+
+	return true;
+}
+
+} // namespace coco
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "../BufferDevice.hpp"
+#include <coco/IntrusiveQueue.hpp>
+#include <coco/platform/Loop_native.hpp>
+#include <linux/can.h>
+#include <sys/socket.h>
+
+
+namespace coco {
+
+/**
+ * CAN socket for the native platform (Linux SocketCAN), e.g. for can0 or a virtual CAN interface (vcan0) that works
+ * without hardware. Each buffer holds one frame: the header (see Header) contains the CAN ID including the flags in
+ * Linux encoding (CAN_EFF_FLAG for extended 29 bit IDs, CAN_RTR_FLAG for remote requests) and the CAN FD flags, the
+ * data is the payload of the frame. Header and data form a struct canfd_frame, therefore the kernel reads and writes
+ * the buffer memory directly.
+ *
+ * Batching is done across buffers instead of packing many frames into one buffer, so that the header of every buffer
+ * describes its frame: all buffers that get started within one iteration of the event loop are submitted in a batch
+ * using one sendmmsg() call for writes and one recvmmsg() call for reads, i.e. many frames get transferred with one
+ * system call. Use many buffers (e.g. 64) for high frame rates. A transfer that fails (e.g. with ENETDOWN) completes
+ * with size 0.
+ * Acceptance filters are set in the kernel using setFilters(), therefore frames that are not of interest do not wake
+ * up the application.
+ *
+ * Usage example:
+ * CanSocket_native socket(loop);
+ * CanSocket_native::Buffer buffer(socket);
+ * socket.open("vcan0");
+ * buffer.setHeader<CanSocket_native::Header>({0x123});
+ * co_await buffer.writeArray(std::array<uint8_t, 2>{0x01, 0x02});
+ */
+class CanSocket_native : public BufferDevice, public Loop_native::CompletionHandler {
+public:
+	/**
+	 * Maximum number of buffers that get submitted in one system call
+	 */
+	static constexpr int MAX_BATCH = 64;
+
+	/**
+	 * Flag that indicates a CAN FD frame (CANFD_FDF), set in the flags of received CAN FD frames. When writing, a frame
+	 * is sent as CAN FD frame if this flag is set or the payload is larger than 8 bytes
+	 */
+	static constexpr uint8_t FD = 0x04;
+
+	/**
+	 * Buffer header, equal to the beginning of struct canfd_frame
+	 */
+	struct Header {
+		// CAN ID including CAN_EFF_FLAG, CAN_RTR_FLAG and CAN_ERR_FLAG
+		canid_t id;
+
+		// payload length, set by the device
+		uint8_t length;
+
+		// CAN FD flags: FD, CANFD_BRS (bit rate switch), CANFD_ESI (error state indicator)
+		uint8_t flags;
+
+		uint8_t reserved0;
+		uint8_t reserved1;
+	};
+
+	/**
+	 * Constructor
+	 * @param loop event loop
+	 */
+	CanSocket_native(Loop_native &loop);
+	~CanSocket_native() override;
+
+	/**
+	 * Buffer for transferring one CAN frame, the capacity is 64 bytes (maximum payload of CAN FD)
+	 */
+	class Buffer : public coco::Buffer, public IntrusiveListNode, public IntrusiveQueueNode {
+		friend class CanSocket_native;
+	public:
+		/**
+		 * Constructor
+		 * @param device device to attach to
+		 */
+		Buffer(CanSocket_native &device);
+		~Buffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		CanSocket_native &device;
+		Op op;
+
+		// sequence number of the current transfer
+		uint32_t sequence = 0;
+	};
+
+	/**
+	 * Open the socket and bind it to a CAN interface
+	 * @param interfaceName name of the interface, e.g. "can0" or "vcan0"
+	 * @param fd true to enable CAN FD frames, then writes with the FD flag or more than 8 bytes are sent as CAN FD
+	 *	frames with the flags of the header (e.g. CANFD_BRS)
+	 * @return true if successful
+	 */
+	bool open(const char *interfaceName, bool fd = false);
+
+	/**
+	 * Set acceptance filters in the kernel. A frame is received if (frameId & mask) == (id & mask) for one of the
+	 * filters. The device has to be open
+	 * @param filters array of filters (Linux can_filter)
+	 * @param count number of filters, 0 to receive no frames at all
+	 * @return true if successful
+	 */
+	bool setFilters(const can_filter *filters, int count);
+
+	/**
+	 * Set acceptance filters in the kernel
+	 * @tparam N number of filters
+	 * @param filters array of filters
+	 * @return true if successful
+	 */
+	template <int N>
+	bool setFilters(const can_filter (&filters)[N]) {
+		return setFilters(filters, N);
+	}
+
+	// Device methods
+	void close() override;
+
+	// BufferDevice methods
+	int getBufferCount() override;
+	Buffer &getBuffer(int index) override;
+
+protected:
+	void handle(epoll_event &event) override;
+	void transfer();
+	void send();
+	void receive();
+	void prepare(int index, Buffer &buffer, int size);
+
+	Loop_native &loop;
+	int socket = -1;
+	bool fd = false;
+	TimedTask<Callback> callback;
+
+	// list of buffers
+	IntrusiveList<Buffer> buffers;
+
+	// queued write and read transfers that get submitted in the next batch
+	IntrusiveQueue<Buffer> writeTransfers;
+	IntrusiveQueue<Buffer> readTransfers;
+
+	// true when the socket returned EAGAIN and we wait for EPOLLOUT
+	bool writeBlocked = false;
+
+	// sequence number of the last started transfer
+	uint32_t sequence = 0;
+
+	// transfers and message headers for sendmmsg()/recvmmsg(), header and data of a buffer are one can_frame or
+	// canfd_frame
+	struct Transfer {
+		Buffer *buffer;
+		uint32_t sequence;
+	};
+	Transfer batch[MAX_BATCH];
+	mmsghdr messages[MAX_BATCH];
+	iovec iovecs[MAX_BATCH];
+};
+
+} // namespace coco
@@ -0,0 +1,227 @@
+#include "I2cMaster_sim.hpp"
+#include <chrono>
+
+
+namespace coco {
+
+I2cMaster_sim::I2cMaster_sim(Loop_native &loop, int clockRate)
+	: loop(loop), clockRate(clockRate)
+	, callback(makeCallback<I2cMaster_sim, &I2cMaster_sim::handle>(this))
+{
+}
+
+I2cMaster_sim::~I2cMaster_sim() {
+}
+
+void I2cMaster_sim::resetStatistics() {
+	this->stats = {};
+	this->startTime = -1;
+}
+
+int64_t I2cMaster_sim::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void I2cMaster_sim::execute(Buffer &buffer) {
+	auto op = buffer.op;
+	auto &slave = buffer.channel.slave;
+	int headerSize = buffer.p.headerSize;
+	int size = buffer.p.size - headerSize;
+	bool read = (op & Buffer::Op::READ) != 0;
+	bool write = (op & Buffer::Op::WRITE) != 0;
+	auto &stats = this->stats;
+
+	// START and address
+	int cycles = 1 + 9;
+	++stats.addressBytes;
+	int64_t stretch = 0;
+	int transferred = size;
+
+	// write phase: header and data are contiguous in the buffer
+	bool nack = false;
+	if (write || headerSize > 0) {
+		int count = headerSize + (write ? size : 0);
+		int acked = slave.write(buffer.p.data, count);
+		if (acked < count) {
+			// the byte that was not acknowledged was transferred too
+			cycles += 9 * (acked + 1);
+			nack = true;
+			++stats.nackCount;
+			transferred = write ? std::max(acked - headerSize, 0) : 0;
+		} else {
+			cycles += 9 * count;
+		}
+		stats.headerBytes += headerSize;
+		if (write)
+			stats.dataBytes += std::max(std::min(acked, count) - headerSize, 0);
+
+		// repeated START and address for the read phase
+		if (read && !nack) {
+			cycles += 1 + 9;
+			++stats.addressBytes;
+			++stats.repeatedStartCount;
+		}
+	}
+
+	// read phase
+	if (read && !nack) {
+		stretch = slave.stretchTime();
+		slave.read(buffer.p.data + headerSize, size);
+		cycles += 9 * size;
+		stats.dataBytes += size;
+	}
+
+	// STOP
+	cycles += 1;
+
+	// timing model: the transaction starts when the bus becomes idle
+	int64_t now = I2cMaster_sim::now();
+	int64_t start = std::max(now, this->busyUntil);
+	int64_t duration = int64_t(cycles) * 1000000000 / this->clockRate + stretch;
+	this->busyUntil = start + duration;
+	this->transferred = transferred;
+
+	// update statistics
+	if (this->startTime < 0)
+		this->startTime = start;
+	++stats.transactionCount;
+	stats.stretchTime += stretch;
+	stats.busyTime += duration;
+	stats.elapsedTime = this->busyUntil - this->startTime;
+
+	// let the event loop call handle() when the transaction has finished
+	this->loop.invoke(this->callback, Milliseconds<>(int((this->busyUntil - now) / 1000000)));
+}
+
+void I2cMaster_sim::handle() {
+	auto buffer = this->transfers.pop();
+	if (buffer != nullptr) {
+		int transferred = this->transferred;
+
+		// start next transfer before notifying the application to keep the bus busy
+		auto next = this->transfers.frontOrNull();
+		if (next != nullptr)
+			execute(*next);
+
+		// set buffer to ready state and notify application
+		buffer->setReady(transferred);
+	}
+}
+
+
+// RegisterSlave
+
+I2cMaster_sim::RegisterSlave::RegisterSlave(int registerCount, int addressSize, int stretchTime)
+	: registers(registerCount), addressSize(addressSize), stretch(stretchTime)
+{
+}
+
+I2cMaster_sim::RegisterSlave::~RegisterSlave() {
+}
+
+int I2cMaster_sim::RegisterSlave::write(const uint8_t *data, int size) {
+	int count = int(this->registers.size());
+	int i = 0;
+
+	// register address, NACK if the write is too short to contain it
+	if (size < this->addressSize)
+		return 0;
+	int address = 0;
+	for (; i < this->addressSize; ++i)
+		address = (address << 8) | data[i];
+	if (address >= count)
+		return 0;
+	this->address = address;
+
+	// register values, NACK at end of register map
+	for (; i < size; ++i) {
+		if (this->address >= count)
+			return i;
+		this->registers[this->address++] = data[i];
+	}
+	return size;
+}
+
+void I2cMaster_sim::RegisterSlave::read(uint8_t *data, int size) {
+	int count = int(this->registers.size());
+	for (int i = 0; i < size; ++i) {
+		// bus reads 0xff after end of register map
+		data[i] = this->address < count ? this->registers[this->address++] : 0xff;
+	}
+}
+
+int I2cMaster_sim::RegisterSlave::stretchTime() {
+	return this->stretch;
+}
+
+
+// Channel
+
+I2cMaster_sim::Channel::Channel(I2cMaster_sim &master, Slave &slave, int address)
+	: BufferDevice(State::READY), master(master), slave(slave), address(address)
+{
+}
+
+I2cMaster_sim::Channel::~Channel() {
+}
+
+int I2cMaster_sim::Channel::getBufferCount() {
+	return this->buffers.count();
+}
+
+I2cMaster_sim::Buffer &I2cMaster_sim::Channel::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+
+// Buffer
+
+I2cMaster_sim::Buffer::Buffer(Channel &channel, int headerCapacity, int capacity)
+	: coco::Buffer(new uint8_t[headerCapacity + capacity], headerCapacity, capacity, channel.st.state)
+	, channel(channel)
+{
+	channel.buffers.add(*this);
+}
+
+I2cMaster_sim::Buffer::~Buffer() {
+	delete [] this->p.data;
+}
+
+bool I2cMaster_sim::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if READ or WRITE flag is set
+	assert((op & Op::READ_WRITE) != 0);
+
+	this->op = op;
+	auto &master = this->channel.master;
+
+	// add buffer to list of transfers and execute it immediately if the bus is idle
+	if (master.transfers.push(*this))
+		master.execute(*this);
+
+	// set state
+	setBusy();
+
+	return true;
+}
+
+bool I2cMaster_sim::Buffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	// the transfer that is on the bus can't be cancelled
+	auto &master = this->channel.master;
+	if (master.transfers.frontOrNull() != this) {
+		master.transfers.remove(*this);
+		setReady(0);
+	}
+	return true;
+}
+
+} // namespace coco
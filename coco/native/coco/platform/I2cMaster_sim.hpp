@@ -0,0 +1,239 @@
+#pragma once
+
+#include "../BufferDevice.hpp"
+#include <coco/IntrusiveQueue.hpp>
+#include <coco/platform/Loop_native.hpp>
+#include <vector>
+
+
+namespace coco {
+
+/**
+ * Simulated I2C master for the native platform. Each channel is a BufferDevice for one slave address and is connected
+ * to a slave model. The header of a buffer typically contains the register address and is written before the data.
+ *
+ * Transactions:
+ * WRITE: START, address+W, header, data, STOP
+ * READ: START, address+W, header, repeated START, address+R, data, STOP (without header: START, address+R, data, STOP)
+ * READ_WRITE: START, address+W, header, data, repeated START, address+R, data, STOP (reply is read into the buffer)
+ *
+ * The timing model counts one clock cycle for each START, repeated START and STOP condition and nine clock cycles
+ * (eight data bits and ACK) for each byte including the address bytes. Slaves can stretch the clock. Transfers
+ * get executed in the order they were started and complete in real time (with the granularity of the event loop
+ * timer) when the bus would have finished the transfer.
+ *
+ * Usage example:
+ * I2cMaster_sim master(loop, 400000);
+ * I2cMaster_sim::RegisterSlave sensor(256);
+ * I2cMaster_sim::Channel channel(master, sensor, 0x76);
+ * I2cMaster_sim::Buffer buffer(channel, 1, 32);
+ * buffer.setHeader<uint8_t>(0xd0);
+ * co_await buffer.read(1);
+ */
+class I2cMaster_sim {
+public:
+	/**
+	 * Interface for slave models
+	 */
+	class Slave {
+	public:
+		virtual ~Slave() {}
+
+		/**
+		 * START condition and address with write bit, then the master writes the data
+		 * @param data data written by the master
+		 * @param size size of data
+		 * @return number of bytes acknowledged by the slave, less than size if the slave sent a NACK
+		 */
+		virtual int write(const uint8_t *data, int size) = 0;
+
+		/**
+		 * (Repeated) START condition and address with read bit, then the master reads the data
+		 * @param data data read by the master
+		 * @param size size of data
+		 */
+		virtual void read(uint8_t *data, int size) = 0;
+
+		/**
+		 * Time in nanoseconds the slave stretches the clock before the data of a read can be transferred, e.g. when a
+		 * measurement is in progress
+		 */
+		virtual int stretchTime() {return 0;}
+	};
+
+	/**
+	 * Slave model consisting of a register map. The first bytes of a write set the register address (auto
+	 * incremented on each data byte), reads start at the current register address. A write that is too short to
+	 * contain the register address or that addresses a register outside of the map gets a NACK.
+	 */
+	class RegisterSlave : public Slave {
+	public:
+		/**
+		 * Constructor
+		 * @param registerCount number of 8 bit registers
+		 * @param addressSize size of the register address in bytes (big endian)
+		 * @param stretchTime clock stretching in nanoseconds before each read
+		 */
+		RegisterSlave(int registerCount, int addressSize = 1, int stretchTime = 0);
+		~RegisterSlave() override;
+
+		/**
+		 * Register access for the test, e.g. to simulate a new measurement
+		 */
+		uint8_t &operator [](int index) {return this->registers[index];}
+
+		int write(const uint8_t *data, int size) override;
+		void read(uint8_t *data, int size) override;
+		int stretchTime() override;
+
+	protected:
+		std::vector<uint8_t> registers;
+		int addressSize;
+		int stretch;
+		int address = 0;
+	};
+
+	/**
+	 * Bus statistics
+	 */
+	struct Statistics {
+		// number of transactions (START to STOP)
+		int transactionCount = 0;
+
+		// number of repeated START conditions
+		int repeatedStartCount = 0;
+
+		// number of transactions aborted by a NACK of the slave
+		int nackCount = 0;
+
+		// number of address bytes (including address bytes after repeated START)
+		int64_t addressBytes = 0;
+
+		// number of header bytes (e.g. register address)
+		int64_t headerBytes = 0;
+
+		// number of data bytes
+		int64_t dataBytes = 0;
+
+		// time the slaves stretched the clock in nanoseconds
+		int64_t stretchTime = 0;
+
+		// time the bus was busy in nanoseconds
+		int64_t busyTime = 0;
+
+		// time from start of first transaction to end of last transaction in nanoseconds
+		int64_t elapsedTime = 0;
+
+		/**
+		 * Bus utilization, i.e. fraction of time the bus was busy
+		 */
+		float utilization() const {return this->elapsedTime > 0 ? float(this->busyTime) / float(this->elapsedTime) : 0.0f;}
+
+		/**
+		 * Average number of overhead bytes (address and header) per transaction
+		 */
+		float overheadPerTransaction() const {
+			return this->transactionCount > 0 ? float(this->addressBytes + this->headerBytes) / float(this->transactionCount) : 0.0f;
+		}
+	};
+
+	/**
+	 * Constructor
+	 * @param loop event loop
+	 * @param clockRate I2C clock rate in Hz, e.g. 100000 or 400000
+	 */
+	I2cMaster_sim(Loop_native &loop, int clockRate);
+	~I2cMaster_sim();
+
+	class Channel;
+
+	/**
+	 * Buffer for transferring data to/from a slave
+	 */
+	class Buffer : public coco::Buffer, public IntrusiveListNode, public IntrusiveQueueNode {
+		friend class I2cMaster_sim;
+	public:
+		/**
+		 * Constructor
+		 * @param channel channel to attach to
+		 * @param headerCapacity capacity of the header (size of register address)
+		 * @param capacity capacity of the buffer
+		 */
+		Buffer(Channel &channel, int headerCapacity, int capacity);
+		~Buffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		Channel &channel;
+		Op op;
+	};
+
+	/**
+	 * Channel to a slave with given slave address
+	 */
+	class Channel : public BufferDevice {
+		friend class I2cMaster_sim;
+	public:
+		/**
+		 * Constructor
+		 * @param master the I2C master the channel belongs to
+		 * @param slave model of the slave
+		 * @param address 7 bit slave address
+		 */
+		Channel(I2cMaster_sim &master, Slave &slave, int address);
+		~Channel() override;
+
+		// BufferDevice methods
+		int getBufferCount() override;
+		Buffer &getBuffer(int index) override;
+
+	protected:
+		I2cMaster_sim &master;
+		Slave &slave;
+		int address;
+
+		// list of buffers
+		IntrusiveList<Buffer> buffers;
+	};
+
+	/**
+	 * Get the bus statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the bus statistics, e.g. after initialization of the slaves
+	 */
+	void resetStatistics();
+
+	/**
+	 * Get the current time of the timing model in nanoseconds
+	 */
+	static int64_t now();
+
+protected:
+	void execute(Buffer &buffer);
+	void handle();
+
+	Loop_native &loop;
+	int clockRate;
+	TimedTask<Callback> callback;
+
+	// time when the bus becomes idle in nanoseconds
+	int64_t busyUntil = 0;
+
+	// time when the first transaction started after reset of statistics in nanoseconds
+	int64_t startTime = -1;
+
+	Statistics stats;
+
+	// number of bytes transferred by the current transaction
+	int transferred;
+
+	// list of active transfers, the first is currently on the bus
+	IntrusiveQueue<Buffer> transfers;
+};
+
+} // namespace coco
@@ -0,0 +1,222 @@
+#include "PeriodicStream_sim.hpp"
+#include <algorithm>
+#include <chrono>
+
+
+namespace coco {
+
+PeriodicStream_sim::PeriodicStream_sim(Loop_native &loop, int sampleRate, int frameSize, int periodFrames)
+	: BufferDevice(State::DISABLED), loop(loop)
+	, sampleRate(sampleRate), periodFrames(periodFrames), periodSize(frameSize * periodFrames)
+	, period(int64_t(periodFrames) * 1000000000 / sampleRate)
+	, callback(makeCallback<PeriodicStream_sim, &PeriodicStream_sim::handle>(this))
+{
+}
+
+PeriodicStream_sim::~PeriodicStream_sim() {
+}
+
+void PeriodicStream_sim::open() {
+	if (this->st.state != State::DISABLED)
+		return;
+
+	// start the clock
+	this->openTime = now();
+	this->index = 1;
+	this->writing = false;
+	this->reading = false;
+	resetStatistics();
+	this->loop.invoke(this->callback, Milliseconds<>(int((this->period + 999999) / 1000000)));
+
+	// set state of buffers to ready
+	for (auto &buffer : this->buffers) {
+		buffer.completeTime = -1;
+		buffer.setReady(0);
+	}
+
+	// set state of device to ready
+	this->st.set(State::READY, Events::ENTER_READY);
+}
+
+void PeriodicStream_sim::resetStatistics() {
+	this->stats = {};
+}
+
+int64_t PeriodicStream_sim::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PeriodicStream_sim::close() {
+	if (this->st.state == State::DISABLED)
+		return;
+
+	// all queued transfers get cancelled, the clock stops in handle()
+	while (this->writeTransfers.pop() != nullptr);
+	while (this->readTransfers.pop() != nullptr);
+
+	// set state of buffers to disabled
+	for (auto &buffer : this->buffers) {
+		buffer.setDisabled();
+	}
+
+	// set state of device to disabled
+	this->st.set(State::DISABLED, Events::ENTER_DISABLED);
+}
+
+int PeriodicStream_sim::getBufferCount() {
+	return this->buffers.count();
+}
+
+PeriodicStream_sim::Buffer &PeriodicStream_sim::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+int64_t PeriodicStream_sim::periodTime(int64_t index) {
+	// split into seconds and remainder to avoid overflow
+	int64_t frames = index * this->periodFrames;
+	return this->openTime + frames / this->sampleRate * 1000000000
+		+ frames % this->sampleRate * 1000000000 / this->sampleRate;
+}
+
+void PeriodicStream_sim::tick(int64_t time) {
+	auto &stats = this->stats;
+	++stats.periodCount;
+
+	// playback: the clock consumes the first write buffer if it was started in time
+	auto buffer = this->writeTransfers.frontOrNull();
+	if (buffer != nullptr && buffer->startTime <= time) {
+		this->writeTransfers.pop();
+		++stats.writeCount;
+		complete(*buffer, time);
+	} else if (this->writing) {
+		++stats.underrunCount;
+	}
+
+	// capture: the clock fills the first read buffer if it was started in time, otherwise the period is lost
+	buffer = this->readTransfers.frontOrNull();
+	if (buffer != nullptr && buffer->startTime <= time) {
+		this->readTransfers.pop();
+		int size = std::min(buffer->capacity(), this->periodSize);
+		auto data = buffer->data();
+		for (int i = 0; i < size; ++i) {
+			data[i] = this->counter++;
+		}
+		buffer->p.size = buffer->p.headerSize + size;
+		++stats.readCount;
+		complete(*buffer, time);
+	} else {
+		this->counter += this->periodSize;
+		if (this->reading)
+			++stats.overrunCount;
+	}
+}
+
+void PeriodicStream_sim::complete(Buffer &buffer, int64_t time) {
+	// record completion time and margin
+	auto &stats = this->stats;
+	buffer.completeTime = time;
+	buffer.lastMargin = time - buffer.startTime;
+	if (stats.writeCount + stats.readCount == 1 || buffer.lastMargin < stats.minMargin)
+		stats.minMargin = buffer.lastMargin;
+	this->completed.push_back({&buffer, buffer.sequence});
+}
+
+void PeriodicStream_sim::handle() {
+	if (this->st.state != State::READY)
+		return;
+
+	// execute all periods that have elapsed, the event loop may be late
+	int64_t now = PeriodicStream_sim::now();
+	int64_t time;
+	while ((time = periodTime(this->index)) <= now) {
+		tick(time);
+		++this->index;
+	}
+
+	// let the event loop call handle() when the next period has elapsed, round up to not wake up too early
+	this->loop.invoke(this->callback, Milliseconds<>(int((time - now + 999999) / 1000000)));
+
+	// set buffers to ready state and notify the application, done last as the application may restart the buffers.
+	// Skip buffers that were cancelled, disabled or restarted by the application in the meantime
+	for (auto &transfer : this->completed) {
+		auto buffer = transfer.buffer;
+		if (buffer->busy() && buffer->sequence == transfer.sequence)
+			buffer->setReady();
+	}
+	this->completed.clear();
+}
+
+
+// Buffer
+
+PeriodicStream_sim::Buffer::Buffer(PeriodicStream_sim &device)
+	: coco::Buffer(new uint8_t[device.periodSize], device.periodSize, device.st.state)
+	, device(device)
+{
+	device.buffers.add(*this);
+}
+
+PeriodicStream_sim::Buffer::~Buffer() {
+	delete [] this->p.data;
+}
+
+bool PeriodicStream_sim::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+
+	this->op = op;
+	auto &device = this->device;
+	this->sequence = ++device.sequence;
+
+	// measure slack between completion by the clock and restart
+	this->startTime = PeriodicStream_sim::now();
+	if (this->completeTime >= 0) {
+		auto &stats = device.stats;
+		int64_t slack = this->startTime - this->completeTime;
+		this->lastSlack = slack;
+		if (stats.slackCount == 0 || slack < stats.minSlack)
+			stats.minSlack = slack;
+		if (slack > stats.maxSlack)
+			stats.maxSlack = slack;
+		stats.totalSlack += slack;
+		++stats.slackCount;
+	}
+
+	// add buffer to list of transfers, the clock picks it up on the next period
+	if ((op & Op::WRITE) != 0) {
+		device.writeTransfers.push(*this);
+		device.writing = true;
+	} else {
+		device.readTransfers.push(*this);
+		device.reading = true;
+	}
+
+	// set state
+	setBusy();
+
+	return true;
+}
+
+bool PeriodicStream_sim::Buffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	auto &device = this->device;
+	if ((this->op & Op::WRITE) != 0)
+		device.writeTransfers.remove(*this);
+	else
+		device.readTransfers.remove(*this);
+	this->completeTime = -1;
+	setReady(0);
+
+	return true;
+}
+
+} // namespace coco
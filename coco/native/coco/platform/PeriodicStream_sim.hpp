@@ -0,0 +1,202 @@
+#pragma once
+
+#include "../BufferDevice.hpp"
+#include <coco/IntrusiveQueue.hpp>
+#include <coco/platform/Loop_native.hpp>
+#include <vector>
+
+
+namespace coco {
+
+/**
+ * Simulated periodic stream for the native platform, e.g. an I2S audio interface, an ALSA period or a free running
+ * ADC. A clock completes one period every periodFrames / sampleRate seconds. On each period, the first queued write
+ * buffer gets consumed (playback) and the first queued read buffer gets filled (capture). The captured data is a byte
+ * counter that continues over all periods so that lost periods can be detected.
+ *
+ * If no write buffer is queued when the clock needs it, an underrun is counted (the hardware would output silence or
+ * repeat the last period), if no read buffer is queued, an overrun is counted and the data of the period is lost. A
+ * direction is only checked after its first buffer was started, therefore a playback-only stream does not count
+ * overruns and a capture-only stream does not count underruns. A buffer counts as queued only if it was started before
+ * the period completed, therefore the measurement is not affected by the latency of the event loop. The stream keeps
+ * running after underruns and overruns.
+ *
+ * For each buffer, the slack between completion by the clock and restart by the application is measured, and the
+ * margin between restart and the time when the clock needs the buffer. A small minimum margin indicates that more
+ * buffers are needed for a glitch-free stream.
+ *
+ * Usage example:
+ * PeriodicStream_sim stream(loop, 48000, 4, 256);
+ * PeriodicStream_sim::Buffer buffer1(stream);
+ * PeriodicStream_sim::Buffer buffer2(stream);
+ * stream.open();
+ * buffer1.startWrite(buffer1.capacity());
+ * buffer2.startWrite(buffer2.capacity());
+ */
+class PeriodicStream_sim : public BufferDevice {
+public:
+	/**
+	 * Stream statistics, times are in nanoseconds
+	 */
+	struct Statistics {
+		// number of periods since open() or resetStatistics()
+		int periodCount = 0;
+
+		// number of consumed write buffers and filled read buffers
+		int writeCount = 0;
+		int readCount = 0;
+
+		// number of periods without a write buffer (underrun) and without a read buffer (overrun), counted once the
+		// direction is in use
+		int underrunCount = 0;
+		int overrunCount = 0;
+
+		// slack between completion and restart of a buffer
+		int slackCount = 0;
+		int64_t totalSlack = 0;
+		int64_t minSlack = 0;
+		int64_t maxSlack = 0;
+
+		// minimum margin between start of a buffer and the period that completed it
+		int64_t minMargin = 0;
+
+		/**
+		 * Average slack between completion and restart of a buffer
+		 */
+		int64_t averageSlack() const {return this->slackCount > 0 ? this->totalSlack / this->slackCount : 0;}
+
+		/**
+		 * Number of periods with glitches
+		 */
+		int glitchCount() const {return this->underrunCount + this->overrunCount;}
+	};
+
+	/**
+	 * Constructor
+	 * @param loop event loop
+	 * @param sampleRate sample rate in frames per second, e.g. 48000
+	 * @param frameSize size of one frame in bytes, e.g. 4 for 16 bit stereo
+	 * @param periodFrames number of frames per period
+	 */
+	PeriodicStream_sim(Loop_native &loop, int sampleRate, int frameSize, int periodFrames);
+	~PeriodicStream_sim() override;
+
+	/**
+	 * Buffer for one period of the stream
+	 */
+	class Buffer : public coco::Buffer, public IntrusiveListNode, public IntrusiveQueueNode {
+		friend class PeriodicStream_sim;
+	public:
+		/**
+		 * Constructor, the capacity is the size of one period
+		 * @param device device to attach to
+		 */
+		Buffer(PeriodicStream_sim &device);
+		~Buffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+		/**
+		 * Slack between the last completion and restart of the buffer in nanoseconds
+		 */
+		int64_t slack() const {return this->lastSlack;}
+
+		/**
+		 * Margin between the last start of the buffer and the period that completed it in nanoseconds
+		 */
+		int64_t margin() const {return this->lastMargin;}
+
+	protected:
+		PeriodicStream_sim &device;
+		Op op;
+
+		// time of last start and last completion, -1 if the buffer was not completed by the clock yet
+		int64_t startTime = 0;
+		int64_t completeTime = -1;
+
+		int64_t lastSlack = 0;
+		int64_t lastMargin = 0;
+
+		// sequence number of the current transfer
+		uint32_t sequence = 0;
+	};
+
+	/**
+	 * Start the clock, the first period completes one period duration after opening
+	 */
+	void open();
+
+	/**
+	 * Get the duration of one period in nanoseconds
+	 */
+	int64_t periodDuration() const {return this->period;}
+
+	/**
+	 * Get the stream statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the stream statistics
+	 */
+	void resetStatistics();
+
+	/**
+	 * Get the current time of the timing model in nanoseconds
+	 */
+	static int64_t now();
+
+	// Device methods
+	void close() override;
+
+	// BufferDevice methods
+	int getBufferCount() override;
+	Buffer &getBuffer(int index) override;
+
+protected:
+	int64_t periodTime(int64_t index);
+	void tick(int64_t time);
+	void complete(Buffer &buffer, int64_t time);
+	void handle();
+
+	Loop_native &loop;
+	int sampleRate;
+	int periodFrames;
+	int periodSize;
+	int64_t period;
+	TimedTask<Callback> callback;
+
+	// list of buffers
+	IntrusiveList<Buffer> buffers;
+
+	// queued write and read transfers
+	IntrusiveQueue<Buffer> writeTransfers;
+	IntrusiveQueue<Buffer> readTransfers;
+
+	// buffers that were completed by the clock, reused in handle()
+	struct Transfer {
+		Buffer *buffer;
+		uint32_t sequence;
+	};
+	std::vector<Transfer> completed;
+
+	// sequence number of the last started transfer
+	uint32_t sequence = 0;
+
+	// true once a write or read buffer was started since open()
+	bool writing = false;
+	bool reading = false;
+
+	// time when the clock was started and index of the next period, the time of a period is calculated from the
+	// index so that rounding errors do not accumulate
+	int64_t openTime = 0;
+	int64_t index = 0;
+
+	// byte counter for captured data
+	uint8_t counter = 0;
+
+	Statistics stats;
+};
+
+} // namespace coco
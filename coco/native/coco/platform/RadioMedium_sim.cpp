@@ -0,0 +1,242 @@
+#include "RadioMedium_sim.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+
+namespace coco {
+
+RadioMedium_sim::RadioMedium_sim(Loop_native &loop, int bitRate, int overhead, float lossProbability, uint32_t seed)
+	: loop(loop), bitRate(bitRate), overhead(overhead), lossProbability(lossProbability), random(seed)
+	, callback(makeCallback<RadioMedium_sim, &RadioMedium_sim::handle>(this))
+{
+}
+
+RadioMedium_sim::~RadioMedium_sim() {
+}
+
+void RadioMedium_sim::resetStatistics() {
+	this->stats = {};
+	this->startTime = -1;
+}
+
+int64_t RadioMedium_sim::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void RadioMedium_sim::transmit(Node &node, int64_t start) {
+	auto &buffer = *node.writeTransfers.frontOrNull();
+
+	// timing model: airtime of data and PHY overhead
+	int64_t duration = int64_t(buffer.size() + this->overhead) * 8 * 1000000000 / this->bitRate;
+	int64_t end = start + duration;
+
+	// all packets that overlap in time collide
+	bool collided = false;
+	for (auto &transmission : this->transmissions) {
+		if (transmission.end > start && transmission.start < end) {
+			transmission.collided = true;
+			collided = true;
+		}
+	}
+	this->transmissions.push_back({&node, &buffer, start, end, collided});
+
+	// the node can't receive while transmitting, extend the time span if the packet follows the previous one directly
+	if (start > node.transmitEnd)
+		node.transmitStart = start;
+	node.transmitEnd = end;
+
+	// update statistics
+	auto &stats = this->stats;
+	if (this->startTime < 0)
+		this->startTime = start;
+	++stats.transmitCount;
+	stats.transmitBytes += buffer.size();
+	stats.busyTime += std::max(end - std::max(start, this->busyUntil), int64_t(0));
+	this->busyUntil = std::max(this->busyUntil, end);
+	stats.elapsedTime = this->busyUntil - this->startTime;
+}
+
+void RadioMedium_sim::schedule(int64_t now) {
+	if (this->transmissions.empty())
+		return;
+
+	// let the event loop call handle() when the first packet has finished, round up to not wake up too early
+	int64_t end = this->transmissions.front().end;
+	for (auto &transmission : this->transmissions) {
+		end = std::min(end, transmission.end);
+	}
+	int delay = int(std::max((end - now + 999999) / 1000000, int64_t(0)));
+	this->loop.invoke(this->callback, Milliseconds<>(delay));
+}
+
+void RadioMedium_sim::handle() {
+	int64_t now = RadioMedium_sim::now();
+	auto &transmissions = this->transmissions;
+	auto &stats = this->stats;
+
+	// process finished packets in the order of their end time so that the next packet of a node, which starts
+	// immediately after the previous one, sees all packets it overlaps with
+	while (true) {
+		auto it = std::min_element(transmissions.begin(), transmissions.end(),
+			[](const Transmission &a, const Transmission &b) {return a.end < b.end;});
+		if (it == transmissions.end() || it->end > now)
+			break;
+		auto transmission = *it;
+		transmissions.erase(it);
+		auto &sender = *transmission.node;
+		auto &buffer = *transmission.buffer;
+
+		if (transmission.collided) {
+			++stats.collisionCount;
+		} else {
+			// deliver the packet to all other nodes
+			for (auto &node : this->nodes) {
+				if (&node == &sender)
+					continue;
+
+				// check if the node is listening and not transmitting (half-duplex)
+				auto receiver = node.readTransfers.frontOrNull();
+				bool transmitting = node.transmitStart < transmission.end && node.transmitEnd > transmission.start;
+				if (receiver == nullptr || transmitting) {
+					++stats.missCount;
+					continue;
+				}
+
+				// random packet loss
+				if (this->lossProbability > 0.0f
+					&& std::uniform_real_distribution<float>(0.0f, 1.0f)(this->random) < this->lossProbability)
+				{
+					++stats.lossCount;
+					continue;
+				}
+
+				// copy the packet, excess data gets truncated
+				int size = std::min(buffer.size(), receiver->capacity());
+				std::memcpy(receiver->data(), buffer.data(), size);
+				receiver->p.size = receiver->p.headerSize + size;
+				node.readTransfers.pop();
+				this->completed.push_back({receiver, receiver->sequence});
+				++stats.receiveCount;
+				stats.receiveBytes += size;
+			}
+		}
+
+		// the transmission has finished, start the next packet of the sender
+		sender.writeTransfers.pop();
+		this->completed.push_back({&buffer, buffer.sequence});
+		if (!sender.writeTransfers.empty())
+			transmit(sender, transmission.end);
+	}
+	schedule(now);
+
+	// set buffers to ready state and notify the application, done last as the application may start new transfers.
+	// Skip transfers that a resumed coroutine has cancelled (and maybe restarted) in the meantime
+	for (auto &transfer : this->completed) {
+		auto buffer = transfer.buffer;
+		if (buffer->busy() && buffer->sequence == transfer.sequence)
+			buffer->setReady();
+	}
+	this->completed.clear();
+}
+
+
+// Buffer
+
+RadioMedium_sim::Buffer::Buffer(Node &node, int capacity)
+	: coco::Buffer(new uint8_t[capacity], capacity, node.st.state)
+	, node(node)
+{
+	node.buffers.add(*this);
+}
+
+RadioMedium_sim::Buffer::~Buffer() {
+	delete [] this->p.data;
+}
+
+bool RadioMedium_sim::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+
+	this->op = op;
+	auto &node = this->node;
+	auto &medium = node.medium;
+	this->sequence = ++medium.sequence;
+
+	// set state
+	setBusy();
+
+	if ((op & Op::WRITE) != 0) {
+		// the packet goes on the air immediately if the node is not transmitting already
+		if (node.writeTransfers.push(*this)) {
+			int64_t now = RadioMedium_sim::now();
+			medium.transmit(node, now);
+			medium.schedule(now);
+		}
+	} else {
+		// listen until a packet arrives
+		node.readTransfers.push(*this);
+	}
+
+	return true;
+}
+
+bool RadioMedium_sim::Buffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	auto &node = this->node;
+	if ((this->op & Op::WRITE) != 0) {
+		// a packet that is on the air can't be cancelled
+		if (node.writeTransfers.frontOrNull() == this)
+			return true;
+		node.writeTransfers.remove(*this);
+	} else {
+		node.readTransfers.remove(*this);
+	}
+	setReady(0);
+
+	return true;
+}
+
+
+// Node
+
+RadioMedium_sim::Node::Node(RadioMedium_sim &medium)
+	: BufferDevice(State::READY), medium(medium)
+{
+	medium.nodes.add(*this);
+}
+
+RadioMedium_sim::Node::~Node() {
+	// remove packet that is on the air
+	auto &transmissions = this->medium.transmissions;
+	transmissions.erase(std::remove_if(transmissions.begin(), transmissions.end(),
+		[this](const Transmission &transmission) {return transmission.node == this;}), transmissions.end());
+}
+
+bool RadioMedium_sim::Node::channelBusy() {
+	int64_t now = RadioMedium_sim::now();
+	for (auto &transmission : this->medium.transmissions) {
+		if (transmission.start <= now && transmission.end > now)
+			return true;
+	}
+	return false;
+}
+
+int RadioMedium_sim::Node::getBufferCount() {
+	return this->buffers.count();
+}
+
+RadioMedium_sim::Buffer &RadioMedium_sim::Node::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+} // namespace coco
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "../BufferDevice.hpp"
+#include <coco/IntrusiveQueue.hpp>
+#include <coco/platform/Loop_native.hpp>
+#include <random>
+#include <vector>
+
+
+namespace coco {
+
+/**
+ * Simulated radio medium for the native platform, e.g. for IEEE 802.15.4 radios. Each node is a BufferDevice, a write
+ * transmits the data of the buffer as one packet and a read receives one packet from another node.
+ *
+ * A packet occupies the medium for an airtime that is proportional to its size plus the PHY overhead (preamble, start
+ * of frame delimiter and length) and inversely proportional to the bit rate. All nodes hear each other, therefore
+ * packets whose airtime overlaps collide and get lost for all receivers. The radios are half-duplex, a node does not
+ * receive packets that overlap with its own transmissions. A packet that did not collide is received by every other
+ * node that has a read pending and was not transmitting, with a given probability of loss. Transmissions of a node are
+ * executed one after the other, there is no carrier sense or retransmission, this is left to the MAC layer under test
+ * which can use channelBusy() for clear channel assessment.
+ *
+ * Packets complete in real time (with the granularity of the event loop timer) when the medium would have finished
+ * the transmission. Hundreds of nodes can share one medium, e.g. for benchmarking MAC scheduling under contention.
+ *
+ * Usage example:
+ * RadioMedium_sim medium(loop, 250000, 6, 0.01f);
+ * RadioMedium_sim::Node node1(medium);
+ * RadioMedium_sim::Node node2(medium);
+ * RadioMedium_sim::Buffer buffer1(node1, 127);
+ * RadioMedium_sim::Buffer buffer2(node2, 127);
+ * co_await buffer1.writeArray(packet);
+ */
+class RadioMedium_sim {
+public:
+	/**
+	 * Medium statistics
+	 */
+	struct Statistics {
+		// number of transmitted packets
+		int transmitCount = 0;
+
+		// number of transmitted packets that collided with other packets
+		int collisionCount = 0;
+
+		// number of received packets
+		int receiveCount = 0;
+
+		// number of packets that were lost on the way to a receiver
+		int lossCount = 0;
+
+		// number of packets that a node missed because it had no read pending or was transmitting
+		int missCount = 0;
+
+		// number of transmitted and received data bytes
+		int64_t transmitBytes = 0;
+		int64_t receiveBytes = 0;
+
+		// time the medium was occupied by at least one packet in nanoseconds
+		int64_t busyTime = 0;
+
+		// time from start of first packet to end of last packet in nanoseconds
+		int64_t elapsedTime = 0;
+
+		/**
+		 * Utilization of the medium, i.e. fraction of time the medium was busy
+		 */
+		float utilization() const {return this->elapsedTime > 0 ? float(this->busyTime) / float(this->elapsedTime) : 0.0f;}
+
+		/**
+		 * Fraction of transmitted packets that collided
+		 */
+		float collisionRate() const {
+			return this->transmitCount > 0 ? float(this->collisionCount) / float(this->transmitCount) : 0.0f;
+		}
+	};
+
+	/**
+	 * Constructor
+	 * @param loop event loop
+	 * @param bitRate bit rate in bits per second, e.g. 250000 for 802.15.4 in the 2.4GHz band
+	 * @param overhead PHY overhead per packet in bytes, e.g. 6 for 802.15.4 (preamble, SFD, PHR)
+	 * @param lossProbability probability that a packet gets lost on the way to a receiver
+	 * @param seed seed of the random generator for reproducible packet loss
+	 */
+	RadioMedium_sim(Loop_native &loop, int bitRate = 250000, int overhead = 6, float lossProbability = 0.0f,
+		uint32_t seed = 1);
+	~RadioMedium_sim();
+
+	class Node;
+
+	/**
+	 * Buffer for transmitting or receiving one packet
+	 */
+	class Buffer : public coco::Buffer, public IntrusiveListNode, public IntrusiveQueueNode {
+		friend class RadioMedium_sim;
+	public:
+		/**
+		 * Constructor
+		 * @param node node to attach to
+		 * @param capacity capacity of the buffer, i.e. maximum packet size
+		 */
+		Buffer(Node &node, int capacity);
+		~Buffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		Node &node;
+		Op op;
+
+		// sequence number of the current transfer
+		uint32_t sequence = 0;
+	};
+
+	/**
+	 * Radio node, always ready
+	 */
+	class Node : public BufferDevice, public IntrusiveListNode {
+		friend class RadioMedium_sim;
+	public:
+		/**
+		 * Constructor
+		 * @param medium the medium the node is attached to
+		 */
+		Node(RadioMedium_sim &medium);
+		~Node() override;
+
+		/**
+		 * Clear channel assessment
+		 * @return true if a packet is currently on the air
+		 */
+		bool channelBusy();
+
+		// BufferDevice methods
+		int getBufferCount() override;
+		Buffer &getBuffer(int index) override;
+
+	protected:
+		RadioMedium_sim &medium;
+
+		// list of buffers
+		IntrusiveList<Buffer> buffers;
+
+		// queued write and read transfers, the first write is on the air
+		IntrusiveQueue<Buffer> writeTransfers;
+		IntrusiveQueue<Buffer> readTransfers;
+
+		// time span of the packets the node transmitted back to back most recently, the node can't receive meanwhile
+		int64_t transmitStart = 0;
+		int64_t transmitEnd = 0;
+	};
+
+	/**
+	 * Get the medium statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the medium statistics
+	 */
+	void resetStatistics();
+
+	/**
+	 * Get the current time of the timing model in nanoseconds
+	 */
+	static int64_t now();
+
+protected:
+	void transmit(Node &node, int64_t start);
+	void schedule(int64_t now);
+	void handle();
+
+	Loop_native &loop;
+	int bitRate;
+	int overhead;
+	float lossProbability;
+	std::minstd_rand random;
+	TimedTask<Callback> callback;
+
+	// list of nodes
+	IntrusiveList<Node> nodes;
+
+	// packets that are on the air
+	struct Transmission {
+		Node *node;
+		Buffer *buffer;
+		int64_t start;
+		int64_t end;
+		bool collided;
+	};
+	std::vector<Transmission> transmissions;
+
+	// sequence number of the last started transfer
+	uint32_t sequence = 0;
+
+	// packets that have finished and transfers to complete, reused in handle()
+	struct Transfer {
+		Buffer *buffer;
+		uint32_t sequence;
+	};
+	std::vector<Transmission> finished;
+	std::vector<Transfer> completed;
+
+	// time until which the medium is busy and time when the first packet started after reset of statistics
+	int64_t busyUntil = 0;
+	int64_t startTime = -1;
+
+	Statistics stats;
+};
+
+} // namespace coco
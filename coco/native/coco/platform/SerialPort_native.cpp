@@ -0,0 +1,374 @@
+#include "SerialPort_native.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/serial.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+namespace coco {
+
+namespace {
+
+// mapping between signal bitmap and TIOCM_* flags
+struct SignalFlag {
+	SerialPort_native::Signals signal;
+	int flag;
+};
+constexpr SignalFlag signalFlags[] = {
+	{SerialPort_native::Signals::DTR, TIOCM_DTR},
+	{SerialPort_native::Signals::RTS, TIOCM_RTS},
+	{SerialPort_native::Signals::CTS, TIOCM_CTS},
+	{SerialPort_native::Signals::DSR, TIOCM_DSR},
+	{SerialPort_native::Signals::DCD, TIOCM_CD},
+	{SerialPort_native::Signals::RI, TIOCM_RNG},
+};
+
+int toFlags(SerialPort_native::Signals signals) {
+	int flags = 0;
+	for (auto &f : signalFlags) {
+		if ((signals & f.signal) != 0)
+			flags |= f.flag;
+	}
+	return flags;
+}
+
+} // namespace
+
+
+SerialPort_native::SerialPort_native(Loop_native &loop)
+	: BufferDevice(State::DISABLED), loop(loop)
+	, callback(makeCallback<SerialPort_native, &SerialPort_native::transfer>(this))
+	, signals(Signals::NONE)
+{
+}
+
+SerialPort_native::~SerialPort_native() {
+	close();
+}
+
+bool SerialPort_native::open(const char *path, int baudRate) {
+	if (this->st.state != State::DISABLED)
+		return false;
+
+	int fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+
+	// configure raw mode and baud rate (glibc accepts the baud rate as number)
+	termios tty;
+	if (tcgetattr(fd, &tty) == -1) {
+		::close(fd);
+		return false;
+	}
+	cfmakeraw(&tty);
+	tty.c_cflag |= CLOCAL | CREAD;
+	if (cfsetspeed(&tty, speed_t(baudRate)) == -1 || tcsetattr(fd, TCSANOW, &tty) == -1) {
+		::close(fd);
+		return false;
+	}
+
+	// the helper thread wakes up the event loop using an eventfd that is handled by the same completion handler
+	int eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (eventFd == -1) {
+		::close(fd);
+		return false;
+	}
+
+	// add to epoll, edge triggered so that we only get notified when new data arrives or the port becomes writable
+	epoll_event event;
+	event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+	event.data.ptr = static_cast<Loop_native::CompletionHandler *>(this);
+	if (epoll_ctl(this->loop.epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+		::close(eventFd);
+		::close(fd);
+		return false;
+	}
+	if (epoll_ctl(this->loop.epollFd, EPOLL_CTL_ADD, eventFd, &event) == -1) {
+		epoll_ctl(this->loop.epollFd, EPOLL_CTL_DEL, fd, nullptr);
+		::close(eventFd);
+		::close(fd);
+		return false;
+	}
+	this->fd = fd;
+	this->eventFd = eventFd;
+	this->writeOffset = 0;
+
+	// read current counters and signals, the helper thread reports changes relative to them
+	readCounts(fd, this->counts);
+	this->signals.store(readSignals(fd));
+
+	// start monitoring the signals if the port has modem control lines (not the case for a pseudo terminal), the
+	// helper thread gets stopped using an eventfd
+	int flags;
+	if (ioctl(fd, TIOCMGET, &flags) == 0) {
+		this->stopFd = eventfd(0, EFD_CLOEXEC);
+		if (this->stopFd != -1)
+			this->thread = std::thread(&SerialPort_native::monitor, this);
+	}
+
+	// set state of buffers and device to ready
+	for (auto &buffer : this->buffers) {
+		buffer.setReady(0);
+	}
+	this->st.set(State::READY, Events::ENTER_READY);
+
+	return true;
+}
+
+void SerialPort_native::setSignals(Signals set, Signals clear) {
+	if (this->fd == -1)
+		return;
+	int setFlags = toFlags(set & (Signals::DTR | Signals::RTS));
+	int clearFlags = toFlags(clear & (Signals::DTR | Signals::RTS));
+	if (setFlags != 0)
+		ioctl(this->fd, TIOCMBIS, &setFlags);
+	if (clearFlags != 0)
+		ioctl(this->fd, TIOCMBIC, &clearFlags);
+	this->signals.store(readSignals(this->fd));
+}
+
+void SerialPort_native::close() {
+	if (this->fd == -1)
+		return;
+
+	// stop the helper thread
+	if (this->thread.joinable()) {
+		uint64_t value = 1;
+		write(this->stopFd, &value, sizeof(value));
+		this->thread.join();
+	}
+	if (this->stopFd != -1) {
+		::close(this->stopFd);
+		this->stopFd = -1;
+	}
+
+	// remove from epoll and close
+	epoll_ctl(this->loop.epollFd, EPOLL_CTL_DEL, this->eventFd, nullptr);
+	::close(this->eventFd);
+	this->eventFd = -1;
+	epoll_ctl(this->loop.epollFd, EPOLL_CTL_DEL, this->fd, nullptr);
+	::close(this->fd);
+	this->fd = -1;
+
+	// all queued transfers get cancelled
+	while (this->writeTransfers.pop() != nullptr);
+	while (this->readTransfers.pop() != nullptr);
+
+	// set state of buffers to disabled
+	for (auto &buffer : this->buffers) {
+		buffer.setDisabled();
+	}
+
+	// set state of device to disabled
+	this->st.set(State::DISABLED, Events::ENTER_DISABLED);
+}
+
+int SerialPort_native::getBufferCount() {
+	return this->buffers.count();
+}
+
+SerialPort_native::Buffer &SerialPort_native::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+SerialPort_native::Signals SerialPort_native::readSignals(int fd) {
+	int flags = 0;
+	if (ioctl(fd, TIOCMGET, &flags) == -1)
+		return Signals::NONE;
+	auto signals = Signals::NONE;
+	for (auto &f : signalFlags) {
+		if ((flags & f.flag) != 0)
+			signals = signals | f.signal;
+	}
+	return signals;
+}
+
+bool SerialPort_native::readCounts(int fd, Counts &counts) {
+	serial_icounter_struct icount;
+	if (ioctl(fd, TIOCGICOUNT, &icount) == -1) {
+		counts = {};
+		return false;
+	}
+	counts = {icount.cts, icount.dsr, icount.rng, icount.dcd};
+	return true;
+}
+
+void SerialPort_native::monitor() {
+	// runs on the helper thread until close() signals the stop eventfd
+	auto counts = this->counts;
+	pollfd stop = {this->stopFd, POLLIN, 0};
+	while (true) {
+		// report changes that happened since the last check, e.g. between open() and the first wait
+		update(counts);
+
+		// wait for the next check or until close() wants to stop the thread
+		int result = poll(&stop, 1, SIGNAL_INTERVAL);
+		if (result > 0 || (result == -1 && errno != EINTR))
+			break;
+	}
+}
+
+void SerialPort_native::update(Counts &counts) {
+	// a change of the counters also detects pulses, e.g. of the ring indicator
+	Counts newCounts;
+	readCounts(this->fd, newCounts);
+	auto signals = readSignals(this->fd);
+	if (newCounts == counts && signals == this->signals.load())
+		return;
+	counts = newCounts;
+
+	// store new signals and notify the event loop
+	this->signals.store(signals);
+	uint64_t value = 1;
+	write(this->eventFd, &value, sizeof(value));
+}
+
+void SerialPort_native::handle(epoll_event &event) {
+	// check if the helper thread has detected a change of the signals
+	uint64_t value;
+	if (read(this->eventFd, &value, sizeof(value)) > 0)
+		this->st.doAll(Events::SIGNALS_CHANGED);
+
+	if ((event.events & (EPOLLERR | EPOLLHUP)) != 0 && this->readTransfers.empty()) {
+		// device is lost and there is no read that detects it
+		close();
+		return;
+	}
+	transfer();
+}
+
+void SerialPort_native::transfer() {
+	if (this->st.state != State::READY)
+		return;
+	if (!send())
+		return;
+	receive();
+}
+
+bool SerialPort_native::send() {
+	while (!this->writeTransfers.empty()) {
+		auto &buffer = *this->writeTransfers.frontOrNull();
+
+		// write as much as possible
+		ssize_t result = write(this->fd, buffer.data() + this->writeOffset, buffer.size() - this->writeOffset);
+		if (result == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				// wait for EPOLLOUT
+				return true;
+			}
+			if (errno == EINTR)
+				continue;
+
+			// device is lost
+			close();
+			return false;
+		}
+		this->writeOffset += result;
+		if (this->writeOffset < buffer.size())
+			return true;
+
+		// set buffer to ready state and notify application
+		this->writeOffset = 0;
+		this->writeTransfers.pop();
+		buffer.setReady();
+
+		// check if the device was closed by a resumed coroutine
+		if (this->fd == -1)
+			return false;
+	}
+	return true;
+}
+
+bool SerialPort_native::receive() {
+	while (!this->readTransfers.empty()) {
+		auto &buffer = *this->readTransfers.frontOrNull();
+
+		// read whatever is available
+		ssize_t result = read(this->fd, buffer.data(), buffer.capacity());
+		if (result == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				// wait for EPOLLIN
+				return true;
+			}
+			if (errno == EINTR)
+				continue;
+
+			// device is lost (e.g. USB serial adapter was removed or other side of pseudo terminal was closed)
+			close();
+			return false;
+		}
+		if (result == 0)
+			return true;
+
+		// set buffer to ready state and notify application
+		this->readTransfers.pop();
+		buffer.setReady(result);
+
+		// check if the device was closed by a resumed coroutine
+		if (this->fd == -1)
+			return false;
+	}
+	return true;
+}
+
+
+// Buffer
+
+SerialPort_native::Buffer::Buffer(SerialPort_native &device, int capacity)
+	: coco::Buffer(new uint8_t[capacity], capacity, device.st.state)
+	, device(device)
+{
+	device.buffers.add(*this);
+}
+
+SerialPort_native::Buffer::~Buffer() {
+	delete [] this->p.data;
+}
+
+bool SerialPort_native::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+
+	this->op = op;
+	auto &device = this->device;
+
+	// add buffer to list of transfers and let the event loop start the transfer when the first was added
+	bool first = (op & Op::WRITE) != 0 ? device.writeTransfers.push(*this) : device.readTransfers.push(*this);
+	if (first)
+		device.loop.invoke(device.callback);
+
+	// set state
+	setBusy();
+
+	return true;
+}
+
+bool SerialPort_native::Buffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	auto &device = this->device;
+	if ((this->op & Op::WRITE) != 0) {
+		// a partially written buffer can't be cancelled
+		if (device.writeTransfers.frontOrNull() == this && device.writeOffset > 0)
+			return true;
+		device.writeTransfers.remove(*this);
+	} else {
+		device.readTransfers.remove(*this);
+	}
+	setReady(0);
+
+	return true;
+}
+
+} // namespace coco
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "../BufferDevice.hpp"
+#include <coco/IntrusiveQueue.hpp>
+#include <coco/platform/Loop_native.hpp>
+#include <atomic>
+#include <thread>
+
+
+namespace coco {
+
+/**
+ * Serial port for the native platform (Linux), e.g. /dev/ttyUSB0 or a pseudo terminal. The port is configured to raw
+ * mode with the given baud rate.
+ * Reads complete with whatever data is available, up to capacity(). Writes complete when all data was written.
+ *
+ * The modem control lines (DCD, DSR, CTS, RI) are monitored by a helper thread, therefore the event loop needs no timer
+ * per port. The thread blocks in poll() on an eventfd that close() uses to stop it and checks the lines and the
+ * interrupt counters (TIOCGICOUNT) every SIGNAL_INTERVAL milliseconds. The counters also detect pulses that are shorter
+ * than the interval, e.g. of the ring indicator. TIOCMIWAIT is not used as only a signal can interrupt it. On change,
+ * the signal bitmap gets updated and coroutines waiting on Events::SIGNALS_CHANGED (e.g. using untilSignalsChanged())
+ * get resumed in the event loop. Pseudo terminals and some drivers have no modem control lines, then hasSignals()
+ * returns false and Events::SIGNALS_CHANGED does not occur.
+ *
+ * Usage example:
+ * SerialPort_native port(loop);
+ * SerialPort_native::Buffer buffer(port, 256);
+ * port.open("/dev/ttyUSB0", 115200);
+ * while ((port.getSignals() & SerialPort_native::Signals::DCD) == 0)
+ *     co_await port.untilSignalsChanged();
+ */
+class SerialPort_native : public BufferDevice, public Loop_native::CompletionHandler {
+public:
+	/**
+	 * Modem control lines
+	 */
+	enum class Signals {
+		NONE = 0,
+
+		// outputs
+		DTR = 1, // data terminal ready
+		RTS = 1 << 1, // request to send
+
+		// inputs
+		CTS = 1 << 2, // clear to send
+		DSR = 1 << 3, // data set ready
+		DCD = 1 << 4, // data carrier detect
+		RI = 1 << 5, // ring indicator
+	};
+
+	/**
+	 * Interval in milliseconds in which the helper thread checks the modem control lines
+	 */
+	static constexpr int SIGNAL_INTERVAL = 10;
+
+	/**
+	 * Constructor
+	 * @param loop event loop
+	 */
+	SerialPort_native(Loop_native &loop);
+	~SerialPort_native() override;
+
+	/**
+	 * Buffer for transferring data over the serial port
+	 */
+	class Buffer : public coco::Buffer, public IntrusiveListNode, public IntrusiveQueueNode {
+		friend class SerialPort_native;
+	public:
+		/**
+		 * Constructor
+		 * @param device device to attach to
+		 * @param capacity capacity of the buffer
+		 */
+		Buffer(SerialPort_native &device, int capacity);
+		~Buffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		SerialPort_native &device;
+		Op op;
+	};
+
+	/**
+	 * Open the serial port
+	 * @param path path of the device, e.g. /dev/ttyUSB0
+	 * @param baudRate baud rate, e.g. 115200
+	 * @return true if successful
+	 */
+	bool open(const char *path, int baudRate);
+
+	/**
+	 * Check if the port has modem control lines that get monitored. The device has to be open
+	 * @return true if Events::SIGNALS_CHANGED can occur, false e.g. for a pseudo terminal
+	 */
+	bool hasSignals() {return this->thread.joinable();}
+
+	/**
+	 * Get the current state of the modem control lines
+	 * @return signal bitmap
+	 */
+	Signals getSignals() {return this->signals.load(std::memory_order_relaxed);}
+
+	/**
+	 * Set or clear output signals (DTR, RTS)
+	 * @param set signals to set
+	 * @param clear signals to clear
+	 */
+	void setSignals(Signals set, Signals clear = Signals::NONE);
+
+	/**
+	 * Wait until the modem control lines change
+	 * @return use co_await on return value to wait for a change of the signals
+	 */
+	[[nodiscard]] Awaitable<Events> untilSignalsChanged() {return {this->st.tasks, Events::SIGNALS_CHANGED};}
+
+	// Device methods
+	void close() override;
+
+	// BufferDevice methods
+	int getBufferCount() override;
+	Buffer &getBuffer(int index) override;
+
+protected:
+	// counters of the input signal changes
+	struct Counts {
+		int cts;
+		int dsr;
+		int rng;
+		int dcd;
+
+		bool operator ==(const Counts &) const = default;
+	};
+
+	static Signals readSignals(int fd);
+	static bool readCounts(int fd, Counts &counts);
+	void monitor();
+	void update(Counts &counts);
+	void handle(epoll_event &event) override;
+	void transfer();
+	bool send();
+	bool receive();
+
+	Loop_native &loop;
+	int fd = -1;
+	TimedTask<Callback> callback;
+
+	// list of buffers
+	IntrusiveList<Buffer> buffers;
+
+	// queued write and read transfers
+	IntrusiveQueue<Buffer> writeTransfers;
+	IntrusiveQueue<Buffer> readTransfers;
+
+	// number of bytes of the first write transfer that were already written
+	int writeOffset = 0;
+
+	// signal monitoring: the helper thread notifies the event loop using an eventfd and gets stopped using another
+	std::thread thread;
+	std::atomic<Signals> signals;
+	Counts counts;
+	int eventFd = -1;
+	int stopFd = -1;
+};
+COCO_ENUM(SerialPort_native::Signals);
+
+} // namespace coco
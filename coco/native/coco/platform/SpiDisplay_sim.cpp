@@ -0,0 +1,102 @@
+#include "SpiDisplay_sim.hpp"
+
+
+namespace coco {
+
+namespace {
+
+// commands
+constexpr uint8_t CASET = 0x2a;
+constexpr uint8_t RASET = 0x2b;
+constexpr uint8_t RAMWR = 0x2c;
+constexpr uint8_t RAMWRC = 0x3c;
+
+} // namespace
+
+
+SpiDisplay_sim::SpiDisplay_sim(int width, int height, int bytesPerPixel)
+	: w(width), h(height), bpp(bytesPerPixel), memory(width * height * bytesPerPixel)
+	, x1(width - 1), y1(height - 1)
+{
+}
+
+SpiDisplay_sim::~SpiDisplay_sim() {
+}
+
+int SpiDisplay_sim::transfer(Buffer::Op op, const uint8_t *header, int headerSize, uint8_t *data, int size) {
+	if ((op & Buffer::Op::COMMAND) != 0) {
+		// command line is asserted for the whole transfer, the last byte is the current command
+		int count = headerSize + size;
+		for (int i = 0; i < count; ++i) {
+			uint8_t command = i < headerSize ? header[i] : data[i - headerSize];
+			++this->stats.commandCount;
+			this->command = command;
+			this->parameterIndex = 0;
+
+			// memory write starts at the beginning of the window
+			if (command == RAMWR) {
+				++this->stats.windowCount;
+				this->x = this->x0;
+				this->y = this->y0;
+				this->byteIndex = 0;
+			}
+		}
+	} else if ((op & Buffer::Op::WRITE) != 0) {
+		// parameters or pixel data
+		write(header, headerSize);
+		write(data, size);
+	}
+
+	// reading is not supported, the display does not drive the bus
+	if ((op & Buffer::Op::READ) != 0) {
+		for (int i = 0; i < size; ++i) {
+			data[i] = 0;
+		}
+	}
+
+	return (headerSize + size) * 8;
+}
+
+void SpiDisplay_sim::write(const uint8_t *data, int size) {
+	switch (this->command) {
+	case CASET:
+	case RASET:
+		// start and end address (inclusive) as big endian
+		for (int i = 0; i < size; ++i) {
+			int index = this->parameterIndex++;
+			int &value = index < 2 ? (this->command == CASET ? this->x0 : this->y0)
+				: (this->command == CASET ? this->x1 : this->y1);
+			if (index < 4)
+				value = (index & 1) == 0 ? data[i] << 8 : (value & 0xff00) | data[i];
+		}
+		break;
+	case RAMWR:
+	case RAMWRC:
+		// fill the window row by row
+		for (int i = 0; i < size; ++i) {
+			int x = this->x;
+			int y = this->y;
+			if (y > this->y1 || x >= this->w || y >= this->h) {
+				++this->stats.ignoredBytes;
+			} else {
+				this->memory[(y * this->w + x) * this->bpp + this->byteIndex] = data[i];
+			}
+
+			// advance to next byte
+			if (++this->byteIndex == this->bpp) {
+				this->byteIndex = 0;
+				++this->stats.pixelCount;
+				if (++this->x > this->x1) {
+					this->x = this->x0;
+					++this->y;
+				}
+			}
+		}
+		break;
+	default:
+		// parameters of other commands are ignored
+		this->parameterIndex += size;
+	}
+}
+
+} // namespace coco
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "SpiMaster_sim.hpp"
+#include <vector>
+
+
+namespace coco {
+
+/**
+ * Simulated display controller with MIPI DCS command set (e.g. ST7789, ILI9341), to be connected to a channel of
+ * SpiMaster_sim. A transfer with Op::COMMAND contains a command, the following transfers without Op::COMMAND contain
+ * its parameters or pixel data.
+ *
+ * Supported commands:
+ * 0x2a CASET column address set, 0x2b RASET row address set, 0x2c RAMWR memory write, 0x3c RAMWRC memory write
+ * continue. Other commands (e.g. 0x11 SLPOUT, 0x29 DISPON, 0x3a COLMOD) are accepted and their parameters ignored.
+ *
+ * Memory writes fill the window set by CASET and RASET row by row, data beyond the end of the window is ignored.
+ *
+ * Usage example:
+ * SpiMaster_sim master(loop, 40000000);
+ * SpiDisplay_sim display(240, 240, 2);
+ * SpiMaster_sim::Channel channel(master, display);
+ * SpiMaster_sim::Buffer buffer(channel, 4096);
+ * Framebuffer framebuffer(channel, 240, 240, 2);
+ */
+class SpiDisplay_sim : public SpiMaster_sim::Slave {
+public:
+	/**
+	 * Display statistics
+	 */
+	struct Statistics {
+		// number of commands
+		int commandCount = 0;
+
+		// number of memory write commands (RAMWR)
+		int windowCount = 0;
+
+		// number of written pixels
+		int64_t pixelCount = 0;
+
+		// number of bytes that were outside of the window or the display
+		int64_t ignoredBytes = 0;
+	};
+
+	/**
+	 * Constructor
+	 * @param width width in pixels
+	 * @param height height in pixels
+	 * @param bytesPerPixel number of bytes per pixel, e.g. 2 for RGB565
+	 */
+	SpiDisplay_sim(int width, int height, int bytesPerPixel = 2);
+	~SpiDisplay_sim() override;
+
+	/**
+	 * Memory contents of the display, e.g. for checking the result of a test
+	 */
+	uint8_t *data() {return this->memory.data();}
+	int width() const {return this->w;}
+	int height() const {return this->h;}
+
+	/**
+	 * Get the display statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the display statistics
+	 */
+	void resetStatistics() {this->stats = {};}
+
+	int transfer(Buffer::Op op, const uint8_t *header, int headerSize, uint8_t *data, int size) override;
+
+protected:
+	void write(const uint8_t *data, int size);
+
+	int w;
+	int h;
+	int bpp;
+	std::vector<uint8_t> memory;
+	Statistics stats;
+
+	// current command and number of parameter bytes received so far
+	uint8_t command = 0;
+	int parameterIndex = 0;
+
+	// window (inclusive)
+	int x0 = 0;
+	int x1 = 0;
+	int y0 = 0;
+	int y1 = 0;
+
+	// current write position, byte offset inside the current pixel
+	int x = 0;
+	int y = 0;
+	int byteIndex = 0;
+};
+
+} // namespace coco
@@ -0,0 +1,221 @@
+#include "SpiFlash_sim.hpp"
+#include <algorithm>
+
+
+namespace coco {
+
+namespace {
+
+// commands
+constexpr uint8_t READ = 0x03;
+constexpr uint8_t FAST_READ = 0x0b;
+constexpr uint8_t DUAL_READ = 0x3b;
+constexpr uint8_t QUAD_READ = 0x6b;
+constexpr uint8_t WRITE_ENABLE = 0x06;
+constexpr uint8_t WRITE_DISABLE = 0x04;
+constexpr uint8_t READ_STATUS = 0x05;
+constexpr uint8_t READ_ID = 0x9f;
+constexpr uint8_t PAGE_PROGRAM = 0x02;
+constexpr uint8_t SECTOR_ERASE = 0x20;
+constexpr uint8_t BLOCK_ERASE_32 = 0x52;
+constexpr uint8_t BLOCK_ERASE_64 = 0xd8;
+constexpr uint8_t CHIP_ERASE = 0x60;
+constexpr uint8_t CHIP_ERASE_2 = 0xc7;
+
+constexpr int PAGE_SIZE = 256;
+
+// typical timing of a 3.3V NOR flash in microseconds
+constexpr SpiFlash_sim::Timing defaultTiming = {
+	700, // page program
+	45000, // sector erase
+	120000, // block erase 32K
+	150000, // block erase 64K
+	5000000 // chip erase (for 1MB)
+};
+
+} // namespace
+
+
+SpiFlash_sim::SpiFlash_sim(int size)
+	: SpiFlash_sim(size, defaultTiming)
+{
+}
+
+SpiFlash_sim::SpiFlash_sim(int size, const Timing &timing)
+	: memory(size, 0xff), timing(timing)
+{
+}
+
+SpiFlash_sim::~SpiFlash_sim() {
+}
+
+bool SpiFlash_sim::busy() {
+	return SpiMaster_sim::now() < this->busyUntil;
+}
+
+int SpiFlash_sim::transfer(Buffer::Op op, const uint8_t *header, int headerSize, uint8_t *data, int size) {
+	bool read = (op & Buffer::Op::READ) != 0;
+	bool write = (op & Buffer::Op::WRITE) != 0;
+
+	// exchange the bytes on the bus, first the header, then the data
+	int cycles = 0;
+	int count = headerSize + size;
+	this->lanes = 1;
+	for (int i = 0; i < count; ++i) {
+		uint8_t out = i < headerSize ? header[i] : (write ? data[i - headerSize] : 0xff);
+		int lanes = this->lanes;
+		uint8_t in = exchange(i, out);
+		if (i >= headerSize && read)
+			data[i - headerSize] = in;
+		cycles += 8 / lanes;
+	}
+
+	// chip select gets deasserted
+	end(count);
+
+	return cycles;
+}
+
+uint8_t SpiFlash_sim::exchange(int index, uint8_t out) {
+	if (index == 0) {
+		// command
+		this->command = out;
+		this->address = 0;
+		this->addressSize = 0;
+		this->dummySize = 0;
+		switch (out) {
+		case FAST_READ:
+		case DUAL_READ:
+		case QUAD_READ:
+			this->dummySize = 1;
+			[[fallthrough]];
+		case READ:
+		case PAGE_PROGRAM:
+		case SECTOR_ERASE:
+		case BLOCK_ERASE_32:
+		case BLOCK_ERASE_64:
+			this->addressSize = 3;
+			break;
+		}
+
+		// only read status register is allowed while busy, program and erase need write enable
+		bool busy = this->busy();
+		bool needsWriteEnable = out == PAGE_PROGRAM || out == SECTOR_ERASE || out == BLOCK_ERASE_32
+			|| out == BLOCK_ERASE_64 || out == CHIP_ERASE || out == CHIP_ERASE_2;
+		this->ignored = (busy && out != READ_STATUS) || (needsWriteEnable && !this->writeEnabled);
+		if (this->ignored) {
+			++this->stats.ignoredCount;
+		} else if (out == READ_STATUS) {
+			++this->stats.statusCount;
+			if (busy)
+				++this->stats.busyStatusCount;
+		}
+		return 0xff;
+	}
+	if (this->ignored)
+		return 0xff;
+
+	// address
+	if (index <= this->addressSize) {
+		this->address = (this->address << 8) | out;
+		return 0xff;
+	}
+
+	// dummy bytes, the data phase of dual and quad reads uses multiple data lines
+	int dataIndex = index - 1 - this->addressSize - this->dummySize;
+	if (dataIndex < 0) {
+		if (this->command == DUAL_READ)
+			this->lanes = 2;
+		else if (this->command == QUAD_READ)
+			this->lanes = 4;
+		return 0xff;
+	}
+
+	// data
+	int size = int(this->memory.size());
+	switch (this->command) {
+	case READ:
+	case FAST_READ:
+	case DUAL_READ:
+	case QUAD_READ:
+		// address wraps around at the end of the memory
+		++this->stats.readBytes;
+		return this->memory[(this->address + dataIndex) & (size - 1)];
+	case READ_STATUS:
+		return (this->writeEnabled ? 2 : 0) | (busy() ? 1 : 0);
+	case READ_ID:
+		{
+			// manufacturer, memory type, capacity (log2 of size)
+			int capacity = 0;
+			while ((1 << capacity) < size)
+				++capacity;
+			uint8_t id[] = {0xef, 0x40, uint8_t(capacity)};
+			return dataIndex < 3 ? id[dataIndex] : 0xff;
+		}
+	case PAGE_PROGRAM:
+		{
+			// address wraps around within the page, bits can only be programmed from 1 to 0
+			int page = this->address & ~(PAGE_SIZE - 1) & (size - 1);
+			this->memory[page + ((this->address + dataIndex) & (PAGE_SIZE - 1))] &= out;
+			return 0xff;
+		}
+	}
+	return 0xff;
+}
+
+void SpiFlash_sim::end(int count) {
+	if (count == 0 || this->ignored)
+		return;
+
+	// program and erase operations start when chip select is deasserted
+	int size = int(this->memory.size());
+	int dataSize = count - 1 - this->addressSize - this->dummySize;
+	int64_t time = 0;
+	switch (this->command) {
+	case WRITE_ENABLE:
+		this->writeEnabled = true;
+		break;
+	case WRITE_DISABLE:
+		this->writeEnabled = false;
+		break;
+	case READ:
+	case FAST_READ:
+	case DUAL_READ:
+	case QUAD_READ:
+		++this->stats.readCount;
+		break;
+	case PAGE_PROGRAM:
+		if (dataSize > 0) {
+			++this->stats.programCount;
+			this->stats.programBytes += std::min(dataSize, PAGE_SIZE);
+			time = this->timing.pageProgram;
+		}
+		break;
+	case SECTOR_ERASE:
+	case BLOCK_ERASE_32:
+	case BLOCK_ERASE_64:
+		if (dataSize >= 0) {
+			int eraseSize = this->command == SECTOR_ERASE ? 4096 : (this->command == BLOCK_ERASE_32 ? 32768 : 65536);
+			int begin = this->address & ~(eraseSize - 1) & (size - 1);
+			std::fill(this->memory.begin() + begin, this->memory.begin() + std::min(begin + eraseSize, size), 0xff);
+			++this->stats.eraseCount;
+			time = this->command == SECTOR_ERASE ? this->timing.sectorErase
+				: (this->command == BLOCK_ERASE_32 ? this->timing.blockErase32 : this->timing.blockErase64);
+		}
+		break;
+	case CHIP_ERASE:
+	case CHIP_ERASE_2:
+		std::fill(this->memory.begin(), this->memory.end(), 0xff);
+		++this->stats.eraseCount;
+		time = this->timing.chipErase;
+		break;
+	}
+
+	// set write in progress and reset write enable latch
+	if (time > 0) {
+		this->busyUntil = SpiMaster_sim::now() + time * 1000;
+		this->writeEnabled = false;
+	}
+}
+
+} // namespace coco
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "SpiMaster_sim.hpp"
+#include <vector>
+
+
+namespace coco {
+
+/**
+ * Simulated SPI NOR flash with JEDEC command set, to be connected to a channel of SpiMaster_sim. The command,
+ * 24 bit address and dummy bytes are typically in the header of the buffer, e.g. {0x0b, a2, a1, a0, 0} for FAST_READ.
+ *
+ * Supported commands:
+ * 0x03 READ, 0x0b FAST_READ, 0x3b dual output read, 0x6b quad output read,
+ * 0x06 write enable, 0x04 write disable, 0x05 read status register, 0x9f read JEDEC ID,
+ * 0x02 page program, 0x20 sector erase (4K), 0x52 block erase (32K), 0xd8 block erase (64K), 0x60/0xc7 chip erase
+ *
+ * Program and erase commands set the write in progress (WIP) bit in the status register for the given time. While
+ * the flash is busy, all commands except read status register get ignored. The data phase of dual and quad reads
+ * takes 4 or 2 clock cycles per byte.
+ *
+ * Usage example:
+ * SpiMaster_sim master(loop, 50000000);
+ * SpiFlash_sim flash(1 << 20);
+ * SpiMaster_sim::Channel channel(master, flash);
+ * SpiMaster_sim::Buffer buffer(channel, 5 + 256);
+ * buffer.setHeader(std::array<uint8_t, 5>{0x0b, 0, 0x10, 0, 0});
+ * co_await buffer.read(256);
+ */
+class SpiFlash_sim : public SpiMaster_sim::Slave {
+public:
+	/**
+	 * Program and erase times in microseconds, defaults are typical values of a 3.3V NOR flash
+	 */
+	struct Timing {
+		int pageProgram;
+		int sectorErase;
+		int blockErase32;
+		int blockErase64;
+		int chipErase;
+	};
+
+	/**
+	 * Flash statistics
+	 */
+	struct Statistics {
+		// number of read commands and bytes
+		int readCount = 0;
+		int64_t readBytes = 0;
+
+		// number of page program commands and bytes
+		int programCount = 0;
+		int64_t programBytes = 0;
+
+		// number of erase commands
+		int eraseCount = 0;
+
+		// number of status register reads, the number of reads while busy indicates polling overhead
+		int statusCount = 0;
+		int busyStatusCount = 0;
+
+		// number of commands that were ignored because the flash was busy or not write enabled
+		int ignoredCount = 0;
+	};
+
+	/**
+	 * Constructor
+	 * @param size size of the flash in bytes (power of two)
+	 */
+	SpiFlash_sim(int size);
+
+	/**
+	 * Constructor
+	 * @param size size of the flash in bytes (power of two)
+	 * @param timing program and erase times
+	 */
+	SpiFlash_sim(int size, const Timing &timing);
+	~SpiFlash_sim() override;
+
+	/**
+	 * Memory contents of the flash, e.g. for checking the result of a test
+	 */
+	uint8_t *data() {return this->memory.data();}
+	int size() const {return int(this->memory.size());}
+
+	/**
+	 * Returns true if a program or erase operation is in progress
+	 */
+	bool busy();
+
+	/**
+	 * Get the flash statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the flash statistics
+	 */
+	void resetStatistics() {this->stats = {};}
+
+	int transfer(Buffer::Op op, const uint8_t *header, int headerSize, uint8_t *data, int size) override;
+
+protected:
+	uint8_t exchange(int index, uint8_t out);
+	void end(int count);
+
+	std::vector<uint8_t> memory;
+	Timing timing;
+	Statistics stats;
+
+	// status register (bit 1: write enable latch, bit 0 is computed from busyUntil)
+	bool writeEnabled = false;
+
+	// time when the current program or erase operation completes in nanoseconds
+	int64_t busyUntil = 0;
+
+	// current command
+	uint8_t command;
+	bool ignored;
+	int address;
+	int addressSize;
+	int dummySize;
+
+	// number of data lines in the data phase
+	int lanes;
+};
+
+} // namespace coco
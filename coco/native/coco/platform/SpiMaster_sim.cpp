@@ -0,0 +1,138 @@
+#include "SpiMaster_sim.hpp"
+#include <chrono>
+
+
+namespace coco {
+
+SpiMaster_sim::SpiMaster_sim(Loop_native &loop, int clockRate, int selectTime)
+	: loop(loop), clockRate(clockRate), selectTime(selectTime)
+	, callback(makeCallback<SpiMaster_sim, &SpiMaster_sim::handle>(this))
+{
+}
+
+SpiMaster_sim::~SpiMaster_sim() {
+}
+
+void SpiMaster_sim::resetStatistics() {
+	this->stats = {};
+	this->startTime = -1;
+}
+
+int64_t SpiMaster_sim::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SpiMaster_sim::execute(Buffer &buffer) {
+	auto op = buffer.op;
+	int headerSize = buffer.p.headerSize;
+	int size = buffer.p.size - headerSize;
+
+	// let the slave model execute the transfer
+	int cycles = buffer.channel.slave.transfer(op, buffer.p.data, headerSize, buffer.p.data + headerSize, size);
+
+	// timing model: the transfer starts when the bus becomes idle
+	int64_t now = SpiMaster_sim::now();
+	int64_t start = std::max(now, this->busyUntil);
+	int64_t duration = this->selectTime + int64_t(cycles) * 1000000000 / this->clockRate;
+	this->busyUntil = start + duration;
+
+	// update statistics
+	auto &stats = this->stats;
+	if (this->startTime < 0)
+		this->startTime = start;
+	++stats.transferCount;
+	if ((op & Buffer::Op::COMMAND) != 0)
+		++stats.commandCount;
+	stats.headerBytes += headerSize;
+	stats.dataBytes += size;
+	stats.busyTime += duration;
+	stats.elapsedTime = this->busyUntil - this->startTime;
+
+	// let the event loop call handle() when the transfer has finished
+	this->loop.invoke(this->callback, Milliseconds<>(int((this->busyUntil - now) / 1000000)));
+}
+
+void SpiMaster_sim::handle() {
+	auto buffer = this->transfers.pop();
+	if (buffer != nullptr) {
+		// start next transfer before notifying the application to keep the bus busy
+		auto next = this->transfers.frontOrNull();
+		if (next != nullptr)
+			execute(*next);
+
+		// set buffer to ready state and notify application
+		buffer->setReady();
+	}
+}
+
+
+// Channel
+
+SpiMaster_sim::Channel::Channel(SpiMaster_sim &master, Slave &slave)
+	: BufferDevice(State::READY), master(master), slave(slave)
+{
+}
+
+SpiMaster_sim::Channel::~Channel() {
+}
+
+int SpiMaster_sim::Channel::getBufferCount() {
+	return this->buffers.count();
+}
+
+SpiMaster_sim::Buffer &SpiMaster_sim::Channel::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+
+// Buffer
+
+SpiMaster_sim::Buffer::Buffer(Channel &channel, int capacity)
+	: coco::Buffer(new uint8_t[capacity], capacity, channel.st.state)
+	, channel(channel)
+{
+	channel.buffers.add(*this);
+}
+
+SpiMaster_sim::Buffer::~Buffer() {
+	delete [] this->p.data;
+}
+
+bool SpiMaster_sim::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if READ or WRITE flag is set
+	assert((op & Op::READ_WRITE) != 0);
+
+	this->op = op;
+	auto &master = this->channel.master;
+
+	// add buffer to list of transfers and execute it immediately if the bus is idle
+	if (master.transfers.push(*this))
+		master.execute(*this);
+
+	// set state
+	setBusy();
+
+	return true;
+}
+
+bool SpiMaster_sim::Buffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	// the transfer that is on the bus can't be cancelled
+	auto &master = this->channel.master;
+	if (master.transfers.frontOrNull() != this) {
+		master.transfers.remove(*this);
+		setReady(0);
+	}
+	return true;
+}
+
+} // namespace coco
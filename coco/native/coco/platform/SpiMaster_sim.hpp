@@ -0,0 +1,173 @@
+#pragma once
+
+#include "../BufferDevice.hpp"
+#include <coco/IntrusiveQueue.hpp>
+#include <coco/platform/Loop_native.hpp>
+
+
+namespace coco {
+
+/**
+ * Simulated SPI master for the native platform. Each channel (chip select) is a BufferDevice that is connected to a
+ * slave model. The header of a buffer gets written before the data, e.g. command and address of a flash memory.
+ * Op::COMMAND sets the command/data line to command for the whole transfer and Op::READ_WRITE exchanges the data in
+ * the buffer in full duplex.
+ *
+ * The timing model assumes that a transfer occupies the bus for the chip select time and the clock cycles of the
+ * transfer at the given clock rate. Transfers get executed in the order they were started and complete in real time
+ * (with the granularity of the event loop timer) when the bus would have finished the transfer. Statistics such as
+ * bus utilization can be used to benchmark drivers.
+ *
+ * Usage example:
+ * SpiMaster_sim master(loop, 8000000);
+ * MySlave slave;
+ * SpiMaster_sim::Channel channel(master, slave);
+ * SpiMaster_sim::Buffer buffer(channel, 128);
+ * co_await buffer.writeArray(data, Buffer::Op::COMMAND);
+ */
+class SpiMaster_sim {
+public:
+	/**
+	 * Interface for slave models
+	 */
+	class Slave {
+	public:
+		virtual ~Slave() {}
+
+		/**
+		 * Execute a transfer while chip select is asserted. The master first writes the header and then writes
+		 * and/or reads the data
+		 * @param op operation, READ, WRITE or READ_WRITE (full duplex), optionally with COMMAND flag
+		 * @param header header that gets written before the data
+		 * @param headerSize size of header
+		 * @param data data to write (WRITE), to read into (READ) or to exchange in place (READ_WRITE)
+		 * @param size size of data
+		 * @return number of clock cycles of the transfer, typically (headerSize + size) * 8
+		 */
+		virtual int transfer(coco::Buffer::Op op, const uint8_t *header, int headerSize, uint8_t *data, int size) = 0;
+	};
+
+	/**
+	 * Bus statistics
+	 */
+	struct Statistics {
+		// number of transfers
+		int transferCount = 0;
+
+		// number of transfers with Op::COMMAND
+		int commandCount = 0;
+
+		// number of header bytes (e.g. command and address of a flash memory)
+		int64_t headerBytes = 0;
+
+		// number of data bytes
+		int64_t dataBytes = 0;
+
+		// time the bus was busy including chip select time in nanoseconds
+		int64_t busyTime = 0;
+
+		// time from start of first transfer to end of last transfer in nanoseconds
+		int64_t elapsedTime = 0;
+
+		/**
+		 * Bus utilization, i.e. fraction of time the bus was busy
+		 */
+		float utilization() const {return this->elapsedTime > 0 ? float(this->busyTime) / float(this->elapsedTime) : 0.0f;}
+	};
+
+	/**
+	 * Constructor
+	 * @param loop event loop
+	 * @param clockRate SPI clock rate in Hz
+	 * @param selectTime time in nanoseconds for asserting and deasserting chip select per transfer
+	 */
+	SpiMaster_sim(Loop_native &loop, int clockRate, int selectTime = 0);
+	~SpiMaster_sim();
+
+	class Channel;
+
+	/**
+	 * Buffer for transferring data to/from a slave
+	 */
+	class Buffer : public coco::Buffer, public IntrusiveListNode, public IntrusiveQueueNode {
+		friend class SpiMaster_sim;
+	public:
+		/**
+		 * Constructor
+		 * @param channel channel to attach to
+		 * @param capacity capacity of the buffer including header
+		 */
+		Buffer(Channel &channel, int capacity);
+		~Buffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		Channel &channel;
+		Op op;
+	};
+
+	/**
+	 * Channel to a slave, has its own chip select
+	 */
+	class Channel : public BufferDevice {
+		friend class SpiMaster_sim;
+	public:
+		/**
+		 * Constructor
+		 * @param master the SPI master the channel belongs to
+		 * @param slave model of the slave connected to the chip select of this channel
+		 */
+		Channel(SpiMaster_sim &master, Slave &slave);
+		~Channel() override;
+
+		// BufferDevice methods
+		int getBufferCount() override;
+		Buffer &getBuffer(int index) override;
+
+	protected:
+		SpiMaster_sim &master;
+		Slave &slave;
+
+		// list of buffers
+		IntrusiveList<Buffer> buffers;
+	};
+
+	/**
+	 * Get the bus statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the bus statistics, e.g. after initialization of the slaves
+	 */
+	void resetStatistics();
+
+	/**
+	 * Get the current time of the timing model in nanoseconds
+	 */
+	static int64_t now();
+
+protected:
+	void execute(Buffer &buffer);
+	void handle();
+
+	Loop_native &loop;
+	int clockRate;
+	int selectTime;
+	TimedTask<Callback> callback;
+
+	// time when the bus becomes idle in nanoseconds
+	int64_t busyUntil = 0;
+
+	// time when the first transfer started after reset of statistics in nanoseconds
+	int64_t startTime = -1;
+
+	Statistics stats;
+
+	// list of active transfers, the first is currently on the bus
+	IntrusiveQueue<Buffer> transfers;
+};
+
+} // namespace coco
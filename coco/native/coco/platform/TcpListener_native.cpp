@@ -0,0 +1,148 @@
+#include "TcpListener_native.hpp"
+#include "TcpSocket_native.hpp"
+#include <cerrno>
+#include <unistd.h>
+
+
+namespace coco {
+
+TcpListener_native::TcpListener_native(Loop_native &loop, int family)
+	: Device(State::DISABLED), loop(loop), family(family)
+	, callback(makeCallback<TcpListener_native, &TcpListener_native::retry>(this))
+{
+}
+
+TcpListener_native::~TcpListener_native() {
+	if (this->socket != -1)
+		::close(this->socket);
+}
+
+bool TcpListener_native::open(int localPort, uint32_t localAddress) {
+	if (this->st.state != State::DISABLED)
+		return false;
+
+	// create non-blocking socket
+	int s = ::socket(this->family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (s == -1)
+		return false;
+	int value = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
+
+	// bind to local port
+	int result;
+	if (this->family == AF_INET6) {
+		sockaddr_in6 address = {};
+		address.sin6_family = AF_INET6;
+		address.sin6_port = htons(localPort);
+		address.sin6_addr = in6addr_any;
+		result = bind(s, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+	} else {
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(localPort);
+		address.sin_addr.s_addr = localAddress;
+		result = bind(s, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+	}
+	if (result == -1 || listen(s, SOMAXCONN) == -1) {
+		::close(s);
+		return false;
+	}
+
+	// add to epoll, edge triggered so that we only get notified when new connections arrive
+	epoll_event event;
+	event.events = EPOLLIN | EPOLLET;
+	event.data.ptr = static_cast<Loop_native::CompletionHandler *>(this);
+	if (epoll_ctl(this->loop.epollFd, EPOLL_CTL_ADD, s, &event) == -1) {
+		::close(s);
+		return false;
+	}
+	this->socket = s;
+
+	// set state of device to ready
+	this->st.set(State::READY, Events::ENTER_READY);
+
+	return true;
+}
+
+int TcpListener_native::getLocalPort() {
+	if (this->socket == -1)
+		return 0;
+	sockaddr_in6 address;
+	socklen_t size = sizeof(address);
+	if (getsockname(this->socket, reinterpret_cast<sockaddr *>(&address), &size) == -1)
+		return 0;
+
+	// port is at the same offset in sockaddr_in and sockaddr_in6
+	return ntohs(address.sin6_port);
+}
+
+void TcpListener_native::close() {
+	if (this->socket == -1)
+		return;
+
+	// remove from epoll and close socket
+	epoll_ctl(this->loop.epollFd, EPOLL_CTL_DEL, this->socket, nullptr);
+	::close(this->socket);
+	this->socket = -1;
+
+	// sockets that wait for a connection get disabled
+	while (auto socket = this->sockets.frontOrNull()) {
+		socket->disconnect();
+	}
+
+	// set state of device to disabled
+	this->st.set(State::DISABLED, Events::ENTER_DISABLED);
+}
+
+void TcpListener_native::handle(epoll_event &event) {
+	accept();
+}
+
+void TcpListener_native::retry() {
+	this->retryActive = false;
+	if (this->socket != -1)
+		accept();
+}
+
+void TcpListener_native::accept() {
+	while (auto socket = this->sockets.frontOrNull()) {
+		int s = accept4(this->socket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (s == -1) {
+			switch (errno) {
+			case EINTR:
+			case ECONNABORTED:
+			case EPROTO:
+			case ENETDOWN:
+			case ENOPROTOOPT:
+			case EHOSTDOWN:
+			case ENONET:
+			case EHOSTUNREACH:
+			case EOPNOTSUPP:
+			case ENETUNREACH:
+				// the error only affects the pending connection
+				continue;
+			case EMFILE:
+			case ENFILE:
+			case ENOBUFS:
+			case ENOMEM:
+				// the connection stays pending and no new EPOLLIN arrives (edge triggered), therefore retry later
+				if (!this->retryActive) {
+					this->retryActive = true;
+					this->loop.invoke(this->callback, Milliseconds<>(RETRY_DELAY));
+				}
+				return;
+			default:
+				// EAGAIN: wait for EPOLLIN
+				return;
+			}
+		}
+
+		// hand the connection over to the socket
+		this->sockets.pop();
+		socket->listener = nullptr;
+		socket->open(s);
+		socket->connected();
+	}
+}
+
+} // namespace coco
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../Device.hpp"
+#include <coco/IntrusiveQueue.hpp>
+#include <coco/platform/Loop_native.hpp>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+
+namespace coco {
+
+class TcpSocket_native;
+
+/**
+ * Listener for incoming TCP connections for the native platform (Linux). Use TcpSocket_native::accept() to accept
+ * the next incoming connection.
+ *
+ * Usage example:
+ * TcpListener_native listener(loop);
+ * TcpSocket_native socket(loop);
+ * listener.open(8080);
+ * socket.accept(listener);
+ * co_await socket.untilReadyOrDisabled();
+ */
+class TcpListener_native : public Device, public Loop_native::CompletionHandler {
+	friend class TcpSocket_native;
+public:
+	/**
+	 * Delay in milliseconds after which accepting gets retried when the process or system ran out of file descriptors or memory
+	 */
+	static constexpr int RETRY_DELAY = 100;
+
+	/**
+	 * Constructor
+	 * @param loop event loop
+	 * @param family address family, AF_INET or AF_INET6
+	 */
+	TcpListener_native(Loop_native &loop, int family = AF_INET);
+	~TcpListener_native() override;
+
+	/**
+	 * Open the listener on a local port
+	 * @param localPort local port, 0 to let the operating system choose a port
+	 * @param localAddress local address in network byte order for AF_INET, e.g. htonl(INADDR_LOOPBACK), ignored for AF_INET6
+	 * @return true if successful
+	 */
+	bool open(int localPort, uint32_t localAddress = 0);
+
+	/**
+	 * Get the local port, e.g. after opening the listener with port 0
+	 * @return local port or 0 if the listener is not open
+	 */
+	int getLocalPort();
+
+	// Device methods
+	void close() override;
+
+protected:
+	void handle(epoll_event &event) override;
+	void accept();
+	void retry();
+
+	Loop_native &loop;
+	int family;
+	int socket = -1;
+	TimedTask<Callback> callback;
+	bool retryActive = false;
+
+	// sockets waiting for an incoming connection
+	IntrusiveQueue<TcpSocket_native> sockets;
+};
+
+} // namespace coco
@@ -0,0 +1,346 @@
+#include "TcpSocket_native.hpp"
+#include "TcpListener_native.hpp"
+#include <cerrno>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+
+namespace coco {
+
+TcpSocket_native::TcpSocket_native(Loop_native &loop)
+	: BufferDevice(State::DISABLED), loop(loop)
+	, callback(makeCallback<TcpSocket_native, &TcpSocket_native::transfer>(this))
+{
+}
+
+TcpSocket_native::~TcpSocket_native() {
+	if (this->listener != nullptr)
+		this->listener->sockets.remove(*this);
+	if (this->socket != -1)
+		::close(this->socket);
+}
+
+bool TcpSocket_native::connect(const sockaddr *address, int addressSize) {
+	if (this->st.state != State::DISABLED)
+		return false;
+
+	// create non-blocking socket
+	int s = ::socket(address->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (s == -1)
+		return false;
+
+	// start to connect
+	if (::connect(s, address, addressSize) == -1 && errno != EINPROGRESS) {
+		::close(s);
+		return false;
+	}
+
+	// set state of buffers to ready so that transfers can be started while the connection is established
+	for (auto &buffer : this->buffers) {
+		buffer.setReady(0);
+	}
+
+	// set state of device to opening, gets set to ready in handle() when the connection is established
+	this->st.set(State::OPENING, Events::ENTER_OPENING);
+
+	open(s);
+	return true;
+}
+
+bool TcpSocket_native::accept(TcpListener_native &listener) {
+	if (this->st.state != State::DISABLED || listener.socket == -1)
+		return false;
+
+	// set state of buffers to ready so that transfers can be started while waiting for a connection
+	for (auto &buffer : this->buffers) {
+		buffer.setReady(0);
+	}
+
+	// set state of device to opening, gets set to ready when the listener accepts a connection
+	this->st.set(State::OPENING, Events::ENTER_OPENING);
+
+	// wait for a connection, accept a pending connection immediately
+	this->listener = &listener;
+	listener.sockets.push(*this);
+	listener.accept();
+	return true;
+}
+
+void TcpSocket_native::open(int socket) {
+	this->socket = socket;
+	this->writeOffset = 0;
+	this->writeBlocked = false;
+
+	// disable Nagle's algorithm, partial writes are held back using MSG_MORE
+	int value = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+
+	// add to epoll, edge triggered so that we only get notified when new data arrives or the socket becomes writable
+	epoll_event event;
+	event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	event.data.ptr = static_cast<Loop_native::CompletionHandler *>(this);
+	epoll_ctl(this->loop.epollFd, EPOLL_CTL_ADD, socket, &event);
+}
+
+void TcpSocket_native::connected() {
+	// set state of device to ready
+	this->st.set(State::READY, Events::ENTER_READY);
+
+	// start transfers that were queued while opening
+	if (this->st.state == State::READY)
+		this->loop.invoke(this->callback);
+}
+
+void TcpSocket_native::disconnect() {
+	// stop waiting for an incoming connection
+	if (this->listener != nullptr) {
+		this->listener->sockets.remove(*this);
+		this->listener = nullptr;
+	}
+
+	// remove from epoll and close socket
+	if (this->socket != -1) {
+		epoll_ctl(this->loop.epollFd, EPOLL_CTL_DEL, this->socket, nullptr);
+		::close(this->socket);
+		this->socket = -1;
+	}
+
+	// all queued transfers get cancelled
+	while (this->writeTransfers.pop() != nullptr);
+	while (this->readTransfers.pop() != nullptr);
+
+	// set state of buffers to disabled
+	for (auto &buffer : this->buffers) {
+		buffer.setDisabled();
+	}
+
+	// set state of device to disabled
+	this->st.set(State::DISABLED, Events::ENTER_DISABLED);
+}
+
+void TcpSocket_native::close() {
+	if (this->st.state != State::DISABLED)
+		disconnect();
+}
+
+int TcpSocket_native::getBufferCount() {
+	return this->buffers.count();
+}
+
+TcpSocket_native::Buffer &TcpSocket_native::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+void TcpSocket_native::handle(epoll_event &event) {
+	if (this->st.state == State::OPENING) {
+		// check if connect() succeeded
+		int error = 0;
+		socklen_t size = sizeof(error);
+		getsockopt(this->socket, SOL_SOCKET, SO_ERROR, &error, &size);
+		if (error != 0 || (event.events & (EPOLLERR | EPOLLHUP)) != 0) {
+			disconnect();
+			return;
+		}
+		if ((event.events & EPOLLOUT) == 0)
+			return;
+		connected();
+
+		// check below if the peer already closed the connection, unless a resumed coroutine closed the device
+		if (this->st.state != State::READY)
+			return;
+	}
+
+	if ((event.events & EPOLLOUT) != 0)
+		this->writeBlocked = false;
+	if ((event.events & (EPOLLERR | EPOLLHUP)) != 0 && this->readTransfers.empty()) {
+		// connection is lost and there is no read that detects it
+		disconnect();
+		return;
+	}
+	if ((event.events & EPOLLRDHUP) != 0 && this->readTransfers.empty()) {
+		// peer closed the connection and there is no read that detects it. Disconnect unless received data is still
+		// waiting, then the read that receives the last data detects the end of the stream
+		uint8_t data;
+		if (recv(this->socket, &data, 1, MSG_PEEK | MSG_DONTWAIT) == 0) {
+			disconnect();
+			return;
+		}
+	}
+	transfer();
+}
+
+void TcpSocket_native::transfer() {
+	if (this->st.state != State::READY)
+		return;
+	if (!this->writeBlocked && !send())
+		return;
+	receive();
+}
+
+bool TcpSocket_native::send() {
+	while (!this->writeTransfers.empty()) {
+		// gather write buffers, the first may already be sent partially
+		int count = 0;
+		int offset = this->writeOffset;
+		ssize_t size = 0;
+		int flags = MSG_NOSIGNAL;
+		for (auto &buffer : this->writeTransfers) {
+			auto &iov = this->iovecs[count];
+			iov.iov_base = buffer.data() + offset;
+			iov.iov_len = buffer.size() - offset;
+			size += iov.iov_len;
+			offset = 0;
+
+			// cork if the last buffer is partial, i.e. more data follows
+			flags = (buffer.op & Buffer::Op::PARTIAL) != 0 ? MSG_NOSIGNAL | MSG_MORE : MSG_NOSIGNAL;
+			if (++count == MAX_BATCH) {
+				flags = MSG_NOSIGNAL | MSG_MORE;
+				break;
+			}
+		}
+
+		msghdr message = {};
+		message.msg_iov = this->iovecs;
+		message.msg_iovlen = count;
+		ssize_t result = sendmsg(this->socket, &message, flags | MSG_DONTWAIT);
+		if (result == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				// wait for EPOLLOUT
+				this->writeBlocked = true;
+				return true;
+			}
+			if (errno == EINTR)
+				continue;
+
+			// connection is lost
+			disconnect();
+			return false;
+		}
+
+		// socket buffer is full if not everything was sent, wait for EPOLLOUT
+		this->writeBlocked = result < size;
+
+		// remove completely sent buffers from the queue before notifying the application
+		int completed = 0;
+		while (result > 0) {
+			auto buffer = this->writeTransfers.frontOrNull();
+			int remaining = buffer->size() - this->writeOffset;
+			if (result < remaining) {
+				this->writeOffset += result;
+				break;
+			}
+			result -= remaining;
+			this->writeOffset = 0;
+			this->writeTransfers.pop();
+			this->batch[completed++] = buffer;
+		}
+
+		// set sent buffers to ready state and notify application
+		for (int i = 0; i < completed; ++i) {
+			auto buffer = this->batch[i];
+			if (buffer->busy())
+				buffer->setReady();
+
+			// check if the device was closed by a resumed coroutine
+			if (this->socket == -1)
+				return false;
+		}
+		if (this->writeBlocked)
+			return true;
+	}
+	return true;
+}
+
+bool TcpSocket_native::receive() {
+	while (!this->readTransfers.empty()) {
+		auto &buffer = *this->readTransfers.frontOrNull();
+
+		// receive whatever is available
+		ssize_t result = recv(this->socket, buffer.data(), buffer.capacity(), MSG_DONTWAIT);
+		if (result == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				// wait for EPOLLIN
+				return true;
+			}
+			if (errno == EINTR)
+				continue;
+
+			// connection is lost
+			disconnect();
+			return false;
+		}
+		if (result == 0) {
+			// connection was closed by the peer
+			disconnect();
+			return false;
+		}
+
+		// set buffer to ready state and notify application
+		this->readTransfers.pop();
+		buffer.setReady(result);
+
+		// check if the device was closed by a resumed coroutine
+		if (this->socket == -1)
+			return false;
+	}
+	return true;
+}
+
+
+// Buffer
+
+TcpSocket_native::Buffer::Buffer(TcpSocket_native &device, int capacity)
+	: coco::Buffer(new uint8_t[capacity], capacity, device.st.state)
+	, device(device)
+{
+	device.buffers.add(*this);
+}
+
+TcpSocket_native::Buffer::~Buffer() {
+	delete [] this->p.data;
+}
+
+bool TcpSocket_native::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+
+	this->op = op;
+	auto &device = this->device;
+
+	// add buffer to list of transfers and let the event loop start the transfer when the first was added and the
+	// device is ready
+	bool first = (op & Op::WRITE) != 0 ? device.writeTransfers.push(*this) : device.readTransfers.push(*this);
+	if (first && device.st.state == Device::State::READY)
+		device.loop.invoke(device.callback);
+
+	// set state
+	setBusy();
+
+	return true;
+}
+
+bool TcpSocket_native::Buffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	auto &device = this->device;
+	if ((this->op & Op::WRITE) != 0) {
+		// a partially sent write can't be cancelled without corrupting the stream
+		if (device.writeTransfers.frontOrNull() == this && device.writeOffset > 0)
+			return true;
+		device.writeTransfers.remove(*this);
+	} else {
+		device.readTransfers.remove(*this);
+	}
+	setReady(0);
+
+	return true;
+}
+
+} // namespace coco
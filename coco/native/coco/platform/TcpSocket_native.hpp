@@ -0,0 +1,139 @@
+#pragma once
+
+#include "../BufferDevice.hpp"
+#include <coco/IntrusiveQueue.hpp>
+#include <coco/platform/Loop_native.hpp>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+
+namespace coco {
+
+class TcpListener_native;
+
+/**
+ * TCP socket for the native platform (Linux). The connection state drives the device state: connect() or accept()
+ * change the state to OPENING and the device becomes READY when the connection is established. When the connection
+ * fails or gets closed by the peer, the device and its buffers become DISABLED. Data that was received before the peer
+ * closed the connection can still be read, the device becomes DISABLED when a read reaches the end of the stream.
+ *
+ * Writes with Op::PARTIAL are sent with MSG_MORE, i.e. the kernel holds back (corks) the data until a write without
+ * Op::PARTIAL flushes it. Since Nagle's algorithm is disabled, a write without Op::PARTIAL gets sent immediately.
+ * Multiple queued writes are gathered into one sendmsg() call.
+ * Reads complete with whatever data is available, up to capacity().
+ *
+ * Usage example:
+ * TcpSocket_native socket(loop);
+ * TcpSocket_native::Buffer buffer(socket, 1024);
+ * socket.connect(address);
+ * co_await socket.untilReadyOrDisabled();
+ * co_await buffer.writeString("GET / HTTP/1.0\r\n", Buffer::Op::PARTIAL);
+ * co_await buffer.writeString("\r\n");
+ */
+class TcpSocket_native : public BufferDevice, public Loop_native::CompletionHandler, public IntrusiveQueueNode {
+	friend class TcpListener_native;
+public:
+	/**
+	 * Maximum number of write buffers that get gathered into one system call
+	 */
+	static constexpr int MAX_BATCH = 64;
+
+	/**
+	 * Constructor
+	 * @param loop event loop
+	 */
+	TcpSocket_native(Loop_native &loop);
+	~TcpSocket_native() override;
+
+	/**
+	 * Buffer for transferring data over the connection
+	 */
+	class Buffer : public coco::Buffer, public IntrusiveListNode, public IntrusiveQueueNode {
+		friend class TcpSocket_native;
+	public:
+		/**
+		 * Constructor
+		 * @param device device to attach to
+		 * @param capacity capacity of the buffer
+		 */
+		Buffer(TcpSocket_native &device, int capacity);
+		~Buffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		TcpSocket_native &device;
+		Op op;
+	};
+
+	/**
+	 * Connect to a server. The device changes to OPENING state and becomes READY when the connection is established
+	 * or DISABLED when the connection fails
+	 * @param address address of the server, e.g. sockaddr_in
+	 * @param addressSize size of the address
+	 * @return true if connecting was started
+	 */
+	bool connect(const sockaddr *address, int addressSize);
+
+	/**
+	 * Connect to a server
+	 * @tparam T address type, sockaddr_in or sockaddr_in6
+	 * @param address address of the server
+	 * @return true if connecting was started
+	 */
+	template <typename T>
+	bool connect(const T &address) {
+		return connect(reinterpret_cast<const sockaddr *>(&address), sizeof(T));
+	}
+
+	/**
+	 * Accept the next incoming connection of a listener. The device changes to OPENING state and becomes READY when
+	 * a connection was accepted
+	 * @param listener listener that accepts incoming connections
+	 * @return true if accepting was started
+	 */
+	bool accept(TcpListener_native &listener);
+
+	// Device methods
+	void close() override;
+
+	// BufferDevice methods
+	int getBufferCount() override;
+	Buffer &getBuffer(int index) override;
+
+protected:
+	void open(int socket);
+	void connected();
+	void disconnect();
+	void handle(epoll_event &event) override;
+	void transfer();
+	bool send();
+	bool receive();
+
+	Loop_native &loop;
+	int socket = -1;
+	TimedTask<Callback> callback;
+
+	// listener when waiting for an incoming connection
+	TcpListener_native *listener = nullptr;
+
+	// list of buffers
+	IntrusiveList<Buffer> buffers;
+
+	// queued write and read transfers
+	IntrusiveQueue<Buffer> writeTransfers;
+	IntrusiveQueue<Buffer> readTransfers;
+
+	// number of bytes of the first write transfer that were already sent
+	int writeOffset = 0;
+
+	// true when the socket returned EAGAIN and we wait for EPOLLOUT
+	bool writeBlocked = false;
+
+	// buffers and io vectors for sendmsg()
+	Buffer *batch[MAX_BATCH];
+	iovec iovecs[MAX_BATCH];
+};
+
+} // namespace coco
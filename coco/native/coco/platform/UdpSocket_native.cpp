@@ -0,0 +1,325 @@
+#include "UdpSocket_native.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/udp.h>
+#include <unistd.h>
+
+// segmentation offload, available since Linux 4.18 (UDP_SEGMENT) and 5.0 (UDP_GRO)
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+
+namespace coco {
+
+UdpSocket_native::UdpSocket_native(Loop_native &loop, int family)
+	: BufferDevice(State::DISABLED), loop(loop), family(family)
+	, callback(makeCallback<UdpSocket_native, &UdpSocket_native::transfer>(this))
+{
+}
+
+UdpSocket_native::~UdpSocket_native() {
+	if (this->socket != -1)
+		::close(this->socket);
+}
+
+bool UdpSocket_native::open(int localPort, uint32_t localAddress) {
+	if (this->st.state != State::DISABLED)
+		return false;
+
+	// create non-blocking socket
+	int s = ::socket(this->family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (s == -1)
+		return false;
+
+	// bind to local port
+	int result;
+	if (this->family == AF_INET6) {
+		sockaddr_in6 address = {};
+		address.sin6_family = AF_INET6;
+		address.sin6_port = htons(localPort);
+		address.sin6_addr = in6addr_any;
+		result = bind(s, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+	} else {
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(localPort);
+		address.sin_addr.s_addr = localAddress;
+		result = bind(s, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+	}
+	if (result == -1) {
+		::close(s);
+		return false;
+	}
+
+	// add to epoll, edge triggered so that we only get notified when new datagrams arrive or the socket
+	// becomes writable again
+	epoll_event event;
+	event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+	event.data.ptr = static_cast<Loop_native::CompletionHandler *>(this);
+	if (epoll_ctl(this->loop.epollFd, EPOLL_CTL_ADD, s, &event) == -1) {
+		::close(s);
+		return false;
+	}
+	this->socket = s;
+	this->writeBlocked = false;
+
+	// set state of buffers to ready
+	for (auto &buffer : this->buffers) {
+		buffer.setReady(0);
+	}
+
+	// set state of device to ready
+	this->st.set(State::READY, Events::ENTER_READY);
+
+	return true;
+}
+
+int UdpSocket_native::getLocalPort() {
+	if (this->socket == -1)
+		return 0;
+	sockaddr_in6 address;
+	socklen_t size = sizeof(address);
+	if (getsockname(this->socket, reinterpret_cast<sockaddr *>(&address), &size) == -1)
+		return 0;
+
+	// port is at the same offset in sockaddr_in and sockaddr_in6
+	return ntohs(address.sin6_port);
+}
+
+bool UdpSocket_native::setReceiveOffload(bool enable) {
+	if (this->socket == -1)
+		return false;
+	int value = enable ? 1 : 0;
+	return setsockopt(this->socket, SOL_UDP, UDP_GRO, &value, sizeof(value)) == 0;
+}
+
+void UdpSocket_native::close() {
+	if (this->socket == -1)
+		return;
+
+	// remove from epoll and close socket
+	epoll_ctl(this->loop.epollFd, EPOLL_CTL_DEL, this->socket, nullptr);
+	::close(this->socket);
+	this->socket = -1;
+
+	// all queued transfers get cancelled
+	while (this->writeTransfers.pop() != nullptr);
+	while (this->readTransfers.pop() != nullptr);
+
+	// set state of buffers to disabled
+	for (auto &buffer : this->buffers) {
+		buffer.setDisabled();
+	}
+
+	// set state of device to disabled
+	this->st.set(State::DISABLED, Events::ENTER_DISABLED);
+}
+
+int UdpSocket_native::getBufferCount() {
+	return this->buffers.count();
+}
+
+UdpSocket_native::Buffer &UdpSocket_native::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+void UdpSocket_native::handle(epoll_event &event) {
+	if ((event.events & EPOLLOUT) != 0)
+		this->writeBlocked = false;
+	transfer();
+}
+
+void UdpSocket_native::transfer() {
+	if (!this->writeBlocked)
+		send();
+	receive();
+}
+
+void UdpSocket_native::send() {
+	while (!this->writeTransfers.empty()) {
+		// collect a batch of write buffers
+		int count = 0;
+		for (auto &buffer : this->writeTransfers) {
+			this->batch[count] = {&buffer, buffer.sequence};
+			auto &message = this->messages[count];
+			auto &iov = this->iovecs[count];
+			iov.iov_base = buffer.data();
+			iov.iov_len = buffer.size();
+			message.msg_hdr = {};
+			message.msg_hdr.msg_name = buffer.p.data;
+			message.msg_hdr.msg_namelen = buffer.p.headerSize;
+			message.msg_hdr.msg_iov = &iov;
+			message.msg_hdr.msg_iovlen = 1;
+
+			// let the kernel split the data into datagrams of segment size
+			if (buffer.segment > 0 && buffer.size() > buffer.segment) {
+				auto &control = this->controls[count];
+				message.msg_hdr.msg_control = control.data;
+				message.msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+				auto cmsg = &control.header;
+				cmsg->cmsg_level = SOL_UDP;
+				cmsg->cmsg_type = UDP_SEGMENT;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+				*reinterpret_cast<uint16_t *>(CMSG_DATA(cmsg)) = buffer.segment;
+			}
+			if (++count == MAX_BATCH)
+				break;
+		}
+
+		// send all datagrams of the batch
+		int result = sendmmsg(this->socket, this->messages, count, 0);
+		if (result == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				// wait for EPOLLOUT
+				this->writeBlocked = true;
+				return;
+			}
+			if (errno == EINTR)
+				continue;
+
+			// the first datagram failed (e.g. ECONNREFUSED), complete it with zero size and go on with the others
+			auto buffer = this->writeTransfers.pop();
+			buffer->setReady(0);
+			continue;
+		}
+
+		// set sent buffers to ready state and notify application
+		for (int i = 0; i < result; ++i) {
+			// skip transfer if a resumed coroutine cancelled (and maybe restarted) it or closed the device
+			auto &transfer = this->batch[i];
+			auto buffer = transfer.buffer;
+			if (!buffer->busy() || buffer->sequence != transfer.sequence)
+				continue;
+			this->writeTransfers.remove(*buffer);
+			buffer->setReady(this->messages[i].msg_len);
+		}
+	}
+}
+
+void UdpSocket_native::receive() {
+	while (!this->readTransfers.empty()) {
+		// collect a batch of read buffers
+		int count = 0;
+		for (auto &buffer : this->readTransfers) {
+			this->batch[count] = {&buffer, buffer.sequence};
+			auto &message = this->messages[count];
+			auto &iov = this->iovecs[count];
+			iov.iov_base = buffer.data();
+			iov.iov_len = buffer.capacity();
+			message.msg_hdr = {};
+			message.msg_hdr.msg_name = buffer.p.data;
+			message.msg_hdr.msg_namelen = buffer.p.headerSize;
+			message.msg_hdr.msg_iov = &iov;
+			message.msg_hdr.msg_iovlen = 1;
+			message.msg_hdr.msg_control = this->controls[count].data;
+			message.msg_hdr.msg_controllen = sizeof(Control);
+			if (++count == MAX_BATCH)
+				break;
+		}
+
+		// receive as many datagrams as are available
+		int result = recvmmsg(this->socket, this->messages, count, MSG_DONTWAIT, nullptr);
+		if (result == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				// wait for EPOLLIN
+				return;
+			}
+			if (errno == EINTR)
+				continue;
+
+			// a pending error (e.g. ECONNREFUSED) was consumed by the call, complete the first read with zero size and
+			// go on with the others as more datagrams may be queued which the edge triggered EPOLLIN won't report again
+			auto buffer = this->readTransfers.pop();
+			buffer->setReady(0);
+			continue;
+		}
+
+		// set received buffers to ready state and notify application
+		for (int i = 0; i < result; ++i) {
+			// skip transfer if a resumed coroutine cancelled (and maybe restarted) it or closed the device
+			auto &transfer = this->batch[i];
+			auto buffer = transfer.buffer;
+			if (!buffer->busy() || buffer->sequence != transfer.sequence)
+				continue;
+			this->readTransfers.remove(*buffer);
+
+			// get segment size if the datagrams were coalesced
+			auto &header = this->messages[i].msg_hdr;
+			buffer->segment = 0;
+			for (auto cmsg = CMSG_FIRSTHDR(&header); cmsg != nullptr; cmsg = CMSG_NXTHDR(&header, cmsg)) {
+				if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+					buffer->segment = *reinterpret_cast<int *>(CMSG_DATA(cmsg));
+			}
+
+			buffer->setReady(this->messages[i].msg_len);
+		}
+
+		// no more datagrams available
+		if (result < count)
+			return;
+	}
+}
+
+
+// Buffer
+
+UdpSocket_native::Buffer::Buffer(UdpSocket_native &device, int capacity)
+	: coco::Buffer(new uint8_t[sizeof(sockaddr_in6) + capacity], device.addressSize(), capacity, device.st.state)
+	, device(device)
+{
+	// initialize the header with an address of the socket's family
+	auto address = reinterpret_cast<sockaddr_in6 *>(this->p.data);
+	*address = {};
+	address->sin6_family = device.family;
+	device.buffers.add(*this);
+}
+
+UdpSocket_native::Buffer::~Buffer() {
+	delete [] this->p.data;
+}
+
+bool UdpSocket_native::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+
+	this->op = op;
+	auto &device = this->device;
+	this->sequence = ++device.sequence;
+
+	// add buffer to list of transfers and let the event loop submit the batch when the first was added
+	bool first = (op & Op::WRITE) != 0 ? device.writeTransfers.push(*this) : device.readTransfers.push(*this);
+	if (first)
+		device.loop.invoke(device.callback);
+
+	// set state
+	setBusy();
+
+	return true;
+}
+
+bool UdpSocket_native::Buffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	// transfers are submitted synchronously, therefore a busy buffer is always still queued
+	auto &device = this->device;
+	if ((this->op & Op::WRITE) != 0)
+		device.writeTransfers.remove(*this);
+	else
+		device.readTransfers.remove(*this);
+	setReady(0);
+
+	return true;
+}
+
+} // namespace coco
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "../BufferDevice.hpp"
+#include <coco/IntrusiveQueue.hpp>
+#include <coco/platform/Loop_native.hpp>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+
+namespace coco {
+
+/**
+ * UDP socket for the native platform (Linux). The header of each buffer holds the peer address as sockaddr_in or
+ * sockaddr_in6 depending on the address family of the socket. For writes the header is the destination address, after
+ * a read it contains the address of the sender.
+ *
+ * All buffers that get started within one iteration of the event loop are submitted in a batch using one sendmmsg()
+ * call for writes and one recvmmsg() call for reads. A transfer that fails (e.g. with ECONNREFUSED) completes with size 0.
+ *
+ * For large transfers, segmentation offload can be used. A write buffer with a segment size gets split into datagrams
+ * of segment size by the kernel (UDP_SEGMENT). When receive offload is enabled using setReceiveOffload(), consecutive
+ * datagrams of equal size from the same sender may be received coalesced into one buffer (UDP_GRO) and the segment
+ * size of the buffer indicates the size of the individual datagrams.
+ *
+ * Usage example:
+ * UdpSocket_native socket(loop);
+ * UdpSocket_native::Buffer buffer(socket, 1500);
+ * socket.open(1337);
+ * buffer.header<sockaddr_in>() = destination;
+ * co_await buffer.writeString("foo");
+ */
+class UdpSocket_native : public BufferDevice, public Loop_native::CompletionHandler {
+public:
+	/**
+	 * Maximum number of buffers that get submitted in one system call
+	 */
+	static constexpr int MAX_BATCH = 64;
+
+	/**
+	 * Constructor
+	 * @param loop event loop
+	 * @param family address family, AF_INET or AF_INET6
+	 */
+	UdpSocket_native(Loop_native &loop, int family = AF_INET);
+	~UdpSocket_native() override;
+
+	/**
+	 * Buffer for transferring datagrams. The header is sized to hold the socket address of the device's family
+	 */
+	class Buffer : public coco::Buffer, public IntrusiveListNode, public IntrusiveQueueNode {
+		friend class UdpSocket_native;
+	public:
+		/**
+		 * Constructor
+		 * @param device device to attach to
+		 * @param capacity capacity of the buffer, i.e. maximum datagram size
+		 */
+		Buffer(UdpSocket_native &device, int capacity);
+		~Buffer() override;
+
+		/**
+		 * Set the segment size for writes. If the data is larger than the segment size, it gets sent as multiple
+		 * datagrams of segment size where the last one may be shorter. At most 64 segments are supported.
+		 * @param segmentSize segment size, 0 to send the data as one datagram
+		 */
+		void setSegmentSize(int segmentSize) {this->segment = segmentSize;}
+
+		/**
+		 * Get the segment size. After a read this is the size of the coalesced datagrams or 0 if the buffer contains
+		 * a single datagram
+		 * @return segment size
+		 */
+		int segmentSize() const {return this->segment;}
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		UdpSocket_native &device;
+		Op op;
+		int segment = 0;
+
+		// sequence number of the current transfer
+		uint32_t sequence = 0;
+	};
+
+	/**
+	 * Open the socket and bind it to a local port
+	 * @param localPort local port, 0 to let the operating system choose a port
+	 * @param localAddress local address in network byte order for AF_INET, e.g. htonl(INADDR_LOOPBACK), ignored for AF_INET6
+	 * @return true if successful
+	 */
+	bool open(int localPort, uint32_t localAddress = 0);
+
+	/**
+	 * Get the local port, e.g. after opening the socket with port 0
+	 * @return local port or 0 if the socket is not open
+	 */
+	int getLocalPort();
+
+	/**
+	 * Enable or disable receive offload (UDP_GRO) which delivers consecutive datagrams of equal size in one buffer.
+	 * The device has to be open
+	 * @param enable true to enable
+	 * @return true if successful
+	 */
+	bool setReceiveOffload(bool enable);
+
+	// Device methods
+	void close() override;
+
+	// BufferDevice methods
+	int getBufferCount() override;
+	Buffer &getBuffer(int index) override;
+
+protected:
+	int addressSize() {return this->family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);}
+	void handle(epoll_event &event) override;
+	void transfer();
+	void send();
+	void receive();
+
+	Loop_native &loop;
+	int family;
+	int socket = -1;
+	TimedTask<Callback> callback;
+
+	// list of buffers
+	IntrusiveList<Buffer> buffers;
+
+	// queued write and read transfers that get submitted in the next batch
+	IntrusiveQueue<Buffer> writeTransfers;
+	IntrusiveQueue<Buffer> readTransfers;
+
+	// true when the socket returned EAGAIN and we wait for EPOLLOUT
+	bool writeBlocked = false;
+
+	// sequence number of the last started transfer
+	uint32_t sequence = 0;
+
+	// transfers and message headers for sendmmsg()/recvmmsg()
+	struct Transfer {
+		Buffer *buffer;
+		uint32_t sequence;
+	};
+	Transfer batch[MAX_BATCH];
+	mmsghdr messages[MAX_BATCH];
+	iovec iovecs[MAX_BATCH];
+
+	// control messages for the segment size
+	union Control {
+		cmsghdr header;
+		uint8_t data[CMSG_SPACE(sizeof(int))];
+	};
+	Control controls[MAX_BATCH];
+};
+
+} // namespace coco
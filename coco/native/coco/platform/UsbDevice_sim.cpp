@@ -0,0 +1,603 @@
+#include "UsbDevice_sim.hpp"
+#include "UsbHost_sim.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+
+namespace coco {
+
+namespace {
+
+// bus parameters, the overhead per packet (token, handshake, sync, CRC, inter-packet delay) in bytes is chosen so
+// that at most 19 packets of 64 bytes (full speed) or 13 packets of 512 bytes (high speed) fit into a frame
+struct Bus {
+	int framesPerMillisecond;
+	int frameTime; // in microseconds
+	int frameBudget; // in bytes
+	int packetOverhead; // in bytes
+};
+constexpr Bus fullSpeed = {1, 1000, 1500, 13};
+constexpr Bus highSpeed = {8, 125, 7500, 55};
+
+// standard request SET_ADDRESS
+constexpr int SET_ADDRESS = 0x05;
+
+} // namespace
+
+
+UsbDevice_sim::UsbDevice_sim(Loop_native &loop, Speed speed)
+	: BufferDevice(State::DISABLED), loop(loop), speed(speed)
+	, callback(makeCallback<UsbDevice_sim, &UsbDevice_sim::handle>(this))
+{
+}
+
+UsbDevice_sim::~UsbDevice_sim() {
+}
+
+void UsbDevice_sim::connect() {
+	if (this->st.state == State::READY)
+		return;
+
+	this->address = 0;
+	this->stage = Stage::SETUP;
+
+	// set state of device, control buffers and endpoints of both sides to ready
+	this->st.set(State::READY, Events::ENTER_READY);
+	for (auto &buffer : this->controlBuffers) {
+		buffer.setReady(0);
+	}
+	for (auto endpoint : this->endpoints) {
+		if (endpoint != nullptr)
+			setState(*endpoint, State::READY);
+	}
+	auto host = this->host;
+	if (host != nullptr) {
+		host->st.set(State::READY, Events::ENTER_READY);
+		for (auto &buffer : host->controlBuffers) {
+			buffer.setReady(0);
+		}
+		for (auto endpoint : host->endpoints) {
+			if (endpoint != nullptr)
+				setState(*endpoint, State::READY);
+		}
+	}
+}
+
+void UsbDevice_sim::disconnect() {
+	if (this->st.state == State::DISABLED)
+		return;
+
+	// remove all control transfers before the buffers get notified
+	while (this->controlTransfers.pop() != nullptr);
+	auto host = this->host;
+	if (host != nullptr) {
+		while (host->controlTransfers.pop() != nullptr);
+	}
+	this->stage = Stage::SETUP;
+
+	// set state of control buffers and endpoints of both sides to disabled, this cancels all transfers
+	for (auto &buffer : this->controlBuffers) {
+		buffer.setDisabled();
+	}
+	for (auto endpoint : this->endpoints) {
+		if (endpoint != nullptr)
+			setState(*endpoint, State::DISABLED);
+	}
+	if (host != nullptr) {
+		for (auto &buffer : host->controlBuffers) {
+			buffer.setDisabled();
+		}
+		for (auto endpoint : host->endpoints) {
+			if (endpoint != nullptr)
+				setState(*endpoint, State::DISABLED);
+		}
+		host->st.set(State::DISABLED, Events::ENTER_DISABLED);
+	}
+	this->st.set(State::DISABLED, Events::ENTER_DISABLED);
+}
+
+void UsbDevice_sim::acknowledge() {
+	if (this->stage != Stage::REQUEST)
+		return;
+
+	// requests from device to host get a zero length reply, data of requests from host to device gets discarded
+	auto &setup = this->setup;
+	bool in = (setup.requestType & 0x80) != 0;
+	this->controlSize = in ? 0 : setup.length;
+	this->controlOffset = 0;
+	this->controlZeroLengthPacket = in;
+	this->stage = in || setup.length > 0 ? Stage::DATA : Stage::STATUS;
+	schedule();
+}
+
+void UsbDevice_sim::stall() {
+	if (this->stage != Stage::REQUEST)
+		return;
+	this->stage = Stage::STALL;
+	schedule();
+}
+
+int64_t UsbDevice_sim::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int UsbDevice_sim::getBufferCount() {
+	return this->controlBuffers.count();
+}
+
+UsbDevice_sim::ControlBuffer &UsbDevice_sim::getBuffer(int index) {
+	return this->controlBuffers.get(index);
+}
+
+void UsbDevice_sim::close() {
+	disconnect();
+}
+
+void UsbDevice_sim::setState(Endpoint &endpoint, State state) {
+	if (endpoint.st.state == state)
+		return;
+
+	// remove all transfers before the buffers get notified
+	while (endpoint.writeTransfers.pop() != nullptr);
+	while (endpoint.readTransfers.pop() != nullptr);
+
+	endpoint.st.set(state, state == State::READY ? Events::ENTER_READY : Events::ENTER_DISABLED);
+	for (auto &buffer : endpoint.buffers) {
+		if (state == State::READY)
+			buffer.setReady(0);
+		else
+			buffer.setDisabled();
+	}
+}
+
+bool UsbDevice_sim::pending() {
+	if (this->st.state != State::READY || this->host == nullptr)
+		return false;
+
+	// the bus is active when the host wants to send or receive data, the device can only answer
+	if (!this->host->controlTransfers.empty())
+		return true;
+	for (int number = 1; number <= MAX_ENDPOINT_COUNT; ++number) {
+		auto endpoint = this->endpoints[number];
+		auto hostEndpoint = this->host->endpoints[number];
+		if (endpoint == nullptr || hostEndpoint == nullptr)
+			continue;
+		if (!hostEndpoint->writeTransfers.empty() || !hostEndpoint->readTransfers.empty())
+			return true;
+	}
+	return false;
+}
+
+void UsbDevice_sim::schedule() {
+	// let the event loop call handle() on the next frame
+	if (!this->running && pending()) {
+		this->running = true;
+		this->loop.invoke(this->callback, Milliseconds<>(1));
+	}
+}
+
+void UsbDevice_sim::handle() {
+	this->running = false;
+	auto &bus = this->speed == Speed::HIGH ? highSpeed : fullSpeed;
+	auto &stats = this->stats;
+
+	for (int frame = 0; frame < bus.framesPerMillisecond && pending(); ++frame) {
+		++stats.frameCount;
+		stats.elapsedTime += bus.frameTime;
+		int budget = bus.frameBudget;
+
+		// a not ready endpoint answers the host only once per frame with NAK (actually the host retries until the end
+		// of the frame)
+		bool naked[MAX_ENDPOINT_COUNT + 1][2] = {};
+
+		// control transfers come first
+		bool full = !control(budget);
+
+		// transfer one packet per endpoint and direction in round robin order until no more progress is possible or
+		// the bandwidth budget of the frame is exhausted
+		bool progress = true;
+		while (progress && !full) {
+			progress = false;
+			for (int number = 1; number <= MAX_ENDPOINT_COUNT && !full; ++number) {
+				for (int direction = 0; direction < 2 && !full; ++direction) {
+					// a notified application may have disconnected the device or destroyed the host
+					if (this->st.state != State::READY || this->host == nullptr)
+						return;
+					auto endpoint = this->endpoints[number];
+					auto hostEndpoint = this->host->endpoints[number];
+					if (endpoint == nullptr || hostEndpoint == nullptr)
+						break;
+
+					// IN: device writes and host reads, OUT: host writes and device reads
+					bool in = direction == 0;
+					auto &writeTransfers = in ? endpoint->writeTransfers : hostEndpoint->writeTransfers;
+					auto &readTransfers = in ? hostEndpoint->readTransfers : endpoint->readTransfers;
+					bool hostActive = !(in ? readTransfers : writeTransfers).empty();
+					if (!writeTransfers.empty() && !readTransfers.empty()) {
+						if (transfer(writeTransfers, readTransfers, endpoint->maxPacketSize, budget))
+							progress = true;
+						else
+							full = true;
+					} else if (hostActive && !naked[number][direction]) {
+						// host polls or sends, but the device is not ready
+						if (budget < bus.packetOverhead) {
+							full = true;
+						} else {
+							budget -= bus.packetOverhead;
+							naked[number][direction] = true;
+							++stats.nakCount;
+						}
+					}
+				}
+			}
+		}
+		if (full)
+			++stats.fullFrameCount;
+	}
+
+	schedule();
+}
+
+bool UsbDevice_sim::transfer(IntrusiveQueue<Buffer> &writeTransfers, IntrusiveQueue<Buffer> &readTransfers,
+	int maxPacketSize, int &budget)
+{
+	auto &bus = this->speed == Speed::HIGH ? highSpeed : fullSpeed;
+	auto &stats = this->stats;
+	auto &writer = *writeTransfers.frontOrNull();
+	auto &reader = *readTransfers.frontOrNull();
+
+	int remaining = writer.transferSize - writer.offset;
+	if (remaining == 0 && !writer.zeroLengthPacket) {
+		// partial write that is smaller than a packet: nothing to transfer
+		writeTransfers.pop();
+		writer.setReady(0);
+		return true;
+	}
+
+	// check if the packet fits into the current frame
+	int size = std::min(remaining, maxPacketSize);
+	if (budget < bus.packetOverhead + size)
+		return false;
+	budget -= bus.packetOverhead + size;
+
+	// copy packet, gets truncated when it does not fit into the read buffer
+	int count = std::min(size, int(reader.p.capacity) - reader.offset);
+	std::memcpy(reader.p.data + reader.offset, writer.p.data + writer.offset, count);
+	writer.offset += size;
+	reader.offset += count;
+	if (size == 0)
+		writer.zeroLengthPacket = false;
+
+	// update statistics
+	++stats.packetCount;
+	if (size == 0)
+		++stats.zeroLengthPacketCount;
+	else if (size < maxPacketSize)
+		++stats.shortPacketCount;
+	stats.byteCount += size;
+
+	// a write is complete when all packets including the optional ZLP were sent, a read is complete on a short packet
+	// or when the buffer is full
+	bool writeDone = writer.offset == writer.transferSize && !writer.zeroLengthPacket;
+	bool readDone = size < maxPacketSize || reader.offset == int(reader.p.capacity);
+
+	// remove completed transfers before notifying the application which may cancel or start transfers
+	if (writeDone)
+		writeTransfers.pop();
+	if (readDone)
+		readTransfers.pop();
+
+	// set buffers to ready state and notify application. Notifying the writer may cancel or restart the reader,
+	// therefore only complete the reader if it is still busy with the same transfer
+	uint32_t writerSequence = writer.sequence;
+	uint32_t readerSequence = reader.sequence;
+	if (writeDone && writer.st.state == Buffer::State::BUSY && writer.sequence == writerSequence)
+		writer.setReady(writer.offset);
+	if (readDone && reader.st.state == Buffer::State::BUSY && reader.sequence == readerSequence)
+		reader.setReady(reader.offset);
+
+	return true;
+}
+
+
+bool UsbDevice_sim::control(int &budget) {
+	auto &bus = this->speed == Speed::HIGH ? highSpeed : fullSpeed;
+	auto &stats = this->stats;
+
+	while (true) {
+		// a notified application may have disconnected the device or destroyed the host
+		if (this->st.state != State::READY || this->host == nullptr)
+			return true;
+		auto hostBuffer = this->host->controlTransfers.frontOrNull();
+		if (hostBuffer == nullptr)
+			return true;
+		auto &setup = this->setup;
+		bool in = (setup.requestType & 0x80) != 0;
+
+		switch (this->stage) {
+		case Stage::SETUP:
+			// setup stage: the setup packet is always acknowledged by the device
+			if (budget < bus.packetOverhead + int(sizeof(Setup)))
+				return false;
+			budget -= bus.packetOverhead + int(sizeof(Setup));
+			++stats.packetCount;
+			setup = hostBuffer->header<Setup>();
+			this->controlOffset = 0;
+			if (setup.requestType == 0 && setup.request == SET_ADDRESS) {
+				// handled by the device
+				this->address = setup.value & 0x7f;
+				this->stage = Stage::STATUS;
+			} else {
+				// notify application
+				this->stage = Stage::REQUEST;
+				this->st.doAll(Events::REQUEST);
+			}
+			break;
+		case Stage::REQUEST:
+			// host polls the data or status stage, the device answers with NAK until the application handles the request
+			if (budget < bus.packetOverhead)
+				return false;
+			budget -= bus.packetOverhead;
+			++stats.nakCount;
+			return true;
+		case Stage::DATA:
+			{
+				// data stage: transfer one packet, no buffer on the device side means the data gets discarded
+				int remaining = this->controlSize - this->controlOffset;
+				int size = std::min(remaining, CONTROL_PACKET_SIZE);
+				if (budget < bus.packetOverhead + size)
+					return false;
+				budget -= bus.packetOverhead + size;
+				auto deviceBuffer = this->controlTransfers.frontOrNull();
+				if (deviceBuffer != nullptr) {
+					// copy directly from the buffer of the sender to the buffer of the receiver
+					uint8_t *hostData = hostBuffer->p.data + hostBuffer->p.headerSize + this->controlOffset;
+					uint8_t *deviceData = deviceBuffer->p.data + this->controlOffset;
+					if (in)
+						std::memcpy(hostData, deviceData, size);
+					else
+						std::memcpy(deviceData, hostData, size);
+				}
+				this->controlOffset += size;
+				if (size == 0)
+					this->controlZeroLengthPacket = false;
+				++stats.packetCount;
+				if (size == 0)
+					++stats.zeroLengthPacketCount;
+				else if (size < CONTROL_PACKET_SIZE)
+					++stats.shortPacketCount;
+				stats.byteCount += size;
+
+				if (this->controlOffset == this->controlSize && !this->controlZeroLengthPacket) {
+					this->stage = Stage::STATUS;
+
+					// set device buffer to ready state and notify application
+					if (deviceBuffer != nullptr) {
+						this->controlTransfers.pop();
+						deviceBuffer->setReady(this->controlSize);
+					}
+				}
+			}
+			break;
+		case Stage::STATUS:
+		case Stage::STALL:
+			{
+				// status stage: handshake of the device
+				if (budget < bus.packetOverhead)
+					return false;
+				budget -= bus.packetOverhead;
+				++stats.packetCount;
+
+				// complete the transfer before notifying the application which may start the next transfer
+				bool stall = this->stage == Stage::STALL;
+				this->host->controlTransfers.pop();
+				this->stage = Stage::SETUP;
+				int64_t latency = now() - hostBuffer->startTime;
+				if (stall) {
+					++stats.stallCount;
+				} else {
+					++stats.controlCount;
+					stats.controlLatency += latency;
+					stats.maxControlLatency = std::max(stats.maxControlLatency, latency);
+				}
+
+				// set host buffer to ready state and notify application
+				hostBuffer->stall = stall;
+				hostBuffer->setReady(stall ? 0 : this->controlOffset);
+			}
+			break;
+		}
+	}
+}
+
+void UsbDevice_sim::resetControl() {
+	// abort the current control transfer, e.g. when the host cancels it
+	this->stage = Stage::SETUP;
+	auto deviceBuffer = this->controlTransfers.pop();
+	if (deviceBuffer != nullptr)
+		deviceBuffer->setReady(0);
+}
+
+
+// Endpoint
+
+UsbDevice_sim::Endpoint::Endpoint(UsbDevice_sim &device, int number)
+	: BufferDevice(device.st.state), device(device), number(number)
+{
+	assert(number >= 1 && number <= MAX_ENDPOINT_COUNT);
+}
+
+UsbDevice_sim::Endpoint::~Endpoint() {
+}
+
+int UsbDevice_sim::Endpoint::getBufferCount() {
+	return this->buffers.count();
+}
+
+UsbDevice_sim::Buffer &UsbDevice_sim::Endpoint::getBuffer(int index) {
+	return this->buffers.get(index);
+}
+
+
+// BulkEndpoint
+
+UsbDevice_sim::BulkEndpoint::BulkEndpoint(UsbDevice_sim &device, int number, int maxPacketSize)
+	: Endpoint(device, number), maxPacketSize(maxPacketSize)
+{
+	assert(maxPacketSize > 0 && maxPacketSize <= (device.speed == Speed::HIGH ? 512 : 64));
+	device.endpoints[number] = this;
+}
+
+UsbDevice_sim::BulkEndpoint::~BulkEndpoint() {
+	this->device.endpoints[this->number] = nullptr;
+}
+
+
+// Buffer
+
+UsbDevice_sim::Buffer::Buffer(Endpoint &endpoint, int capacity)
+	: coco::Buffer(new uint8_t[capacity], capacity, endpoint.st.state)
+	, endpoint(endpoint)
+{
+	endpoint.buffers.add(*this);
+}
+
+UsbDevice_sim::Buffer::~Buffer() {
+	delete [] this->p.data;
+}
+
+bool UsbDevice_sim::Buffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+
+	this->op = op;
+	this->offset = 0;
+	auto &endpoint = this->endpoint;
+	auto &device = endpoint.device;
+	this->sequence = ++device.sequence;
+
+	if ((op & Op::WRITE) != 0) {
+		// the maximum packet size is defined by the device endpoint
+		auto deviceEndpoint = device.endpoints[endpoint.number];
+		if (deviceEndpoint == nullptr)
+			return false;
+		int maxPacketSize = deviceEndpoint->maxPacketSize;
+
+		// partial writes transfer only full packets, other writes end with a short packet or ZLP
+		int size = this->p.size;
+		if ((op & Op::PARTIAL) != 0) {
+			this->transferSize = size - size % maxPacketSize;
+			this->zeroLengthPacket = false;
+		} else {
+			this->transferSize = size;
+			this->zeroLengthPacket = size % maxPacketSize == 0;
+		}
+		endpoint.writeTransfers.push(*this);
+	} else {
+		endpoint.readTransfers.push(*this);
+	}
+
+	// start frames if the bus is idle
+	device.schedule();
+
+	// set state
+	setBusy();
+
+	return true;
+}
+
+bool UsbDevice_sim::Buffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	auto &endpoint = this->endpoint;
+	if ((this->op & Op::WRITE) != 0)
+		endpoint.writeTransfers.remove(*this);
+	else
+		endpoint.readTransfers.remove(*this);
+	setReady(0);
+
+	return true;
+}
+
+
+
+// ControlBuffer
+
+UsbDevice_sim::ControlBuffer::ControlBuffer(UsbDevice_sim &device, int capacity)
+	: coco::Buffer(new uint8_t[capacity], capacity, device.st.state)
+	, device(device)
+{
+	device.controlBuffers.add(*this);
+}
+
+UsbDevice_sim::ControlBuffer::~ControlBuffer() {
+	delete [] this->p.data;
+}
+
+bool UsbDevice_sim::ControlBuffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+
+	// a request must be pending and the direction must match
+	auto &device = this->device;
+	auto &setup = device.setup;
+	bool in = (setup.requestType & 0x80) != 0;
+	bool write = (op & Op::WRITE) != 0;
+	if (device.stage != Stage::REQUEST || write != in)
+		return false;
+
+	this->op = op;
+	if (write) {
+		// reply gets limited to the length of the request, a short reply that ends with a full packet needs a ZLP
+		int size = std::min(int(this->p.size), int(setup.length));
+		device.controlSize = size;
+		device.controlZeroLengthPacket = size < setup.length && size % CONTROL_PACKET_SIZE == 0;
+	} else {
+		device.controlSize = std::min(int(setup.length), int(this->p.capacity));
+		device.controlZeroLengthPacket = false;
+	}
+	device.controlOffset = 0;
+	device.stage = Stage::DATA;
+	device.controlTransfers.push(*this);
+
+	// start frames if the bus is idle
+	device.schedule();
+
+	// set state
+	setBusy();
+
+	return true;
+}
+
+bool UsbDevice_sim::ControlBuffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	// the device aborts the data stage, therefore the request gets stalled
+	auto &device = this->device;
+	if (device.controlTransfers.frontOrNull() == this) {
+		device.controlTransfers.pop();
+		device.stage = Stage::STALL;
+		device.schedule();
+	}
+	setReady(0);
+
+	return true;
+}
+
+} // namespace coco
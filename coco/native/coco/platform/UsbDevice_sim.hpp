@@ -0,0 +1,375 @@
+#pragma once
+
+#include "../BufferDevice.hpp"
+#include <coco/IntrusiveQueue.hpp>
+#include <coco/platform/Loop_native.hpp>
+
+
+namespace coco {
+
+class UsbHost_sim;
+
+/**
+ * Simulated USB device for the native platform. Bulk endpoints are BufferDevices that transfer packets to/from the
+ * peer endpoints of a simulated host (UsbHost_sim) in the same process.
+ *
+ * Writes get split into packets of the maximum packet size of the endpoint. If the last packet of a write has the
+ * maximum packet size (or the write is empty), a zero length packet (ZLP) gets added to end the transfer. Writes with
+ * Op::PARTIAL transfer only full packets and no ZLP, the size of the buffer is set to the number of bytes that were
+ * transferred. Reads complete when a short packet (including a ZLP) was received or the capacity of the buffer is
+ * reached, therefore the capacity of read buffers should be a multiple of the maximum packet size. Otherwise a packet
+ * that does not fit gets truncated (babble).
+ *
+ * The bus gets simulated in frames (1ms for full speed, 125us microframes for high speed). Each packet including NAKs
+ * takes a fixed protocol overhead in addition to its data from the bandwidth budget of the frame, therefore short
+ * packets reduce the throughput. Statistics can be used to measure the throughput of a USB stack.
+ *
+ * Control requests of the host on endpoint 0 get queued on the device. The application waits for a request using
+ * untilRequest() (Events::REQUEST), gets it using getRequest() and answers it with a ControlBuffer (data stage),
+ * acknowledge() (no data stage) or stall(). The reply gets transferred from the ControlBuffer directly into the buffer
+ * of the host without intermediate copy. SET_ADDRESS gets handled by the device itself.
+ *
+ * Usage example:
+ * UsbDevice_sim device(loop);
+ * UsbDevice_sim::BulkEndpoint endpoint(device, 1, 64);
+ * UsbDevice_sim::Buffer buffer(endpoint, 256);
+ * UsbHost_sim host(device);
+ * UsbHost_sim::BulkEndpoint hostEndpoint(host, 1);
+ * UsbDevice_sim::Buffer hostBuffer(hostEndpoint, 256);
+ * device.connect();
+ *
+ * Control request example:
+ * UsbDevice_sim::ControlBuffer controlBuffer(device, 256);
+ * co_await device.untilRequest();
+ * auto &setup = device.getRequest();
+ * if (setup.request == 0x06) co_await controlBuffer.writeData(descriptor, sizeof(descriptor)); else device.stall();
+ */
+class UsbDevice_sim : public BufferDevice {
+	friend class UsbHost_sim;
+public:
+	/**
+	 * Maximum number of endpoints (without control endpoint 0)
+	 */
+	static constexpr int MAX_ENDPOINT_COUNT = 15;
+
+	/**
+	 * Maximum packet size of control endpoint 0
+	 */
+	static constexpr int CONTROL_PACKET_SIZE = 64;
+
+	/**
+	 * Setup packet of a control request
+	 */
+	struct Setup {
+		// direction (bit 7 set for device to host), type (standard, class, vendor) and recipient
+		uint8_t requestType;
+
+		// request, e.g. 0x06 for GET_DESCRIPTOR
+		uint8_t request;
+
+		uint16_t value;
+		uint16_t index;
+
+		// length of the data stage
+		uint16_t length;
+	};
+
+	/**
+	 * Bus speed
+	 */
+	enum class Speed {
+		// 12 MBit/s, 1ms frames, maximum bulk packet size 64
+		FULL,
+
+		// 480 MBit/s, 125us microframes, maximum bulk packet size 512
+		HIGH
+	};
+
+	/**
+	 * Bus statistics
+	 */
+	struct Statistics {
+		// number of (micro)frames while transfers were pending
+		int frameCount = 0;
+
+		// number of (micro)frames where the bandwidth budget was exhausted
+		int fullFrameCount = 0;
+
+		// number of data packets
+		int packetCount = 0;
+
+		// number of short packets (not including zero length packets)
+		int shortPacketCount = 0;
+
+		// number of zero length packets
+		int zeroLengthPacketCount = 0;
+
+		// number of NAKs, i.e. one side of an endpoint was not ready in a frame
+		int nakCount = 0;
+
+		// number of transferred data bytes
+		int64_t byteCount = 0;
+
+		// time of the counted frames in microseconds
+		int64_t elapsedTime = 0;
+
+		// number of completed and stalled control transfers
+		int controlCount = 0;
+		int stallCount = 0;
+
+		// sum and maximum of the latencies of control transfers (start of host buffer until completion) in nanoseconds
+		int64_t controlLatency = 0;
+		int64_t maxControlLatency = 0;
+
+		/**
+		 * Throughput in bytes per second
+		 */
+		float throughput() const {return this->elapsedTime > 0 ? float(this->byteCount) * 1e6f / float(this->elapsedTime) : 0.0f;}
+
+		/**
+		 * Average latency of a control transfer in nanoseconds
+		 */
+		float averageControlLatency() const {
+			return this->controlCount > 0 ? float(this->controlLatency) / float(this->controlCount) : 0.0f;
+		}
+	};
+
+	/**
+	 * Constructor
+	 * @param loop event loop
+	 * @param speed bus speed
+	 */
+	UsbDevice_sim(Loop_native &loop, Speed speed = Speed::FULL);
+	~UsbDevice_sim() override;
+
+	class Endpoint;
+
+	/**
+	 * Buffer for transferring data over an endpoint
+	 */
+	class Buffer : public coco::Buffer, public IntrusiveListNode, public IntrusiveQueueNode {
+		friend class UsbDevice_sim;
+	public:
+		/**
+		 * Constructor
+		 * @param endpoint endpoint to attach to (device or host side)
+		 * @param capacity capacity of the buffer
+		 */
+		Buffer(Endpoint &endpoint, int capacity);
+		~Buffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		Endpoint &endpoint;
+		Op op;
+
+		// number of bytes that were already transferred
+		int offset;
+
+		// size to transfer for writes (only full packets for Op::PARTIAL)
+		int transferSize;
+
+		// write needs a zero length packet at the end
+		bool zeroLengthPacket;
+
+		// sequence number of the current transfer
+		uint32_t sequence = 0;
+	};
+
+	/**
+	 * Base class for device side and host side endpoints
+	 */
+	class Endpoint : public BufferDevice {
+		friend class UsbDevice_sim;
+		friend class UsbHost_sim;
+	public:
+		Endpoint(UsbDevice_sim &device, int number);
+		~Endpoint() override;
+
+		// BufferDevice methods
+		int getBufferCount() override;
+		Buffer &getBuffer(int index) override;
+
+	protected:
+		UsbDevice_sim &device;
+		int number;
+
+		// list of buffers
+		IntrusiveList<Buffer> buffers;
+
+		// queued write and read transfers
+		IntrusiveQueue<Buffer> writeTransfers;
+		IntrusiveQueue<Buffer> readTransfers;
+	};
+
+	/**
+	 * Device side bulk endpoint. Writes go to the host (IN), reads come from the host (OUT)
+	 */
+	class BulkEndpoint : public Endpoint {
+		friend class UsbDevice_sim;
+	public:
+		/**
+		 * Constructor
+		 * @param device the device the endpoint belongs to
+		 * @param number endpoint number (1 to MAX_ENDPOINT_COUNT), used for IN and OUT direction
+		 * @param maxPacketSize maximum packet size, at most 64 for full speed and 512 for high speed
+		 */
+		BulkEndpoint(UsbDevice_sim &device, int number, int maxPacketSize);
+		~BulkEndpoint() override;
+
+		/**
+		 * Get the maximum packet size of the endpoint
+		 */
+		int getMaxPacketSize() {return this->maxPacketSize;}
+
+	protected:
+		int maxPacketSize;
+	};
+
+	/**
+	 * Buffer for the data stage of control requests on endpoint 0. Use write() to reply to a request of the host
+	 * (device to host), the size gets limited to the length of the request. Use read() to receive the data of a
+	 * request (host to device), the status stage gets acknowledged automatically.
+	 */
+	class ControlBuffer : public coco::Buffer, public IntrusiveListNode, public IntrusiveQueueNode {
+		friend class UsbDevice_sim;
+	public:
+		/**
+		 * Constructor
+		 * @param device the device the buffer belongs to
+		 * @param capacity capacity of the buffer
+		 */
+		ControlBuffer(UsbDevice_sim &device, int capacity);
+		~ControlBuffer() override;
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		UsbDevice_sim &device;
+		Op op;
+	};
+
+	/**
+	 * Connect the device to the host. The device and all endpoints become ready
+	 */
+	void connect();
+
+	/**
+	 * Disconnect the device from the host, all transfers get cancelled
+	 */
+	void disconnect();
+
+	/**
+	 * Wait for a control request of the host. Does not wait when a request is pending.
+	 * @return use co_await on return value to wait for a control request
+	 */
+	[[nodiscard]] Awaitable<Events> untilRequest() {
+		if (this->stage == Stage::REQUEST)
+			return {};
+		return {this->st.tasks, Events::REQUEST};
+	}
+
+	/**
+	 * Returns true if a control request is pending and needs to be answered
+	 */
+	bool hasRequest() {return this->stage == Stage::REQUEST;}
+
+	/**
+	 * Get the pending control request, only valid if hasRequest() returns true
+	 */
+	const Setup &getRequest() {return this->setup;}
+
+	/**
+	 * Acknowledge the pending control request without data stage
+	 */
+	void acknowledge();
+
+	/**
+	 * Stall the pending control request, e.g. because it is not supported
+	 */
+	void stall();
+
+	/**
+	 * Get the address assigned by the host using SET_ADDRESS
+	 */
+	int getAddress() {return this->address;}
+
+	/**
+	 * Get the bus statistics
+	 */
+	const Statistics &statistics() const {return this->stats;}
+
+	/**
+	 * Reset the bus statistics
+	 */
+	void resetStatistics() {this->stats = {};}
+
+	/**
+	 * Get the current time for measuring latencies in nanoseconds
+	 */
+	static int64_t now();
+
+	// BufferDevice methods
+	int getBufferCount() override;
+	ControlBuffer &getBuffer(int index) override;
+	void close() override;
+
+protected:
+	// stage of the current control transfer
+	enum class Stage {
+		// wait for host to send a setup packet
+		SETUP,
+
+		// request is pending in the device
+		REQUEST,
+
+		// data stage using a ControlBuffer
+		DATA,
+
+		// status stage
+		STATUS,
+
+		// request gets stalled
+		STALL
+	};
+
+	static void setState(Endpoint &endpoint, State state);
+	bool pending();
+	void schedule();
+	void handle();
+	bool transfer(IntrusiveQueue<Buffer> &writeTransfers, IntrusiveQueue<Buffer> &readTransfers, int maxPacketSize,
+		int &budget);
+	bool control(int &budget);
+	void resetControl();
+
+	Loop_native &loop;
+	Speed speed;
+	UsbHost_sim *host = nullptr;
+	TimedTask<Callback> callback;
+	bool running = false;
+
+	// sequence number of the last started transfer
+	uint32_t sequence = 0;
+
+	// device side endpoints by endpoint number
+	BulkEndpoint *endpoints[MAX_ENDPOINT_COUNT + 1] = {};
+
+	// control transfers
+	IntrusiveList<ControlBuffer> controlBuffers;
+	IntrusiveQueue<ControlBuffer> controlTransfers;
+	Stage stage = Stage::SETUP;
+	Setup setup;
+	int address = 0;
+
+	// size and progress of the data stage
+	int controlSize;
+	int controlOffset;
+	bool controlZeroLengthPacket;
+
+	Statistics stats;
+};
+
+} // namespace coco
@@ -0,0 +1,163 @@
+#include "UsbHost_sim.hpp"
+#include <algorithm>
+
+
+namespace coco {
+
+namespace {
+
+// standard requests and descriptor types
+constexpr uint8_t SET_ADDRESS = 0x05;
+constexpr uint8_t GET_DESCRIPTOR = 0x06;
+constexpr uint8_t SET_CONFIGURATION = 0x09;
+constexpr int DEVICE_DESCRIPTOR = 1;
+constexpr int CONFIGURATION_DESCRIPTOR = 2;
+
+} // namespace
+
+
+UsbHost_sim::UsbHost_sim(UsbDevice_sim &device)
+	: BufferDevice(device.st.state), device(device)
+{
+	device.host = this;
+}
+
+UsbHost_sim::~UsbHost_sim() {
+	this->device.host = nullptr;
+}
+
+AwaitableCoroutine UsbHost_sim::enumerate(ControlBuffer &buffer) {
+	this->configuration = 0;
+	int64_t start = UsbDevice_sim::now();
+
+	// get device descriptor, the host asks for 64 bytes but only needs the first 8 bytes (maximum packet size)
+	buffer.setHeader(Setup{0x80, GET_DESCRIPTOR, DEVICE_DESCRIPTOR << 8, 0, 64});
+	co_await buffer.read();
+	if (buffer.stalled() || buffer.size() < 8)
+		co_return;
+
+	// set address
+	buffer.setHeader(Setup{0x00, SET_ADDRESS, 1, 0, 0});
+	co_await buffer.write(0);
+	if (buffer.stalled())
+		co_return;
+
+	// get complete device descriptor
+	buffer.setHeader(Setup{0x80, GET_DESCRIPTOR, DEVICE_DESCRIPTOR << 8, 0, 18});
+	co_await buffer.read();
+	if (buffer.stalled() || buffer.size() < 18)
+		co_return;
+
+	// get configuration descriptor to obtain the total length
+	buffer.setHeader(Setup{0x80, GET_DESCRIPTOR, CONFIGURATION_DESCRIPTOR << 8, 0, 9});
+	co_await buffer.read();
+	if (buffer.stalled() || buffer.size() < 9)
+		co_return;
+	int totalLength = buffer[2] | (buffer[3] << 8);
+	int configuration = buffer[5];
+
+	// get configuration descriptor including interface and endpoint descriptors
+	buffer.setHeader(Setup{0x80, GET_DESCRIPTOR, CONFIGURATION_DESCRIPTOR << 8, 0, uint16_t(totalLength)});
+	co_await buffer.read();
+	if (buffer.stalled() || buffer.size() < std::min(totalLength, buffer.capacity()))
+		co_return;
+
+	// set configuration
+	buffer.setHeader(Setup{0x00, SET_CONFIGURATION, uint16_t(configuration), 0, 0});
+	co_await buffer.write(0);
+	if (buffer.stalled())
+		co_return;
+
+	this->configuration = configuration;
+	this->enumerationTime = UsbDevice_sim::now() - start;
+}
+
+int UsbHost_sim::getBufferCount() {
+	return this->controlBuffers.count();
+}
+
+UsbHost_sim::ControlBuffer &UsbHost_sim::getBuffer(int index) {
+	return this->controlBuffers.get(index);
+}
+
+
+// BulkEndpoint
+
+UsbHost_sim::BulkEndpoint::BulkEndpoint(UsbHost_sim &host, int number)
+	: Endpoint(host.device, number), host(host)
+{
+	host.endpoints[number] = this;
+}
+
+UsbHost_sim::BulkEndpoint::~BulkEndpoint() {
+	this->host.endpoints[this->number] = nullptr;
+}
+
+
+// ControlBuffer
+
+UsbHost_sim::ControlBuffer::ControlBuffer(UsbHost_sim &host, int capacity)
+	: coco::Buffer(new uint8_t[sizeof(Setup) + capacity], sizeof(Setup), capacity, host.st.state)
+	, host(host)
+{
+	host.controlBuffers.add(*this);
+}
+
+UsbHost_sim::ControlBuffer::~ControlBuffer() {
+	delete [] this->p.data;
+}
+
+bool UsbHost_sim::ControlBuffer::start(Op op) {
+	if (this->st.state != State::READY) {
+		// staring a buffer that is busy is considered a bug
+		assert(this->st.state != State::BUSY);
+		return false;
+	}
+
+	// check if either READ or WRITE flag is set and the header contains a setup packet
+	assert((op & Op::READ_WRITE) != 0 && (op & Op::READ_WRITE) != Op::READ_WRITE);
+	assert(this->p.headerSize == sizeof(Setup));
+
+	// set direction and length of the request
+	auto &setup = header<Setup>();
+	int capacity = this->p.capacity - this->p.headerSize;
+	if ((op & Op::WRITE) != 0) {
+		setup.requestType &= ~0x80;
+		setup.length = this->p.size - this->p.headerSize;
+	} else {
+		setup.requestType |= 0x80;
+		setup.length = std::min(int(setup.length), capacity);
+	}
+
+	this->op = op;
+	this->stall = false;
+	this->startTime = UsbDevice_sim::now();
+
+	// add to list of control transfers and start frames if the bus is idle
+	this->host.controlTransfers.push(*this);
+	this->host.device.schedule();
+
+	// set state
+	setBusy();
+
+	return true;
+}
+
+bool UsbHost_sim::ControlBuffer::cancel() {
+	if (this->st.state != State::BUSY)
+		return false;
+
+	auto &host = this->host;
+	bool current = host.controlTransfers.frontOrNull() == this;
+	host.controlTransfers.remove(*this);
+
+	// abort the control transfer in the device
+	if (current)
+		host.device.resetControl();
+
+	setReady(0);
+
+	return true;
+}
+
+} // namespace coco
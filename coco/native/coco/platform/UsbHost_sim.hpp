@@ -0,0 +1,127 @@
+#pragma once
+
+#include "UsbDevice_sim.hpp"
+
+
+namespace coco {
+
+/**
+ * Simulated USB host that is the peer of a simulated USB device (UsbDevice_sim) in the same process. The bulk
+ * endpoints of the host use the maximum packet size of the device endpoint with the same number, writes go to the
+ * device (OUT) and reads come from the device (IN). A read of the host polls the device endpoint, if the device has no
+ * data to send, it answers with NAK.
+ *
+ * Control requests get issued using a ControlBuffer whose header contains the setup packet. Control transfers get
+ * executed one after the other in the order they were started. The latency of control transfers and the duration of
+ * an enumeration can be used to benchmark the request handling of a USB stack.
+ *
+ * Usage example:
+ * UsbHost_sim::ControlBuffer buffer(host, 256);
+ * buffer.header<UsbDevice_sim::Setup>() = {0xc0, 0x01, 0, 0, 16}; // vendor request, device to host
+ * co_await buffer.read();
+ */
+class UsbHost_sim : public BufferDevice {
+	friend class UsbDevice_sim;
+public:
+	using Buffer = UsbDevice_sim::Buffer;
+	using Setup = UsbDevice_sim::Setup;
+
+	/**
+	 * Constructor
+	 * @param device the simulated device that is attached to the host
+	 */
+	UsbHost_sim(UsbDevice_sim &device);
+	~UsbHost_sim() override;
+
+	/**
+	 * Host side bulk endpoint
+	 */
+	class BulkEndpoint : public UsbDevice_sim::Endpoint {
+		friend class UsbDevice_sim;
+	public:
+		/**
+		 * Constructor
+		 * @param host the host the endpoint belongs to
+		 * @param number endpoint number of the device endpoint (1 to UsbDevice_sim::MAX_ENDPOINT_COUNT)
+		 */
+		BulkEndpoint(UsbHost_sim &host, int number);
+		~BulkEndpoint() override;
+
+	protected:
+		UsbHost_sim &host;
+	};
+
+	/**
+	 * Buffer for control transfers on endpoint 0, the header contains the setup packet. Use read() for requests from
+	 * device to host (the length field of the setup packet is limited to the capacity), use write() for requests from
+	 * host to device (the length field is set to the size of the data). The direction bit of the request type is set
+	 * according to the operation.
+	 */
+	class ControlBuffer : public coco::Buffer, public IntrusiveListNode, public IntrusiveQueueNode {
+		friend class UsbDevice_sim;
+		friend class UsbHost_sim;
+	public:
+		/**
+		 * Constructor
+		 * @param host the host the buffer belongs to
+		 * @param capacity capacity of the buffer (without setup packet)
+		 */
+		ControlBuffer(UsbHost_sim &host, int capacity);
+		~ControlBuffer() override;
+
+		/**
+		 * Returns true if the last request was stalled by the device
+		 */
+		bool stalled() {return this->stall;}
+
+		bool start(Op op) override;
+		bool cancel() override;
+
+	protected:
+		UsbHost_sim &host;
+		Op op;
+		bool stall = false;
+
+		// time when the transfer was started in nanoseconds
+		int64_t startTime;
+	};
+
+	/**
+	 * Enumerate the device using standard requests: Get the device descriptor, set the address, get the configuration
+	 * descriptor and set the first configuration. The device has to answer the GET_DESCRIPTOR and SET_CONFIGURATION
+	 * requests.
+	 * @param buffer control buffer with a capacity that is large enough for the configuration descriptor
+	 * @return use co_await on return value to wait until the enumeration has finished
+	 */
+	[[nodiscard]] AwaitableCoroutine enumerate(ControlBuffer &buffer);
+
+	/**
+	 * Get the configuration that was set by the last enumeration, 0 if the enumeration failed
+	 */
+	int getConfiguration() {return this->configuration;}
+
+	/**
+	 * Get the duration of the last enumeration in nanoseconds
+	 */
+	int64_t getEnumerationTime() {return this->enumerationTime;}
+
+	// BufferDevice methods
+	int getBufferCount() override;
+	ControlBuffer &getBuffer(int index) override;
+
+protected:
+	UsbDevice_sim &device;
+
+	// host side endpoints by endpoint number
+	BulkEndpoint *endpoints[UsbDevice_sim::MAX_ENDPOINT_COUNT + 1] = {};
+
+	// control transfers
+	IntrusiveList<ControlBuffer> controlBuffers;
+	IntrusiveQueue<ControlBuffer> controlTransfers;
+
+	// result of enumeration
+	int configuration = 0;
+	int64_t enumerationTime = 0;
+};
+
+} // namespace coco
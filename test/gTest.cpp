@@ -2,8 +2,37 @@
 #include <coco/Buffer.hpp>
 #include <coco/BufferReader.hpp>
 #include <coco/BufferWriter.hpp>
+#include <coco/CancelScope.hpp>
+#include <coco/FairQueue.hpp>
+#include <coco/Framebuffer.hpp>
+#include <coco/PageCache.hpp>
+#include <coco/ReadSequence.hpp>
+#include <coco/RegisterCache.hpp>
+#include <coco/Sender.hpp>
+#include <coco/StreamReader.hpp>
+#include <coco/StreamWriter.hpp>
+#include <coco/TrafficShaper.hpp>
+#include <coco/WhenAll.hpp>
+#include <coco/WriteBackCache.hpp>
+#include <coco/WriteMerger.hpp>
+#include <coco/platform/Loop_native.hpp>
+#include <coco/platform/I2cMaster_sim.hpp>
+#include <coco/platform/PeriodicStream_sim.hpp>
+#include <coco/platform/RadioMedium_sim.hpp>
+#include <coco/platform/SerialPort_native.hpp>
+#include <coco/platform/SpiDisplay_sim.hpp>
+#include <coco/platform/SpiFlash_sim.hpp>
+#include <coco/platform/SpiMaster_sim.hpp>
+#include <coco/platform/TcpListener_native.hpp>
+#include <coco/platform/TcpSocket_native.hpp>
+#include <coco/platform/UdpSocket_native.hpp>
+#include <coco/platform/UsbHost_sim.hpp>
 #include <coco/ArrayConcept.hpp>
 #include <coco/StreamOperators.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
 
 
 using namespace coco;
@@ -40,6 +69,61 @@ public:
 	}
 };
 
+class TestDevice : public BufferDevice {
+public:
+	TestDevice(Buffer &buffer) : BufferDevice(State::READY), buffer(buffer) {}
+
+	int getBufferCount() override {return 1;}
+	Buffer &getBuffer(int index) override {return this->buffer;}
+
+	Buffer &buffer;
+};
+
+// buffer that stays busy until the test completes it
+class ManualBuffer : public Buffer {
+public:
+	ManualBuffer() : Buffer(data, 16, State::READY) {}
+
+	bool start(Op op) override {
+		this->op = op;
+		setBusy();
+		return true;
+	}
+
+	bool cancel() override {
+		if (!busy())
+			return false;
+		setReady(0);
+		return true;
+	}
+
+	void complete(int size) {
+		setReady(size);
+	}
+
+	void disable() {
+		setDisabled();
+	}
+
+	void enable() {
+		setReady(0);
+	}
+
+	uint8_t data[16];
+	Op op = Op::NONE;
+};
+
+class ManualDevice : public BufferDevice {
+public:
+	ManualDevice() : BufferDevice(State::READY) {}
+
+	int getBufferCount() override {return 2;}
+	Buffer &getBuffer(int index) override {return index == 0 ? this->buffer1 : this->buffer2;}
+
+	ManualBuffer buffer1;
+	ManualBuffer buffer2;
+};
+
 TEST(cocoTest, setHeader) {
 	uint8_t buffer[128];
 	TestBuffer b(buffer, 128);
@@ -334,6 +418,1716 @@ TEST(cocoTest, DataBuffer) {
 	}
 }
 
+Coroutine udpTest(Loop_native &loop, UdpSocket_native &sender, UdpSocket_native &receiver) {
+	auto &w1 = sender.getBuffer(0);
+	auto &w2 = sender.getBuffer(1);
+	auto &r1 = receiver.getBuffer(0);
+	auto &r2 = receiver.getBuffer(1);
+	sockaddr_in destination = {};
+	destination.sin_family = AF_INET;
+	destination.sin_port = htons(receiver.getLocalPort());
+	destination.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	w1.header<sockaddr_in>() = destination;
+	w2.header<sockaddr_in>() = destination;
+
+	// buffers that get started in the same iteration of the event loop are submitted in one batch
+	r1.startRead(r1.capacity());
+	r2.startRead(r2.capacity());
+	std::memcpy(w1.data(), "foo", 3);
+	std::memcpy(w2.data(), "barbaz", 6);
+	w1.startWrite(3);
+	w2.startWrite(6);
+	co_await r2.untilReadyOrDisabled();
+	EXPECT_TRUE(w1.ready());
+	EXPECT_EQ(w1.size(), 3);
+	EXPECT_EQ(w2.size(), 6);
+	EXPECT_TRUE(r1.ready());
+	EXPECT_EQ(r1.string(), "foo");
+	EXPECT_EQ(r2.string(), "barbaz");
+
+	// the header contains the address of the sender
+	EXPECT_EQ(ntohs(r1.header<sockaddr_in>().sin_port), sender.getLocalPort());
+
+	// datagrams that are queued when a read gets started are received without a new notification
+	co_await w1.writeData("1", 1);
+	co_await w2.writeData("2", 1);
+	co_await r1.read(r1.capacity());
+	EXPECT_EQ(r1.string(), "1");
+	co_await r1.read(r1.capacity());
+	EXPECT_EQ(r1.string(), "2");
+
+	// closing the device disables pending reads
+	r1.startRead(r1.capacity());
+	receiver.close();
+	EXPECT_TRUE(r1.disabled());
+
+	loop.exit();
+}
+
+TEST(cocoTest, UdpSocket_native) {
+	Loop_native loop;
+	UdpSocket_native sender(loop);
+	UdpSocket_native::Buffer w1(sender, 16);
+	UdpSocket_native::Buffer w2(sender, 16);
+	UdpSocket_native receiver(loop);
+	UdpSocket_native::Buffer r1(receiver, 16);
+	UdpSocket_native::Buffer r2(receiver, 16);
+	EXPECT_TRUE(sender.open(0, htonl(INADDR_LOOPBACK)));
+	EXPECT_TRUE(receiver.open(0, htonl(INADDR_LOOPBACK)));
+	EXPECT_TRUE(w1.ready());
+
+	udpTest(loop, sender, receiver);
+	loop.run();
+}
+
+Coroutine udpOffloadTest(Loop_native &loop, UdpSocket_native &sender, UdpSocket_native &receiver) {
+	auto &w1 = sender.getBuffer(0);
+	auto &r1 = receiver.getBuffer(0);
+	auto &r2 = receiver.getBuffer(1);
+	auto &r3 = receiver.getBuffer(2);
+	sockaddr_in destination = {};
+	destination.sin_family = AF_INET;
+	destination.sin_port = htons(receiver.getLocalPort());
+	destination.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	w1.header<sockaddr_in>() = destination;
+	for (int i = 0; i < 10; ++i)
+		w1[i] = i;
+
+	// the kernel splits the data into datagrams of segment size
+	w1.setSegmentSize(4);
+	r1.startRead(r1.capacity());
+	r2.startRead(r2.capacity());
+	r3.startRead(r3.capacity());
+	co_await w1.write(10);
+	EXPECT_EQ(w1.size(), 10);
+	co_await r3.untilReadyOrDisabled();
+	EXPECT_EQ(r1.size(), 4);
+	EXPECT_EQ(r2.size(), 4);
+	EXPECT_EQ(r3.size(), 2);
+	EXPECT_EQ(r1.segmentSize(), 0);
+	EXPECT_EQ(r3[1], 9);
+
+	// with receive offload the datagrams arrive coalesced and the segment size is reported
+	EXPECT_TRUE(receiver.setReceiveOffload(true));
+	r1.startRead(r1.capacity());
+	co_await w1.write(10);
+	co_await r1.untilReadyOrDisabled();
+	EXPECT_EQ(r1.size(), 10);
+	EXPECT_EQ(r1.segmentSize(), 4);
+	EXPECT_EQ(r1[9], 9);
+
+	loop.exit();
+}
+
+TEST(cocoTest, UdpSocket_nativeOffload) {
+	Loop_native loop;
+	UdpSocket_native sender(loop);
+	UdpSocket_native::Buffer w1(sender, 16);
+	UdpSocket_native receiver(loop);
+	UdpSocket_native::Buffer r1(receiver, 16);
+	UdpSocket_native::Buffer r2(receiver, 16);
+	UdpSocket_native::Buffer r3(receiver, 16);
+	EXPECT_TRUE(sender.open(0, htonl(INADDR_LOOPBACK)));
+	EXPECT_TRUE(receiver.open(0, htonl(INADDR_LOOPBACK)));
+
+	udpOffloadTest(loop, sender, receiver);
+	loop.run();
+}
+
+Coroutine tcpTest(Loop_native &loop, TcpListener_native &listener, TcpSocket_native &server, TcpSocket_native &client) {
+	auto &s1 = server.getBuffer(0);
+	auto &c1 = client.getBuffer(0);
+	auto &c2 = client.getBuffer(1);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(listener.getLocalPort());
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	// accept and connect
+	EXPECT_TRUE(server.accept(listener));
+	EXPECT_TRUE(client.connect(address));
+	EXPECT_TRUE(client.opening());
+	co_await server.untilReadyOrDisabled();
+	co_await client.untilReadyOrDisabled();
+	EXPECT_TRUE(server.ready());
+	EXPECT_TRUE(client.ready());
+
+	// queued writes are gathered, a read completes with the available data
+	std::memcpy(c1.data(), "foo", 3);
+	std::memcpy(c2.data(), "bar", 3);
+	c1.startWrite(3, Buffer::Op::PARTIAL);
+	c2.startWrite(3);
+	co_await c2.untilReadyOrDisabled();
+	EXPECT_EQ(c1.size(), 3);
+	EXPECT_EQ(c2.size(), 3);
+	std::string received;
+	while (received.size() < 6) {
+		co_await s1.read(s1.capacity());
+		received += s1.string();
+	}
+	EXPECT_EQ(received, "foobar");
+
+	// data that was received before the peer closed the connection can still be read
+	co_await s1.writeData("baz", 3);
+	server.close();
+	EXPECT_TRUE(s1.disabled());
+	co_await loop.sleep(loop.now() + 20ms);
+	EXPECT_TRUE(client.ready());
+	co_await c1.read(c1.capacity());
+	EXPECT_EQ(c1.string(), "baz");
+	co_await c1.read(c1.capacity());
+	EXPECT_TRUE(c1.disabled());
+	co_await client.untilDisabled();
+	EXPECT_TRUE(c2.disabled());
+
+	// the device gets disabled when the peer closes the connection while no read is pending
+	EXPECT_TRUE(server.accept(listener));
+	EXPECT_TRUE(client.connect(address));
+	co_await server.untilReadyOrDisabled();
+	co_await client.untilReadyOrDisabled();
+	client.close();
+	co_await loop.sleep(loop.now() + 20ms);
+	EXPECT_TRUE(s1.disabled());
+	EXPECT_TRUE(server.disabled());
+
+	listener.close();
+	loop.exit();
+}
+
+TEST(cocoTest, TcpSocket_native) {
+	Loop_native loop;
+	TcpListener_native listener(loop);
+	TcpSocket_native server(loop);
+	TcpSocket_native::Buffer s1(server, 16);
+	TcpSocket_native client(loop);
+	TcpSocket_native::Buffer c1(client, 16);
+	TcpSocket_native::Buffer c2(client, 16);
+	EXPECT_TRUE(listener.open(0, htonl(INADDR_LOOPBACK)));
+	EXPECT_NE(listener.getLocalPort(), 0);
+
+	tcpTest(loop, listener, server, client);
+	loop.run();
+}
+
+// slave model that records the last transfer and returns a counter on read
+class SpiTestSlave : public SpiMaster_sim::Slave {
+public:
+	int transfer(Buffer::Op op, const uint8_t *header, int headerSize, uint8_t *data, int size) override {
+		this->op = op;
+		this->header.assign(header, header + headerSize);
+		if ((op & Buffer::Op::WRITE) != 0)
+			this->data.assign(data, data + size);
+		if ((op & Buffer::Op::READ) != 0) {
+			for (int i = 0; i < size; ++i)
+				data[i] = i;
+		}
+		++this->transferCount;
+		return (headerSize + size) * 8;
+	}
+
+	Buffer::Op op = Buffer::Op::NONE;
+	std::vector<uint8_t> header;
+	std::vector<uint8_t> data;
+	int transferCount = 0;
+};
+
+Coroutine spiTest(Loop_native &loop, SpiMaster_sim &master, SpiMaster_sim::Buffer &b1, SpiMaster_sim::Buffer &b2,
+	SpiMaster_sim::Buffer &b3, SpiTestSlave &slave1, SpiTestSlave &slave2)
+{
+	// 8 clock cycles per millisecond and 1ms chip select time: a write with 2 header bytes and 8 data bytes takes
+	// 11ms, a read of 4 bytes takes 5ms and gets executed when the bus becomes idle
+	int64_t start = SpiMaster_sim::now();
+	b1.setHeader<uint16_t>(0x1234);
+	for (int i = 0; i < 8; ++i)
+		b1[i] = 10 + i;
+	b1.startWrite(8, Buffer::Op::COMMAND);
+	b2.startRead(4);
+	b3.startRead(4);
+	EXPECT_EQ(slave1.transferCount, 1);
+	EXPECT_EQ(slave2.transferCount, 0);
+
+	// a queued transfer can be cancelled, the transfer on the bus can't
+	EXPECT_TRUE(b3.cancel());
+	EXPECT_TRUE(b3.ready());
+	EXPECT_EQ(b3.size(), 0);
+	EXPECT_TRUE(b1.cancel());
+	EXPECT_TRUE(b1.busy());
+
+	// the transfers get dispatched to the slave of their channel and complete when the bus has finished them
+	co_await b1.untilReadyOrDisabled();
+	EXPECT_GE(SpiMaster_sim::now() - start, 10000000);
+	EXPECT_EQ(b1.size(), 8);
+	EXPECT_EQ(slave1.op, Buffer::Op::WRITE | Buffer::Op::COMMAND);
+	EXPECT_EQ(slave1.header, std::vector<uint8_t>({0x34, 0x12}));
+	EXPECT_EQ(slave1.data, std::vector<uint8_t>({10, 11, 12, 13, 14, 15, 16, 17}));
+	EXPECT_EQ(slave2.transferCount, 1);
+	co_await b2.untilReadyOrDisabled();
+	EXPECT_GE(SpiMaster_sim::now() - start, 15000000);
+	EXPECT_EQ(b2.size(), 4);
+	EXPECT_EQ(b2[3], 3);
+	EXPECT_EQ(slave2.op, Buffer::Op::READ);
+
+	auto &stats = master.statistics();
+	EXPECT_EQ(stats.transferCount, 2);
+	EXPECT_EQ(stats.commandCount, 1);
+	EXPECT_EQ(stats.headerBytes, 2);
+	EXPECT_EQ(stats.dataBytes, 12);
+	EXPECT_EQ(stats.busyTime, 16000000);
+	EXPECT_GE(stats.elapsedTime, stats.busyTime);
+
+	loop.exit();
+}
+
+TEST(cocoTest, SpiMaster_sim) {
+	Loop_native loop;
+	SpiMaster_sim master(loop, 8000, 1000000);
+	SpiTestSlave slave1;
+	SpiTestSlave slave2;
+	SpiMaster_sim::Channel channel1(master, slave1);
+	SpiMaster_sim::Channel channel2(master, slave2);
+	SpiMaster_sim::Buffer b1(channel1, 16);
+	SpiMaster_sim::Buffer b2(channel2, 16);
+	SpiMaster_sim::Buffer b3(channel2, 16);
+
+	spiTest(loop, master, b1, b2, b3, slave1, slave2);
+	loop.run();
+	EXPECT_EQ(slave2.transferCount, 1);
+}
+
+Coroutine i2cTest(Loop_native &loop, I2cMaster_sim &master, I2cMaster_sim::RegisterSlave &sensor,
+	I2cMaster_sim::Buffer &buffer, I2cMaster_sim::Buffer &buffer16)
+{
+	auto &stats = master.statistics();
+
+	// write registers 2 to 4: START, address, register, 3 bytes, STOP
+	int64_t start = I2cMaster_sim::now();
+	buffer.setHeader<uint8_t>(2);
+	co_await buffer.writeData("\x01\x02\x03", 3);
+	EXPECT_GE(I2cMaster_sim::now() - start, 4000000);
+	EXPECT_EQ(buffer.size(), 3);
+	EXPECT_EQ(sensor[2], 1);
+	EXPECT_EQ(sensor[4], 3);
+	EXPECT_EQ(stats.busyTime, 4700000);
+
+	// read with repeated START, then continue reading at the auto incremented register address
+	sensor[5] = 0x55;
+	buffer.setHeader<uint8_t>(3);
+	co_await buffer.read(2);
+	EXPECT_EQ(buffer.size(), 2);
+	EXPECT_EQ(buffer[0], 2);
+	EXPECT_EQ(buffer[1], 3);
+	EXPECT_EQ(stats.repeatedStartCount, 1);
+	buffer.headerResize(0);
+	co_await buffer.read(1);
+	EXPECT_EQ(buffer[0], 0x55);
+	EXPECT_EQ(stats.repeatedStartCount, 1);
+
+	// NACK at the end of the register map
+	buffer.setHeader<uint8_t>(14);
+	co_await buffer.writeData("\x0e\x0f\x10\x11", 4);
+	EXPECT_EQ(buffer.size(), 2);
+	EXPECT_EQ(sensor[15], 0x0f);
+	EXPECT_EQ(stats.nackCount, 1);
+
+	// NACK for a register address outside of the map
+	buffer.setHeader<uint8_t>(16);
+	co_await buffer.writeData("\x10", 1);
+	EXPECT_EQ(buffer.size(), 0);
+	EXPECT_EQ(stats.nackCount, 2);
+
+	// NACK for a write that is too short for a 16 bit register address
+	buffer16.setHeader<uint8_t>(0x77);
+	co_await buffer16.write(0);
+	EXPECT_EQ(buffer16.size(), 0);
+	EXPECT_EQ(stats.nackCount, 3);
+
+	EXPECT_EQ(stats.transactionCount, 6);
+	EXPECT_EQ(stats.headerBytes, 5);
+	EXPECT_EQ(stats.dataBytes, 8);
+
+	loop.exit();
+}
+
+TEST(cocoTest, I2cMaster_sim) {
+	Loop_native loop;
+	I2cMaster_sim master(loop, 10000);
+	I2cMaster_sim::RegisterSlave sensor(16);
+	I2cMaster_sim::RegisterSlave memory(16, 2);
+	I2cMaster_sim::Channel channel(master, sensor, 0x76);
+	I2cMaster_sim::Channel channel16(master, memory, 0x50);
+	I2cMaster_sim::Buffer buffer(channel, 1, 8);
+	I2cMaster_sim::Buffer buffer16(channel16, 2, 8);
+
+	i2cTest(loop, master, sensor, buffer, buffer16);
+	loop.run();
+	for (int i = 0; i < 16; ++i) {
+		EXPECT_EQ(memory[i], 0);
+	}
+}
+
+Coroutine flashTest(Loop_native &loop, SpiFlash_sim &flash, SpiMaster_sim::Buffer &buffer) {
+	auto &stats = flash.statistics();
+	auto memory = flash.data();
+	const uint8_t data[] = {0x0f, 0x0f, 0x0f, 0x0f};
+
+	// page program without write enable gets ignored
+	buffer.setHeader(std::array<uint8_t, 4>{0x02, 0, 0, 0xfe});
+	co_await buffer.writeData(data, 4);
+	EXPECT_EQ(memory[0xfe], 0xff);
+	EXPECT_EQ(stats.ignoredCount, 1);
+
+	// write enable sets the write enable latch in the status register
+	buffer.setHeader<uint8_t>(0x06);
+	co_await buffer.write(0);
+	buffer.setHeader<uint8_t>(0x05);
+	co_await buffer.read(1);
+	EXPECT_EQ(buffer[0], 0x02);
+
+	// page program wraps around within the page and sets write in progress
+	int64_t start = SpiMaster_sim::now();
+	buffer.setHeader(std::array<uint8_t, 4>{0x02, 0, 0, 0xfe});
+	co_await buffer.writeData(data, 4);
+	EXPECT_EQ(memory[0xfe], 0x0f);
+	EXPECT_EQ(memory[0xff], 0x0f);
+	EXPECT_EQ(memory[0x00], 0x0f);
+	EXPECT_EQ(memory[0x01], 0x0f);
+	EXPECT_EQ(memory[0x100], 0xff);
+	EXPECT_TRUE(flash.busy());
+	buffer.setHeader<uint8_t>(0x05);
+	co_await buffer.read(1);
+	EXPECT_EQ(buffer[0], 0x01);
+
+	// commands other than read status register get ignored while busy
+	buffer.setHeader<uint8_t>(0x06);
+	co_await buffer.write(0);
+	EXPECT_EQ(stats.ignoredCount, 2);
+
+	// poll the status register until the page program time has elapsed
+	do {
+		co_await loop.sleep(loop.now() + 1ms);
+		buffer.setHeader<uint8_t>(0x05);
+		co_await buffer.read(1);
+	} while ((buffer[0] & 1) != 0);
+	EXPECT_GE(SpiMaster_sim::now() - start, 2000000);
+	EXPECT_GE(stats.busyStatusCount, 1);
+
+	// bits can only be programmed from 1 to 0
+	buffer.setHeader<uint8_t>(0x06);
+	co_await buffer.write(0);
+	buffer.setHeader(std::array<uint8_t, 4>{0x02, 0, 0, 0xff});
+	co_await buffer.writeData("\xf3", 1);
+	EXPECT_EQ(memory[0xff], 0x03);
+	while (flash.busy())
+		co_await loop.sleep(loop.now() + 1ms);
+
+	// fast read with one dummy byte
+	buffer.setHeader(std::array<uint8_t, 5>{0x0b, 0, 0, 0xfe, 0});
+	co_await buffer.read(3);
+	EXPECT_EQ(buffer[0], 0x0f);
+	EXPECT_EQ(buffer[1], 0x03);
+	EXPECT_EQ(buffer[2], 0xff);
+
+	// sector erase sets the sector to 0xff
+	buffer.setHeader<uint8_t>(0x06);
+	co_await buffer.write(0);
+	buffer.setHeader(std::array<uint8_t, 4>{0x20, 0, 0x10, 0});
+	co_await buffer.write(0);
+	EXPECT_EQ(memory[0xff], 0x03);
+	buffer.setHeader(std::array<uint8_t, 4>{0x20, 0, 0, 0x80});
+	co_await buffer.write(0);
+	EXPECT_EQ(stats.ignoredCount, 3);
+	while (flash.busy())
+		co_await loop.sleep(loop.now() + 1ms);
+	buffer.setHeader<uint8_t>(0x06);
+	co_await buffer.write(0);
+	buffer.setHeader(std::array<uint8_t, 4>{0x20, 0, 0, 0x80});
+	co_await buffer.write(0);
+	EXPECT_EQ(memory[0xff], 0xff);
+	EXPECT_EQ(memory[0x00], 0xff);
+	EXPECT_TRUE(flash.busy());
+
+	EXPECT_EQ(stats.programCount, 2);
+	EXPECT_EQ(stats.programBytes, 5);
+	EXPECT_EQ(stats.eraseCount, 2);
+	EXPECT_EQ(stats.readCount, 1);
+
+	loop.exit();
+}
+
+TEST(cocoTest, SpiFlash_sim) {
+	// 64K flash, 2ms page program time, 5ms erase time
+	Loop_native loop;
+	SpiMaster_sim master(loop, 50000000);
+	SpiFlash_sim flash(65536, {2000, 5000, 5000, 5000, 5000});
+	SpiMaster_sim::Channel channel(master, flash);
+	SpiMaster_sim::Buffer buffer(channel, 5 + 16);
+
+	flashTest(loop, flash, buffer);
+	loop.run();
+}
+
+Coroutine usbBulkTest(Loop_native &loop, UsbDevice_sim &device, UsbDevice_sim::Buffer &deviceBuffer,
+	UsbDevice_sim::Buffer &hostBuffer)
+{
+	auto &stats = device.statistics();
+	for (int i = 0; i < 128; ++i)
+		deviceBuffer[i] = i;
+
+	// IN: a write gets split into packets of 64 bytes, the read of the host completes on the short packet
+	hostBuffer.startRead(hostBuffer.capacity());
+	co_await deviceBuffer.write(100);
+	co_await hostBuffer.untilReadyOrDisabled();
+	EXPECT_EQ(deviceBuffer.size(), 100);
+	EXPECT_EQ(hostBuffer.size(), 100);
+	EXPECT_EQ(hostBuffer[99], 99);
+	EXPECT_EQ(stats.packetCount, 2);
+	EXPECT_EQ(stats.shortPacketCount, 1);
+
+	// a write that ends with a full packet gets terminated with a zero length packet
+	hostBuffer.startRead(hostBuffer.capacity());
+	co_await deviceBuffer.write(128);
+	co_await hostBuffer.untilReadyOrDisabled();
+	EXPECT_EQ(hostBuffer.size(), 128);
+	EXPECT_EQ(stats.packetCount, 5);
+	EXPECT_EQ(stats.zeroLengthPacketCount, 1);
+
+	// a partial write transfers only full packets and no zero length packet, the host read continues
+	hostBuffer.startRead(hostBuffer.capacity());
+	co_await deviceBuffer.write(100, Buffer::Op::PARTIAL);
+	EXPECT_EQ(deviceBuffer.size(), 64);
+	EXPECT_TRUE(hostBuffer.busy());
+	std::memmove(deviceBuffer.data(), deviceBuffer.data() + 64, 36);
+	co_await deviceBuffer.write(36);
+	co_await hostBuffer.untilReadyOrDisabled();
+	EXPECT_EQ(hostBuffer.size(), 100);
+	EXPECT_EQ(hostBuffer[64], 64);
+	EXPECT_EQ(hostBuffer[99], 99);
+
+	// the host polls the device which answers with NAK while it has no data to send
+	hostBuffer.startRead(hostBuffer.capacity());
+	co_await loop.sleep(loop.now() + 5ms);
+	EXPECT_TRUE(hostBuffer.busy());
+	EXPECT_GT(stats.nakCount, 0);
+	hostBuffer.cancel();
+
+	// OUT: a write of the host that ends with a full packet gets terminated with a zero length packet
+	deviceBuffer.startRead(deviceBuffer.capacity());
+	co_await hostBuffer.write(64);
+	co_await deviceBuffer.untilReadyOrDisabled();
+	EXPECT_EQ(deviceBuffer.size(), 64);
+	EXPECT_EQ(stats.zeroLengthPacketCount, 2);
+	EXPECT_EQ(stats.byteCount, 100 + 128 + 100 + 64);
+
+	// disconnecting disables the buffers of both sides
+	hostBuffer.startRead(hostBuffer.capacity());
+	device.disconnect();
+	EXPECT_TRUE(hostBuffer.disabled());
+	EXPECT_TRUE(deviceBuffer.disabled());
+
+	loop.exit();
+}
+
+TEST(cocoTest, UsbDevice_sim) {
+	Loop_native loop;
+	UsbDevice_sim device(loop);
+	UsbDevice_sim::BulkEndpoint endpoint(device, 1, 64);
+	UsbDevice_sim::Buffer deviceBuffer(endpoint, 256);
+	UsbHost_sim host(device);
+	UsbHost_sim::BulkEndpoint hostEndpoint(host, 1);
+	UsbDevice_sim::Buffer hostBuffer(hostEndpoint, 256);
+	device.connect();
+	EXPECT_TRUE(hostBuffer.ready());
+
+	usbBulkTest(loop, device, deviceBuffer, hostBuffer);
+	loop.run();
+}
+
+// answers the control requests of the host
+Coroutine usbControlHandler(UsbDevice_sim &device, UsbDevice_sim::ControlBuffer &buffer, int requestCount) {
+	const uint8_t deviceDescriptor[] = {18, 1, 0x00, 0x02, 0, 0, 0, 64, 0x34, 0x12, 0x78, 0x56, 0x00, 0x01, 0, 0, 0, 1};
+	const uint8_t configurationDescriptor[] = {
+		9, 2, 32, 0, 1, 1, 0, 0x80, 50,
+		9, 4, 0, 0, 2, 0xff, 0, 0, 0,
+		7, 5, 0x81, 2, 64, 0, 0,
+		7, 5, 0x01, 2, 64, 0, 0};
+
+	for (int i = 0; i < requestCount; ++i) {
+		co_await device.untilRequest();
+		auto &setup = device.getRequest();
+		if (setup.request == 0x06 && (setup.value >> 8) == 1) {
+			co_await buffer.writeData(deviceDescriptor, sizeof(deviceDescriptor));
+		} else if (setup.request == 0x06 && (setup.value >> 8) == 2) {
+			co_await buffer.writeData(configurationDescriptor, sizeof(configurationDescriptor));
+		} else if (setup.request == 0x09) {
+			device.acknowledge();
+		} else if (setup.request == 0x42 && (setup.requestType & 0x80) == 0) {
+			// vendor request with data from host to device
+			co_await buffer.read();
+		} else {
+			device.stall();
+		}
+	}
+}
+
+Coroutine usbControlTest(Loop_native &loop, UsbDevice_sim &device, UsbHost_sim &host,
+	UsbHost_sim::ControlBuffer &buffer, UsbDevice_sim::ControlBuffer &deviceBuffer)
+{
+	auto &stats = device.statistics();
+
+	// enumeration: SET_ADDRESS gets handled by the device, the other requests by the application
+	co_await host.enumerate(buffer);
+	EXPECT_EQ(host.getConfiguration(), 1);
+	EXPECT_GT(host.getEnumerationTime(), 0);
+	EXPECT_EQ(device.getAddress(), 1);
+	EXPECT_EQ(stats.controlCount, 6);
+	EXPECT_EQ(stats.stallCount, 0);
+
+	// request from host to device with data stage
+	buffer.setHeader(UsbDevice_sim::Setup{0x40, 0x42, 0, 0, 0});
+	std::memcpy(buffer.data(), "abcd", 4);
+	co_await buffer.write(4);
+	EXPECT_FALSE(buffer.stalled());
+	EXPECT_EQ(buffer.size(), 4);
+	EXPECT_EQ(deviceBuffer.size(), 4);
+	EXPECT_EQ(std::memcmp(deviceBuffer.data(), "abcd", 4), 0);
+
+	// unsupported request gets stalled
+	buffer.setHeader(UsbDevice_sim::Setup{0xc0, 0x43, 0, 0, 16});
+	co_await buffer.read();
+	EXPECT_TRUE(buffer.stalled());
+	EXPECT_EQ(buffer.size(), 0);
+	EXPECT_EQ(stats.controlCount, 7);
+	EXPECT_EQ(stats.stallCount, 1);
+	EXPECT_GT(stats.averageControlLatency(), 0);
+
+	loop.exit();
+}
+
+TEST(cocoTest, UsbDevice_simControl) {
+	Loop_native loop;
+	UsbDevice_sim device(loop);
+	UsbDevice_sim::ControlBuffer deviceBuffer(device, 64);
+	UsbHost_sim host(device);
+	UsbHost_sim::ControlBuffer buffer(host, 256);
+	device.connect();
+
+	// 5 requests of the enumeration and 2 vendor requests
+	usbControlHandler(device, deviceBuffer, 7);
+	usbControlTest(loop, device, host, buffer, deviceBuffer);
+	loop.run();
+}
+
+Coroutine serialTest(Loop_native &loop, SerialPort_native &port, int master) {
+	auto &buffer = port.getBuffer(0);
+
+	// a pseudo terminal has no modem control lines
+	EXPECT_FALSE(port.hasSignals());
+	EXPECT_EQ(port.getSignals(), SerialPort_native::Signals::NONE);
+
+	// data written on the master side arrives at the port
+	EXPECT_EQ(::write(master, "foo", 3), 3);
+	co_await buffer.read(buffer.capacity());
+	EXPECT_EQ(buffer.string(), "foo");
+
+	// data written to the port arrives on the master side
+	co_await buffer.writeString("bar");
+	EXPECT_EQ(buffer.size(), 3);
+	char data[8];
+	EXPECT_EQ(::read(master, data, sizeof(data)), 3);
+	EXPECT_EQ(std::string(data, 3), "bar");
+
+	// closing the device disables pending reads
+	buffer.startRead(buffer.capacity());
+	port.close();
+	EXPECT_TRUE(buffer.disabled());
+
+	loop.exit();
+}
+
+TEST(cocoTest, SerialPort_native) {
+	// pseudo terminal as serial port
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	ASSERT_NE(master, -1);
+	ASSERT_EQ(grantpt(master), 0);
+	ASSERT_EQ(unlockpt(master), 0);
+
+	Loop_native loop;
+	SerialPort_native port(loop);
+	SerialPort_native::Buffer buffer(port, 16);
+	EXPECT_TRUE(port.open(ptsname(master), 115200));
+	EXPECT_TRUE(buffer.ready());
+
+	serialTest(loop, port, master);
+	loop.run();
+	close(master);
+}
+
+Coroutine radioTest(Loop_native &loop, RadioMedium_sim &medium, RadioMedium_sim::Node &node1,
+	RadioMedium_sim::Node &node2, RadioMedium_sim::Node &node3, RadioMedium_sim &lossyMedium,
+	RadioMedium_sim::Node &lossy1, RadioMedium_sim::Node &lossy2)
+{
+	auto &stats = medium.statistics();
+	auto &w1 = node1.getBuffer(0);
+	auto &r1 = node1.getBuffer(1);
+	auto &w2 = node2.getBuffer(0);
+	auto &r2 = node2.getBuffer(1);
+	auto &r3 = node3.getBuffer(1);
+
+	// the airtime is 1ms per byte, the packet is received by all other nodes that listen
+	r2.startRead(r2.capacity());
+	int64_t start = RadioMedium_sim::now();
+	std::memcpy(w1.data(), "0123456789", 10);
+	w1.startWrite(10);
+	EXPECT_TRUE(node2.channelBusy());
+	co_await w1.untilReadyOrDisabled();
+	EXPECT_GE(RadioMedium_sim::now() - start, 10000000);
+	EXPECT_FALSE(node2.channelBusy());
+	EXPECT_TRUE(r2.ready());
+	EXPECT_EQ(r2.string(), "0123456789");
+	EXPECT_EQ(stats.transmitCount, 1);
+	EXPECT_EQ(stats.receiveCount, 1);
+	EXPECT_EQ(stats.missCount, 1);
+	EXPECT_EQ(stats.transmitBytes, 10);
+	EXPECT_EQ(stats.receiveBytes, 10);
+	EXPECT_EQ(stats.busyTime, 10000000);
+
+	// overlapping packets collide, the transmitting nodes don't receive the packet of the other node (half-duplex)
+	medium.resetStatistics();
+	r1.startRead(r1.capacity());
+	r2.startRead(r2.capacity());
+	r3.startRead(r3.capacity());
+	std::memcpy(w2.data(), "abcde", 5);
+	w1.startWrite(10);
+	w2.startWrite(5);
+	co_await w1.untilReadyOrDisabled();
+	EXPECT_TRUE(w2.ready());
+	EXPECT_TRUE(r1.busy());
+	EXPECT_TRUE(r2.busy());
+	EXPECT_TRUE(r3.busy());
+	EXPECT_EQ(stats.transmitCount, 2);
+	EXPECT_EQ(stats.collisionCount, 2);
+	EXPECT_EQ(stats.receiveCount, 0);
+	EXPECT_EQ(stats.busyTime, 10000000);
+
+	r1.cancel();
+	r2.cancel();
+	r3.cancel();
+
+	// packets get lost with the given probability
+	auto &lossyStats = lossyMedium.statistics();
+	auto &lossyWrite = lossy1.getBuffer(0);
+	auto &lossyRead = lossy2.getBuffer(1);
+	lossyRead.startRead(lossyRead.capacity());
+	for (int i = 0; i < 20; ++i) {
+		co_await lossyWrite.writeData("x", 1);
+		if (lossyRead.ready())
+			lossyRead.startRead(lossyRead.capacity());
+	}
+	lossyRead.cancel();
+	EXPECT_EQ(lossyStats.transmitCount, 20);
+	EXPECT_EQ(lossyStats.receiveCount + lossyStats.lossCount, 20);
+	EXPECT_GT(lossyStats.receiveCount, 0);
+	EXPECT_GT(lossyStats.lossCount, 0);
+
+	loop.exit();
+}
+
+TEST(cocoTest, RadioMedium_sim) {
+	Loop_native loop;
+
+	// 1ms airtime per byte and no PHY overhead
+	RadioMedium_sim medium(loop, 8000, 0);
+	RadioMedium_sim::Node node1(medium);
+	RadioMedium_sim::Node node2(medium);
+	RadioMedium_sim::Node node3(medium);
+	RadioMedium_sim::Buffer w1(node1, 16);
+	RadioMedium_sim::Buffer r1(node1, 16);
+	RadioMedium_sim::Buffer w2(node2, 16);
+	RadioMedium_sim::Buffer r2(node2, 16);
+	RadioMedium_sim::Buffer w3(node3, 16);
+	RadioMedium_sim::Buffer r3(node3, 16);
+
+	RadioMedium_sim lossyMedium(loop, 8000, 0, 0.5f);
+	RadioMedium_sim::Node lossy1(lossyMedium);
+	RadioMedium_sim::Node lossy2(lossyMedium);
+	RadioMedium_sim::Buffer lw1(lossy1, 16);
+	RadioMedium_sim::Buffer lw2(lossy2, 16);
+	RadioMedium_sim::Buffer lr2(lossy2, 16);
+
+	radioTest(loop, medium, node1, node2, node3, lossyMedium, lossy1, lossy2);
+	loop.run();
+}
+
+Coroutine streamTest(Loop_native &loop, PeriodicStream_sim &stream, PeriodicStream_sim::Buffer &buffer1,
+	PeriodicStream_sim::Buffer &buffer2)
+{
+	auto &stats = stream.statistics();
+
+	// capture with two buffers, the data is a counter
+	auto *b1 = &buffer1;
+	auto *b2 = &buffer2;
+	b1->startRead(b1->capacity());
+	b2->startRead(b2->capacity());
+	for (int i = 0; i < 4; ++i) {
+		co_await b1->untilReadyOrDisabled();
+		EXPECT_EQ(b1->size(), 10);
+		for (int j = 1; j < b1->size(); ++j) {
+			EXPECT_EQ((*b1)[j], uint8_t((*b1)[0] + j));
+		}
+		EXPECT_GE(b1->margin(), 0);
+		b1->startRead(b1->capacity());
+		std::swap(b1, b2);
+	}
+
+	// no read buffer queued for three periods: overruns
+	buffer1.cancel();
+	buffer2.cancel();
+	int overrunCount = stats.overrunCount;
+	std::this_thread::sleep_for(std::chrono::milliseconds(35));
+	co_await buffer1.read(buffer1.capacity());
+	EXPECT_GE(stats.overrunCount - overrunCount, 3);
+
+	// a capture-only stream does not count underruns
+	EXPECT_EQ(stats.underrunCount, 0);
+	EXPECT_EQ(stats.writeCount, 0);
+	EXPECT_GE(stats.readCount, 5);
+	EXPECT_GE(stats.minMargin, 0);
+
+	// reopen for playback
+	stream.close();
+	EXPECT_TRUE(buffer1.disabled());
+	stream.open();
+	co_await buffer1.write(buffer1.capacity());
+
+	// no write buffer queued for three periods: underruns
+	std::this_thread::sleep_for(std::chrono::milliseconds(35));
+	co_await buffer1.write(buffer1.capacity());
+	EXPECT_GE(stats.underrunCount, 3);
+	EXPECT_EQ(stats.overrunCount, 0);
+	EXPECT_EQ(stats.writeCount, 2);
+	EXPECT_EQ(stats.slackCount, 1);
+
+	stream.close();
+	loop.exit();
+}
+
+TEST(cocoTest, PeriodicStream_sim) {
+	// period of 10 bytes and 10ms
+	Loop_native loop;
+	PeriodicStream_sim stream(loop, 1000, 1, 10);
+	PeriodicStream_sim::Buffer buffer1(stream);
+	PeriodicStream_sim::Buffer buffer2(stream);
+	EXPECT_EQ(stream.periodDuration(), 10000000);
+	stream.open();
+
+	streamTest(loop, stream, buffer1, buffer2);
+	loop.run();
+	EXPECT_TRUE(stream.disabled());
+}
+
+TEST(cocoTest, Framebuffer) {
+	uint8_t buffer[16];
+	TestBuffer b(buffer, 16);
+	TestDevice device(b);
+	Framebuffer f(device, 16, 16, 2, 2);
+
+	// initially the whole frame is dirty
+	EXPECT_EQ(f.update(), 1);
+	EXPECT_EQ(f.rectangles()[0].width, 16);
+	EXPECT_EQ(f.rectangles()[0].height, 16);
+
+	// nothing has changed
+	f.update();
+	f.update();
+	EXPECT_EQ(f.rectangles().size(), 0);
+
+	// adjacent changed rows get combined, the maximum number of rectangles merges the rest
+	f.row(1)[3] = 1;
+	f.row(2)[20] = 1;
+	f.row(5)[10] = 1;
+	f.row(9)[31] = 1;
+	EXPECT_EQ(f.update(), 2);
+	auto r = f.rectangles();
+	EXPECT_EQ(r[0].x, 1);
+	EXPECT_EQ(r[0].y, 1);
+	EXPECT_EQ(r[0].width, 10);
+	EXPECT_EQ(r[0].height, 2);
+	EXPECT_EQ(r[1].x, 5);
+	EXPECT_EQ(r[1].y, 5);
+	EXPECT_EQ(r[1].width, 11);
+	EXPECT_EQ(r[1].height, 5);
+}
+
+// register file that is accessed using the header as address and completes immediately
+class RegisterBuffer : public Buffer {
+public:
+	RegisterBuffer() : Buffer(data, 1, 16, State::READY) {}
+
+	bool start(Op op) override {
+		int address = this->data[0];
+		if ((op & Op::READ) != 0)
+			std::copy(this->registers + address, this->registers + address + size(), this->data + 1);
+		else
+			std::copy(this->data + 1, this->data + 1 + size(), this->registers + address);
+		++this->transferCount;
+		return true;
+	}
+
+	bool cancel() override {
+		return false;
+	}
+
+	uint8_t data[17];
+	uint8_t registers[256] = {};
+	int transferCount = 0;
+};
+
+Coroutine flushTest(Loop_native &loop, Framebuffer &f, SpiDisplay_sim &display) {
+	int size = f.stride() * f.height();
+
+	// initial flush sends the whole frame
+	for (int i = 0; i < size; ++i) {
+		f.data()[i] = i * 7;
+	}
+	co_await f.flush();
+	EXPECT_EQ(std::memcmp(display.data(), f.data(), size), 0);
+	EXPECT_EQ(display.statistics().windowCount, 1);
+	EXPECT_EQ(display.statistics().ignoredBytes, 0);
+
+	// only the changed rectangles get sent, rows are split across buffers
+	f.row(3)[4] = 1;
+	f.row(3)[25] = 2;
+	f.row(10)[31] = 3;
+	co_await f.flush();
+	EXPECT_EQ(std::memcmp(display.data(), f.data(), size), 0);
+	EXPECT_EQ(display.statistics().windowCount, 3);
+	EXPECT_EQ(display.statistics().pixelCount, 16 * 16 + 11 + 1);
+	EXPECT_EQ(f.statistics().rectangleCount, 3);
+
+	loop.exit();
+}
+
+TEST(cocoTest, FramebufferFlush) {
+	Loop_native loop;
+	SpiMaster_sim master(loop, 100000000);
+	SpiDisplay_sim display(16, 16, 2);
+	SpiMaster_sim::Channel channel(master, display);
+	SpiMaster_sim::Buffer buffer1(channel, 10);
+	SpiMaster_sim::Buffer buffer2(channel, 10);
+	Framebuffer f(channel, 16, 16, 2);
+
+	flushTest(loop, f, display);
+	loop.run();
+}
+
+TEST(cocoTest, RegisterCache) {
+	RegisterBuffer bus;
+	RegisterCache cache(32);
+	cache.setMode(0x10, 4, RegisterCache::Mode::VOLATILE);
+	RegisterCache::Buffer b(cache, bus);
+
+	// first read goes to the bus, second read is served from the cache
+	bus.registers[2] = 5;
+	b.setHeader<uint8_t>(2);
+	b.startRead(2);
+	EXPECT_EQ(b[0], 5);
+	bus.registers[2] = 6;
+	b.startRead(2);
+	EXPECT_EQ(b[0], 5);
+	EXPECT_EQ(bus.transferCount, 1);
+
+	// write-through, a write of the same value gets suppressed
+	b[0] = 7;
+	b.startWrite(1);
+	EXPECT_EQ(bus.registers[2], 7);
+	b.startWrite(1);
+	EXPECT_EQ(bus.transferCount, 2);
+
+	// volatile registers always go to the bus
+	b.setHeader<uint8_t>(0x10);
+	b.startRead(1);
+	b.startRead(1);
+	EXPECT_EQ(bus.transferCount, 4);
+
+	auto &stats = cache.statistics();
+	EXPECT_EQ(stats.hitCount, 1);
+	EXPECT_EQ(stats.suppressedCount, 1);
+	EXPECT_EQ(stats.transferCount(), 4);
+
+	// addresses beyond the number of registers are not cached
+	RegisterCache small(16);
+	RegisterCache::Buffer b2(small, bus);
+	b2.setHeader<uint8_t>(20);
+	b2.startRead(2);
+	b2.startRead(2);
+	EXPECT_EQ(bus.transferCount, 6);
+	EXPECT_EQ(small.statistics().hitCount, 0);
+}
+
+Coroutine mergeTest(Loop_native &loop, WriteMerger &merger, RegisterBuffer &bus) {
+	WriteMerger::Buffer b1(merger, 1, 8);
+	WriteMerger::Buffer b2(merger, 1, 8);
+	WriteMerger::Buffer b3(merger, 1, 4);
+	WriteMerger::Buffer large(merger, 1, 20);
+	auto &stats = merger.statistics();
+
+	// writes to contiguous addresses get merged
+	b1.setHeader<uint8_t>(0x02);
+	b1.startWriteArray(std::array<uint8_t, 2>{1, 2});
+	b2.setHeader<uint8_t>(0x04);
+	b2.startWriteArray(std::array<uint8_t, 2>{3, 4});
+	co_await b2.untilReadyOrDisabled();
+	EXPECT_TRUE(b1.ready());
+	EXPECT_EQ(b1.size(), 2);
+	EXPECT_EQ(b2.size(), 2);
+	EXPECT_EQ(bus.transferCount, 1);
+	EXPECT_EQ(bus.registers[2], 1);
+	EXPECT_EQ(bus.registers[5], 4);
+	EXPECT_EQ(stats.mergedCount, 1);
+
+	// a gap or different flags end the burst
+	b1.setHeader<uint8_t>(0x08);
+	b1.startWriteArray(std::array<uint8_t, 1>{5});
+	b2.setHeader<uint8_t>(0x0a);
+	b2.startWriteArray(std::array<uint8_t, 1>{6});
+	b3.setHeader<uint8_t>(0x8b);
+	b3.startWriteArray(std::array<uint8_t, 1>{7});
+	co_await b3.untilReadyOrDisabled();
+	EXPECT_EQ(bus.transferCount, 4);
+	EXPECT_EQ(bus.registers[0x8b], 7);
+	EXPECT_EQ(stats.mergedCount, 1);
+
+	// the capacity of the bus buffer limits the burst, a transfer that does not fit fails
+	b1.setHeader<uint8_t>(0x10);
+	b1.startWrite(8);
+	b2.setHeader<uint8_t>(0x18);
+	b2.startWrite(8);
+	b3.setHeader<uint8_t>(0x20);
+	b3.startWrite(4);
+	large.setHeader<uint8_t>(0x24);
+	large.startWrite(20);
+	co_await large.untilReadyOrDisabled();
+	EXPECT_EQ(bus.transferCount, 6);
+	EXPECT_EQ(stats.mergedCount, 2);
+	EXPECT_EQ(b3.size(), 4);
+	EXPECT_EQ(large.size(), 0);
+
+	// reads are not merged and return the value of a preceding write
+	b1.setHeader<uint8_t>(0x30);
+	b1.startWriteArray(std::array<uint8_t, 1>{9});
+	b2.setHeader<uint8_t>(0x30);
+	b2.startRead(1);
+	b3.setHeader<uint8_t>(0x31);
+	b3.startWriteArray(std::array<uint8_t, 1>{10});
+	co_await b3.untilReadyOrDisabled();
+	EXPECT_EQ(bus.transferCount, 9);
+	EXPECT_EQ(b2.size(), 1);
+	EXPECT_EQ(b2[0], 9);
+
+	// a queued transfer can be cancelled
+	b1.setHeader<uint8_t>(0x40);
+	b1.startWriteArray(std::array<uint8_t, 1>{11});
+	b2.setHeader<uint8_t>(0x41);
+	b2.startWriteArray(std::array<uint8_t, 1>{12});
+	EXPECT_TRUE(b2.cancel());
+	EXPECT_TRUE(b2.ready());
+	EXPECT_EQ(b2.size(), 0);
+	co_await b1.untilReadyOrDisabled();
+	EXPECT_EQ(bus.transferCount, 10);
+	EXPECT_EQ(bus.registers[0x40], 11);
+	EXPECT_EQ(bus.registers[0x41], 0);
+
+	EXPECT_EQ(stats.writeCount, 13);
+	EXPECT_EQ(stats.readCount, 1);
+	EXPECT_EQ(stats.transferCount, 10);
+	loop.exit();
+}
+
+TEST(cocoTest, WriteMerger) {
+	Loop_native loop;
+	RegisterBuffer bus;
+	WriteMerger merger(loop, bus);
+
+	mergeTest(loop, merger, bus);
+	loop.run();
+}
+
+TEST(cocoTest, PageCache) {
+	RegisterBuffer storage;
+	for (int i = 0; i < 32; ++i)
+		storage.registers[i] = i;
+	TestDevice device(storage);
+	// writes go to the registers starting at 128 to check that the operation gets passed to the function
+	PageCache cache(device, 8, [](Buffer &buffer, Buffer::Op op, uint32_t address) {
+		buffer.setHeader<uint8_t>((op & Buffer::Op::WRITE) != 0 ? 128 + address : address);
+	}, 1);
+	PageCache::Buffer b(cache, 8);
+
+	// first read loads the page, second read hits and triggers read-ahead of the next page
+	b.setHeader<uint32_t>(0);
+	b.startRead(4);
+	EXPECT_EQ(b[3], 3);
+	b.setHeader<uint32_t>(4);
+	b.startRead(4);
+	EXPECT_EQ(b[3], 7);
+	EXPECT_EQ(storage.transferCount, 2);
+
+	// read of the prefetched page hits and prefetches the following page
+	b.setHeader<uint32_t>(8);
+	b.startRead(8);
+	EXPECT_EQ(b[7], 15);
+	EXPECT_EQ(storage.transferCount, 3);
+
+	auto &stats = cache.statistics();
+	EXPECT_EQ(stats.readCount, 3);
+	EXPECT_EQ(stats.hitCount, 2);
+	EXPECT_EQ(stats.prefetchHitCount, 1);
+
+	// a write that is larger than a page gets split at the page boundaries and invalidates the pages
+	PageCache::Buffer w(cache, 16);
+	for (int i = 0; i < 12; ++i)
+		w[i] = 100 + i;
+	w.setHeader<uint32_t>(4);
+	w.startWrite(12);
+	EXPECT_TRUE(w.ready());
+	EXPECT_EQ(w.size(), 12);
+	for (int i = 0; i < 12; ++i)
+		EXPECT_EQ(storage.registers[128 + 4 + i], 100 + i);
+	EXPECT_EQ(stats.writeCount, 2);
+	EXPECT_EQ(storage.transferCount, 5);
+	b.setHeader<uint32_t>(8);
+	b.startRead(8);
+	EXPECT_EQ(stats.missCount, 2);
+
+	// reads and writes complete when no page can be used because the device is disabled
+	ManualBuffer page;
+	TestDevice closed(page);
+	PageCache cache2(closed, 8, [](Buffer &buffer, Buffer::Op op, uint32_t address) {}, 0);
+	PageCache::Buffer b2(cache2, 8);
+	page.disable();
+	b2.setHeader<uint32_t>(0);
+	b2.startRead(4);
+	EXPECT_TRUE(b2.ready());
+	EXPECT_EQ(b2.size(), 0);
+	b2.startWrite(4);
+	EXPECT_TRUE(b2.ready());
+	EXPECT_EQ(b2.size(), 0);
+}
+
+Coroutine waitAllAny(ManualBuffer &b1, ManualBuffer &b2, ManualBuffer &b3, int &step) {
+	co_await whenAll(b1.read(4), b2.read(4), b3.read(4));
+	step = 1;
+	step = 10 + co_await whenAny(b1.read(4), b2.read(4), b3.read(4));
+}
+
+class StorageBuffer : public Buffer {
+public:
+	StorageBuffer(uint8_t *memory) : Buffer(data, 4, 16, State::READY), memory(memory) {}
+
+	bool start(Op op) override {
+		// transfers complete immediately, a failed transfer transfers nothing
+		auto address = header<uint32_t>();
+		if (this->fail)
+			resize(0);
+		else if ((op & Op::READ) != 0)
+			std::copy(this->memory + address, this->memory + address + size(), this->data + 4);
+		else
+			std::copy(this->data + 4, this->data + 4 + size(), this->memory + address);
+		++this->transferCount;
+		return true;
+	}
+
+	bool cancel() override {
+		return false;
+	}
+
+	void disable() {
+		setDisabled();
+	}
+
+	uint8_t data[20];
+	uint8_t *memory;
+	bool fail = false;
+	int transferCount = 0;
+};
+
+class StorageDevice : public BufferDevice {
+public:
+	StorageDevice() : BufferDevice(State::READY), buffer1(memory), buffer2(memory) {}
+
+	int getBufferCount() override {return 2;}
+	Buffer &getBuffer(int index) override {return index == 0 ? this->buffer1 : this->buffer2;}
+
+	uint8_t memory[64] = {};
+	StorageBuffer buffer1;
+	StorageBuffer buffer2;
+};
+
+Coroutine writeBackTest(Loop_native &loop, WriteBackCache &cache, StorageDevice &storage) {
+	WriteBackCache::Buffer b(cache, 8);
+	auto &stats = cache.statistics();
+
+	// writes to the same page get coalesced
+	b.setHeader<uint32_t>(0);
+	co_await b.writeArray(std::array<uint8_t, 2>{1, 2});
+	b.setHeader<uint32_t>(2);
+	co_await b.writeArray(std::array<uint8_t, 2>{3, 4});
+	EXPECT_EQ(stats.loadCount, 1);
+	EXPECT_EQ(stats.coalescedCount, 1);
+	EXPECT_EQ(cache.dirtyCount(), 1);
+	EXPECT_EQ(storage.memory[0], 0);
+
+	// a completely written page gets flushed
+	b.setHeader<uint32_t>(4);
+	co_await b.writeArray(std::array<uint8_t, 4>{5, 6, 7, 8});
+	EXPECT_EQ(stats.fullCount, 1);
+	EXPECT_EQ(cache.dirtyCount(), 0);
+	EXPECT_EQ(storage.memory[0], 1);
+	EXPECT_EQ(storage.memory[7], 8);
+
+	// reads return the written data
+	b.setHeader<uint32_t>(2);
+	co_await b.read(2);
+	EXPECT_EQ(b[0], 3);
+
+	// the least recently used dirty page gets evicted when all pages are dirty
+	b.setHeader<uint32_t>(8);
+	co_await b.writeArray(std::array<uint8_t, 1>{9});
+	b.setHeader<uint32_t>(16);
+	co_await b.writeArray(std::array<uint8_t, 1>{10});
+	b.setHeader<uint32_t>(24);
+	co_await b.writeArray(std::array<uint8_t, 1>{11});
+	EXPECT_EQ(b.size(), 1);
+	EXPECT_EQ(stats.evictCount, 1);
+	EXPECT_EQ(storage.memory[8], 9);
+	EXPECT_EQ(storage.memory[16], 0);
+	EXPECT_EQ(cache.dirtyCount(), 2);
+
+	// dirty pages get flushed on timeout
+	co_await loop.sleep(loop.now() + 30ms);
+	EXPECT_EQ(stats.timeoutCount, 2);
+	EXPECT_EQ(cache.dirtyCount(), 0);
+	EXPECT_EQ(storage.memory[16], 10);
+	EXPECT_EQ(storage.memory[24], 11);
+
+	// writing the first and last byte does not write the page completely, sync() flushes all dirty pages
+	b.setHeader<uint32_t>(32);
+	co_await b.writeArray(std::array<uint8_t, 1>{12});
+	b.setHeader<uint32_t>(39);
+	co_await b.writeArray(std::array<uint8_t, 1>{15});
+	EXPECT_EQ(stats.fullCount, 1);
+	EXPECT_EQ(cache.dirtyCount(), 1);
+	co_await cache.sync();
+	EXPECT_EQ(stats.syncCount, 1);
+	EXPECT_EQ(cache.dirtyCount(), 0);
+	EXPECT_EQ(storage.memory[32], 12);
+	EXPECT_EQ(storage.memory[39], 15);
+
+	// a page stays dirty when its write fails
+	b.setHeader<uint32_t>(40);
+	co_await b.writeArray(std::array<uint8_t, 1>{13});
+	storage.buffer1.fail = true;
+	storage.buffer2.fail = true;
+	co_await cache.sync();
+	EXPECT_EQ(stats.failedCount, 1);
+	EXPECT_EQ(cache.dirtyCount(), 1);
+	EXPECT_EQ(storage.memory[40], 0);
+	storage.buffer1.fail = false;
+	storage.buffer2.fail = false;
+	co_await cache.sync();
+	EXPECT_EQ(cache.dirtyCount(), 0);
+	EXPECT_EQ(storage.memory[40], 13);
+
+	// sync() returns when the storage device is disabled
+	b.setHeader<uint32_t>(48);
+	co_await b.writeArray(std::array<uint8_t, 1>{14});
+	storage.buffer1.disable();
+	storage.buffer2.disable();
+	co_await cache.sync();
+	EXPECT_EQ(cache.dirtyCount(), 1);
+
+	EXPECT_EQ(stats.flushCount(), 7);
+	loop.exit();
+}
+
+TEST(cocoTest, WriteBackCache) {
+	Loop_native loop;
+	StorageDevice storage;
+	WriteBackCache cache(loop, storage, 8, 10ms);
+
+	writeBackTest(loop, cache, storage);
+	loop.run();
+}
+
+Coroutine streamWriterTest(Loop_native &loop, StreamWriter &writer, ManualDevice &device) {
+	auto &b1 = device.buffer1;
+	auto &b2 = device.buffer2;
+	auto &stats = writer.statistics();
+	const uint8_t data[16] = {'h', 'e', 'l', 'l', 'o', 'w', 'o', 'r', 'l', 'd'};
+
+	// small writes get coalesced, the buffer gets started with Op::PARTIAL when the next write does not fit
+	EXPECT_TRUE(writer.write(data, 5));
+	EXPECT_TRUE(writer.write(data + 5, 5));
+	EXPECT_TRUE(b1.ready());
+	EXPECT_TRUE(writer.write(data, 8));
+	EXPECT_TRUE(b1.busy());
+	EXPECT_EQ(b1.size(), 10);
+	EXPECT_EQ(std::memcmp(b1.data, data, 10), 0);
+	EXPECT_TRUE((b1.op & Buffer::Op::PARTIAL) != 0);
+	EXPECT_EQ(stats.fullCount, 1);
+	b1.complete(10);
+
+	// the latency budget starts the buffer without Op::PARTIAL
+	co_await loop.sleep(loop.now() + 20ms);
+	EXPECT_TRUE(b2.busy());
+	EXPECT_EQ(b2.size(), 8);
+	EXPECT_TRUE((b2.op & Buffer::Op::PARTIAL) == 0);
+	EXPECT_EQ(stats.timeoutCount, 1);
+
+	// a full buffer gets started immediately, the next write stalls until a buffer is available
+	EXPECT_TRUE(writer.write(data, 16));
+	EXPECT_TRUE(b1.busy());
+	EXPECT_EQ(stats.fullCount, 2);
+	EXPECT_FALSE(writer.write(data, 4));
+	EXPECT_EQ(stats.stallCount, 1);
+	b2.complete(8);
+	co_await writer.untilAvailable();
+	EXPECT_TRUE(writer.write(data, 4));
+
+	// flush starts the current buffer and waits for all transfers
+	auto flush = writer.flush();
+	EXPECT_TRUE(b2.busy());
+	EXPECT_EQ(b2.size(), 4);
+	EXPECT_TRUE((b2.op & Buffer::Op::PARTIAL) == 0);
+	b1.complete(16);
+	b2.complete(4);
+	co_await flush;
+	EXPECT_EQ(stats.flushCount, 1);
+	EXPECT_EQ(stats.transferCount(), 4);
+	EXPECT_EQ(stats.byteCount, 38);
+
+	loop.exit();
+}
+
+TEST(cocoTest, StreamWriter) {
+	Loop_native loop;
+	ManualDevice device;
+	StreamWriter writer(loop, device, 5ms);
+
+	streamWriterTest(loop, writer, device);
+	loop.run();
+}
+
+Coroutine streamReaderTest(StreamReader &reader, int &step) {
+	uint8_t storage[16];
+	Array<const uint8_t> view;
+
+	// a line that is contained in one buffer is returned as view of the buffer
+	co_await reader.readUntil('\n', storage, sizeof(storage), view);
+	EXPECT_EQ(std::string(view.begin(), view.end()), "ab\n");
+	EXPECT_NE(view.data(), storage);
+	step = 1;
+
+	// a line across buffers gets copied
+	co_await reader.readUntil('\n', storage, sizeof(storage), view);
+	EXPECT_EQ(std::string(view.begin(), view.end()), "cdef\n");
+	EXPECT_EQ(view.data(), storage);
+	step = 2;
+
+	// peek across buffers does not consume the data
+	co_await reader.peek(4, storage, view);
+	EXPECT_EQ(std::string(view.begin(), view.end()), "ghij");
+	step = 3;
+	co_await reader.read(4, storage, view);
+	EXPECT_EQ(std::string(view.begin(), view.end()), "ghij");
+	EXPECT_EQ(view.data(), storage);
+	co_await reader.read(2, storage, view);
+	EXPECT_EQ(std::string(view.begin(), view.end()), "kl");
+	EXPECT_NE(view.data(), storage);
+	step = 4;
+
+	// data that was consumed before the device gets disabled is returned
+	co_await reader.read(4, storage, view);
+	EXPECT_EQ(std::string(view.begin(), view.end()), "mn");
+	EXPECT_EQ(view.data(), storage);
+	step = 5;
+
+	// the view is empty when the device is disabled
+	co_await reader.readUntil('\n', storage, sizeof(storage), view);
+	EXPECT_EQ(view.size(), 0);
+	step = 6;
+}
+
+TEST(cocoTest, StreamReader) {
+	ManualDevice device;
+	auto &b1 = device.buffer1;
+	auto &b2 = device.buffer2;
+	StreamReader reader(device);
+	reader.start();
+	EXPECT_TRUE(b1.busy());
+	EXPECT_TRUE(b2.busy());
+
+	int step = 0;
+	streamReaderTest(reader, step);
+	std::memcpy(b1.data, "ab\ncd", 5);
+	b1.complete(5);
+	EXPECT_EQ(step, 1);
+	EXPECT_TRUE(b1.busy());
+	std::memcpy(b2.data, "ef\ngh", 5);
+	b2.complete(5);
+	EXPECT_EQ(step, 2);
+	std::memcpy(b1.data, "ijkl", 4);
+	b1.complete(4);
+	EXPECT_EQ(step, 4);
+	EXPECT_TRUE(b2.busy());
+	std::memcpy(b2.data, "mn", 2);
+	b2.complete(2);
+	EXPECT_EQ(step, 4);
+	b1.disable();
+	b2.disable();
+	EXPECT_EQ(step, 6);
+
+	auto &stats = reader.statistics();
+	EXPECT_EQ(stats.byteCount, 16);
+	EXPECT_EQ(stats.viewCount, 2);
+	EXPECT_EQ(stats.copyCount, 4);
+	EXPECT_EQ(stats.transferCount, 6);
+}
+
+Coroutine readSequenceTest(ReadSequence &reads, std::vector<int> &values) {
+	while (true) {
+		co_await reads.next();
+		if (!reads)
+			break;
+		values.push_back(reads->data()[0]);
+	}
+}
+
+TEST(cocoTest, ReadSequence) {
+	ManualDevice device;
+	auto &b1 = device.buffer1;
+	auto &b2 = device.buffer2;
+	ReadSequence reads(device, 4);
+	std::vector<int> values;
+
+	// all buffers get started, completed reads are processed in the order in which the buffers were started
+	readSequenceTest(reads, values);
+	EXPECT_TRUE(b1.busy());
+	EXPECT_TRUE(b2.busy());
+	b2.data[0] = 2;
+	b2.complete(4);
+	EXPECT_TRUE(values.empty());
+	b1.data[0] = 1;
+	b1.complete(4);
+	EXPECT_EQ(values, std::vector<int>({1, 2}));
+
+	// processed buffers are started again
+	EXPECT_TRUE(b1.busy());
+	EXPECT_TRUE(b2.busy());
+	b1.data[0] = 3;
+	b1.complete(4);
+	EXPECT_EQ(values, std::vector<int>({1, 2, 3}));
+
+	// the loop ends when the device gets disabled
+	b1.disable();
+	b2.disable();
+	EXPECT_EQ(values.size(), 3);
+
+	auto &stats = reads.statistics();
+	EXPECT_EQ(stats.readCount, 3);
+	EXPECT_EQ(stats.byteCount, 12);
+	EXPECT_EQ(stats.waitCount, 3);
+
+	// after the device was enabled again, all buffers get started
+	b1.enable();
+	b2.enable();
+	readSequenceTest(reads, values);
+	EXPECT_TRUE(b1.busy());
+	EXPECT_TRUE(b2.busy());
+	EXPECT_EQ(b1.size(), 4);
+	b1.data[0] = 4;
+	b1.complete(4);
+	EXPECT_EQ(values.back(), 4);
+	b1.disable();
+	b2.disable();
+}
+
+TEST(cocoTest, WhenAll) {
+	ManualBuffer b1;
+	ManualBuffer b2;
+	ManualBuffer b3;
+	int step = 0;
+	waitAllAny(b1, b2, b3, step);
+
+	// whenAll() completes when the last buffer is ready
+	b2.complete(4);
+	b1.complete(4);
+	EXPECT_EQ(step, 0);
+	b3.complete(4);
+	EXPECT_EQ(step, 1);
+
+	// whenAny() completes when the first buffer is ready and returns its index
+	b3.complete(4);
+	EXPECT_EQ(step, 12);
+	b1.complete(4);
+	b2.complete(4);
+	EXPECT_EQ(step, 12);
+}
+
+Coroutine waitIdle(CancelScope &scope, bool &idle) {
+	co_await scope.untilIdle();
+	idle = true;
+}
+
+Coroutine addOnReady(CancelScope &scope, Buffer &buffer, Buffer &other, bool &added) {
+	co_await buffer.untilReadyOrDisabled();
+	added = scope.add(other);
+}
+
+TEST(cocoTest, CancelScope) {
+	ManualBuffer b1;
+	ManualBuffer b2;
+	ManualBuffer b3;
+	CancelScope session(4);
+	CancelScope control(session, 2);
+	EXPECT_TRUE(session.start(b1, Buffer::Op::READ));
+	EXPECT_TRUE(control.start(b2, Buffer::Op::READ));
+	EXPECT_TRUE(control.start(b3, Buffer::Op::WRITE));
+	EXPECT_EQ(session.busyCount(), 3);
+
+	// cancelling the child scope only cancels its own buffers
+	b3.complete(4);
+	EXPECT_EQ(control.cancel(), 1);
+	EXPECT_TRUE(b2.ready());
+	EXPECT_TRUE(b1.busy());
+	EXPECT_FALSE(control.start(b2, Buffer::Op::READ));
+
+	// cancelling the parent scope cancels all buffers and untilIdle() completes
+	control.reset();
+	EXPECT_TRUE(control.start(b2, Buffer::Op::READ));
+	bool idle = false;
+	waitIdle(session, idle);
+	EXPECT_FALSE(idle);
+	EXPECT_EQ(session.cancel(), 2);
+	EXPECT_TRUE(idle);
+	EXPECT_TRUE(control.cancelled());
+	EXPECT_EQ(session.busyCount(), 0);
+
+	// a coroutine that gets resumed by the cancellation can't compact the tracked buffers
+	CancelScope scope(2);
+	ManualBuffer b4;
+	scope.start(b1, Buffer::Op::READ);
+	scope.start(b2, Buffer::Op::READ);
+	b4.start(Buffer::Op::READ);
+	bool added = true;
+	addOnReady(scope, b1, b4, added);
+	EXPECT_EQ(scope.cancel(), 2);
+	EXPECT_FALSE(added);
+	EXPECT_TRUE(b2.ready());
+	b4.cancel();
+}
+
+// receiver that stores the result
+struct TestReceiver {
+	void setValue(int value) {*this->result = value;}
+	void setStopped() {*this->result = -2;}
+
+	int *result;
+};
+
+TEST(cocoTest, Sender) {
+	ManualBuffer buffer;
+	int result = -1;
+
+	// transfer completes when the buffer becomes ready, the function gets the transferred size
+	auto operation = then(transfer(buffer, 8, Buffer::Op::READ), [](int size) {return size * 2;})
+		.connect(TestReceiver{&result});
+	operation.start();
+	EXPECT_TRUE(buffer.busy());
+	EXPECT_EQ(result, -1);
+	buffer.complete(5);
+	EXPECT_EQ(result, 10);
+
+	// transfer that completes in start()
+	RegisterBuffer bus;
+	bus.registers[3] = 42;
+	bus.setHeader<uint8_t>(3);
+	auto operation2 = then(transfer(bus, 1, Buffer::Op::READ), [&bus](int size) {return int(bus[0]);})
+		.connect(TestReceiver{&result});
+	operation2.start();
+	EXPECT_EQ(result, 42);
+}
+
+Coroutine shaperTest(Loop_native &loop, TrafficShaper &shaper, ManualBuffer &d1, ManualBuffer &d2, ManualBuffer &d3) {
+	TrafficShaper::Buffer b1(shaper, d1);
+	TrafficShaper::Buffer b2(shaper, d2);
+	TrafficShaper::Buffer b3(shaper, d3);
+	auto &stats = shaper.statistics();
+
+	// writes start while the bucket contains enough tokens, then they get queued
+	b1.startWrite(4);
+	b2.startWrite(4);
+	EXPECT_TRUE(d1.busy());
+	EXPECT_TRUE(d2.busy());
+	b3.startWrite(4);
+	EXPECT_TRUE(b3.busy());
+	EXPECT_FALSE(d3.busy());
+	int delay = shaper.queueDelay();
+	EXPECT_GE(delay, 3);
+	EXPECT_LE(delay, 4);
+
+	// a queued write can be cancelled
+	EXPECT_TRUE(b3.cancel());
+	EXPECT_TRUE(b3.ready());
+	EXPECT_EQ(b3.size(), 0);
+	EXPECT_EQ(shaper.queueDelay(), 0);
+
+	// a write that is larger than the bucket waits until the bucket is full
+	b3.startWrite(12);
+	co_await loop.sleep(loop.now() + 30ms);
+	EXPECT_TRUE(d3.busy());
+	d1.complete(4);
+	d2.complete(4);
+	d3.complete(12);
+	EXPECT_TRUE(b3.ready());
+	EXPECT_EQ(b3.size(), 12);
+	EXPECT_EQ(stats.writeCount, 3);
+	EXPECT_EQ(stats.byteCount, 20);
+	EXPECT_EQ(stats.delayedCount, 1);
+
+	// changing the rate sets the timer again
+	shaper.setRate(10, 8);
+	b2.startWrite(8);
+	b1.startWrite(4);
+	EXPECT_TRUE(d2.busy());
+	EXPECT_FALSE(d1.busy());
+	EXPECT_GT(shaper.queueDelay(), 100);
+	shaper.setRate(100000, 8);
+	co_await loop.sleep(loop.now() + 20ms);
+	EXPECT_TRUE(d1.busy());
+	d1.complete(4);
+	d2.complete(8);
+	EXPECT_TRUE(b1.ready());
+
+	loop.exit();
+}
+
+TEST(cocoTest, TrafficShaper) {
+	Loop_native loop;
+	TrafficShaper shaper(loop, 1000, 8);
+	ManualBuffer d1, d2, d3;
+
+	shaperTest(loop, shaper, d1, d2, d3);
+	loop.run();
+}
+
+TEST(cocoTest, FairQueue) {
+	FairQueue queue(1, 4);
+	FairQueue::Flow bulk(queue, 1);
+	FairQueue::Flow interactive(queue, 1);
+	ManualBuffer d1, d2, d3, d4, d5;
+	FairQueue::Buffer b1(bulk, d1);
+	FairQueue::Buffer b2(bulk, d2);
+	FairQueue::Buffer b3(bulk, d3);
+	FairQueue::Buffer b4(bulk, d4);
+	FairQueue::Buffer i1(interactive, d5);
+
+	// the bulk producer starts all its buffers before the interactive producer
+	b1.startWrite(4);
+	b2.startWrite(4);
+	b3.startWrite(4);
+	b4.startWrite(4);
+	i1.startWrite(4);
+	EXPECT_TRUE(d1.busy());
+	EXPECT_FALSE(d2.busy());
+	EXPECT_EQ(queue.activeCount(), 1);
+
+	// the bulk flow was queued first and gets one transfer per round
+	d1.complete(4);
+	EXPECT_TRUE(b1.ready());
+	EXPECT_EQ(b1.size(), 4);
+	EXPECT_TRUE(d2.busy());
+
+	// then the interactive flow gets its turn before the remaining bulk transfers
+	d2.complete(4);
+	EXPECT_TRUE(b2.ready());
+	EXPECT_TRUE(d5.busy());
+	EXPECT_FALSE(d3.busy());
+
+	// cancel a queued transfer
+	EXPECT_TRUE(b4.cancel());
+	EXPECT_TRUE(b4.ready());
+	EXPECT_EQ(b4.size(), 0);
+
+	d5.complete(4);
+	EXPECT_TRUE(i1.ready());
+	EXPECT_TRUE(d3.busy());
+	d3.complete(4);
+	EXPECT_TRUE(b3.ready());
+	EXPECT_FALSE(d4.busy());
+	EXPECT_EQ(queue.activeCount(), 0);
+
+	EXPECT_EQ(bulk.statistics().transferCount, 3);
+	EXPECT_EQ(bulk.statistics().byteCount, 12);
+	EXPECT_EQ(interactive.statistics().transferCount, 1);
+
+	// an idle buffer follows the state of the device buffer
+	d1.disable();
+	EXPECT_TRUE(b1.disabled());
+	d1.enable();
+	EXPECT_TRUE(b1.ready());
+
+	// a queued transfer completes disabled when the device buffer got disabled in the meantime
+	b1.startWrite(4);
+	b2.startWrite(4);
+	EXPECT_TRUE(d1.busy());
+	d2.disable();
+	d1.complete(4);
+	EXPECT_TRUE(b1.ready());
+	EXPECT_TRUE(b2.disabled());
+	EXPECT_EQ(queue.activeCount(), 0);
+}
+
+TEST(cocoTest, BufferWrapper) {
+	ManualBuffer d;
+	RegisterCache cache(16, RegisterCache::Mode::VOLATILE);
+	{
+		RegisterCache::Buffer b(cache, d);
+
+		// the wrapper follows the wrapped buffer while idle
+		d.disable();
+		EXPECT_TRUE(b.disabled());
+		EXPECT_FALSE(b.startRead(1));
+		d.enable();
+		EXPECT_TRUE(b.ready());
+
+		// a transfer completes with the wrapped buffer
+		b.startRead(1);
+		EXPECT_TRUE(b.busy());
+		d.complete(1);
+		EXPECT_TRUE(b.ready());
+		EXPECT_EQ(b.size(), 1);
+
+		// the wrapped buffer gets disabled during a transfer
+		b.startRead(1);
+		d.disable();
+		EXPECT_TRUE(b.disabled());
+		d.enable();
+		EXPECT_TRUE(b.ready());
+
+		// a transfer that can't be forwarded completes with size 0
+		d.start(Buffer::Op::READ);
+		b.startRead(1);
+		EXPECT_TRUE(b.ready());
+		EXPECT_EQ(b.size(), 0);
+		d.cancel();
+	}
+
+	// the destroyed wrapper does not observe the wrapped buffer anymore
+	d.disable();
+	d.enable();
+}
+
 int main(int argc, char **argv) {
 	testing::InitGoogleTest(&argc, argv);
 	int success = RUN_ALL_TESTS();